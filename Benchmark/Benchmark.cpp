@@ -0,0 +1,729 @@
+/*
+
+Microbenchmark of all kernels on synthetic images
+
+Every kernel runs on square images from 256^2 up to 8192^2 pixels. A kernel is
+repeated until it ran for at least -time seconds, the fastest repetition is
+reported as MPix/s (pixels of the input image per second) and GB/s (bytes read
+plus bytes written per second).
+
+Command line: -min N -max N   smallest / largest edge length (256 ... 8192)
+              -filter text    only kernels whose name contains text
+              -threads N      thread pool for the band-parallel stages (default 1)
+              -simd level     scalar, sse2, avx2 or avx512
+              -time sec       minimum time per kernel and size (default 0.2)
+              -tmp dir        directory for the file I/O benchmarks
+              -csv            comma separated output
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ImageProcess.h"
+#include "GaussFilter.h"
+#include "RecursiveGauss.h"
+#include "GrayPipeline.h"
+#include "FrameArena.h"
+#include "Histogram.h"
+#include "IntegralImage.h"
+#include "ImagePyramid.h"
+#include "Warp.h"
+#include "AffineTransform.h"
+#include "ColorPipeline.h"
+#include "ColorImage.h"
+#include "BitMask.h"
+#include "ConnectedComponents.h"
+#include "Morphology.h"
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
+#include "PGM_IO.h"
+#include "PPM_IO.h"
+
+struct BenchOptions
+{
+	int minSize;
+	int maxSize;
+	std::string filter;
+	int numThreads;
+	double minTime;
+	std::string tmpDir;
+	bool csv;
+
+	BenchOptions() : minSize(256), maxSize(8192), numThreads(1), minTime(0.2), tmpDir("."), csv(false) {}
+};
+
+// one kernel on one image size
+struct BenchCase
+{
+	std::string name;
+	double bytes;				// bytes read plus bytes written per run
+	std::function<void()> run;
+};
+
+static unsigned int xorShift(unsigned int & state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static void fillGray(unsigned char * pImg, const int width, const int height)
+/*smooth gradient with noise, so that histogram and energy are not degenerate*/
+{
+	unsigned int state = 2463534242u;
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+			pImg[(size_t)y * width + x] = (unsigned char)(((x + y) * 128 / (width + height)) + 32 + (xorShift(state) & 63));
+}
+
+static void fillRgb(unsigned char * pRgb, const int numPixels)
+{
+	unsigned int state = 88172645u;
+	for (int i = 0; i < numPixels; i++)
+	{
+		const unsigned int r = xorShift(state);
+		pRgb[3 * i + 0] = (unsigned char)r;
+		pRgb[3 * i + 1] = (unsigned char)(r >> 8);
+		pRgb[3 * i + 2] = (unsigned char)(r >> 16);
+	}
+}
+
+static double timeCase(const BenchCase & bench, const double minTime)
+/*seconds of the fastest run, after one warm-up run*/
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	bench.run();
+
+	double best = 1e30;
+	double total = 0;
+	int runs = 0;
+	while (runs < 3 || total < minTime)
+	{
+		const Clock::time_point start = Clock::now();
+		bench.run();
+		const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		best = std::min(best, seconds);
+		total += seconds;
+		++runs;
+	}
+	return best;
+}
+
+static void report(const BenchCase & bench, const int size, const double seconds, const bool csv)
+{
+	const double mpix = (double)size * size / seconds * 1e-6;
+	const double gbs = bench.bytes / seconds * 1e-9;
+	if (csv)
+		printf("%s,%d,%.6f,%.2f,%.3f\n", bench.name.c_str(), size, seconds * 1e3, mpix, gbs);
+	else
+		printf("%-28s %5d^2 %11.3f ms %10.1f MPix/s %8.2f GB/s\n", bench.name.c_str(), size, seconds * 1e3, mpix, gbs);
+	fflush(stdout);
+}
+
+static void addGrayCases(std::vector<BenchCase> & cases, const int size, ThreadPool * pPool,
+	const std::vector<unsigned char> & gray, std::vector<unsigned char> & half,
+	std::vector<unsigned char> & work, std::vector<unsigned char> & out,
+	std::vector<unsigned short> & work16, IntegralImage & integral)
+{
+	const int w = size;
+	const int h = size;
+	const int w2 = w / 2;
+	const int h2 = h / 2;
+	const double n = (double)w * h;
+	const double n2 = (double)w2 * h2;
+	const unsigned char * pGray = &gray[0];
+	unsigned char * pHalf = &half[0];
+	unsigned char * pWork = &work[0];
+	unsigned char * pOut = &out[0];
+	unsigned short * pWork16 = &work16[0];
+	IntegralImage * pIntegral = &integral;
+
+	BenchCase bench;
+
+	// scaleHalf reads every second row
+	bench.name = "scaleHalf";
+	bench.bytes = n / 2 + n2;
+	bench.run = [=]() { scaleHalf(pHalf, pGray, w, h, pPool); };
+	cases.push_back(bench);
+
+	// reads every source row once
+	bench.name = "downsampleHalf";
+	bench.bytes = n + n2;
+	bench.run = [=]()
+	{
+		downsampleHalf(ImageViewT<unsigned char>(pHalf, h2, w2, w2), ImageViewT<const unsigned char>(pGray, h, w, w), pPool);
+	};
+	cases.push_back(bench);
+
+	// all levels from scratch, about 4/3 of the base image written
+	bench.name = "ImagePyramid all levels";
+	bench.bytes = n + n / 3;
+	bench.run = [=]()
+	{
+		ImagePyramid pyramid(ImageViewT<const unsigned char>(pGray, h, w, w), pPool);
+		pyramid.level(pyramid.numLevels() - 1);
+	};
+	cases.push_back(bench);
+
+	bench.name = "filterGaussian3x3";
+	bench.bytes = 2 * n;
+	bench.run = [=]() { filterGaussian3x3(pOut, pGray, w, h, pPool); };
+	cases.push_back(bench);
+
+	bench.name = "filterGaussian3x3 in-place";
+	bench.bytes = 2 * n;
+	bench.run = [=]() { filterGaussian3x3(pWork, w, h); };
+	cases.push_back(bench);
+
+	// two float passes and two float transposes, the same cost for every sigma
+	bench.name = "filterGaussianRecursive s=2";
+	bench.bytes = 2 * n;
+	bench.run = [=]() { filterGaussianRecursive(pOut, pGray, w, h, 2.f, pPool); };
+	cases.push_back(bench);
+
+	bench.name = "filterGaussianRecursive s=50";
+	bench.bytes = 2 * n;
+	bench.run = [=]() { filterGaussianRecursive(pOut, pGray, w, h, 50.f, pPool); };
+	cases.push_back(bench);
+
+	// an angle that is not a multiple of 90 degrees, every output pixel samples
+	static const char * const rotateNames[3] = { "rotateImage nearest", "rotateImage bilinear", "rotateImage bicubic" };
+	for (int mode = INTERPOLATION_NEAREST; mode <= INTERPOLATION_BICUBIC; mode++)
+	{
+		bench.name = rotateNames[mode];
+		bench.bytes = 2 * n;
+		bench.run = [=]()
+		{
+			rotateImage(ImageViewT<unsigned char>(pOut, h, w, w), ImageViewT<const unsigned char>(pGray, h, w, w),
+				13., (InterpolationMode)mode, pPool);
+		};
+		cases.push_back(bench);
+	}
+
+	// histogram pass plus mapping pass
+	bench.name = "stretchHistogram";
+	bench.bytes = 3 * n;
+	bench.run = [=]() { memcpy(pWork, pGray, (size_t)w * h); stretchHistogram(pWork, w, h, 0.05f, pPool); };
+	cases.push_back(bench);
+
+	bench.name = "computeHistogram";
+	bench.bytes = n;
+	bench.run = [=]()
+	{
+		unsigned int histogram[256];
+		computeHistogram(ImageViewT<const unsigned char>(pGray, h, w, w), histogram, pPool);
+	};
+	cases.push_back(bench);
+
+	// 12 bit samples
+	bench.name = "stretchPercentile 16u";
+	bench.bytes = 6 * n;
+	bench.run = [=]()
+	{
+		for (size_t i = 0; i < (size_t)w * h; i++)
+			pWork16[i] = (unsigned short)(pGray[i] << 4);
+		stretchPercentile(ImageViewT<unsigned short>(pWork16, h, w, w), 4095, 0.05f, pPool);
+	};
+	cases.push_back(bench);
+
+	bench.name = "IntegralImage compute";
+	bench.bytes = n + 16 * n;
+	bench.run = [=]() { pIntegral->compute(ImageViewT<const unsigned char>(pGray, h, w, w), pPool); };
+	cases.push_back(bench);
+
+	// 10000 regions of 1/8 x 1/8 of the image, MPix/s counts the image once
+	bench.name = "IntegralImage 10000 ROIs";
+	bench.bytes = 0;
+	bench.run = [=]()
+	{
+		double total = 0;
+		unsigned int state = 12345;
+		for (int i = 0; i < 10000; i++)
+		{
+			const int r = xorShift(state) % (h - h / 8);
+			const int c = xorShift(state) % (w - w / 8);
+			total += pIntegral->mean(r, c, r + h / 8, c + w / 8) + pIntegral->variance(r, c, r + h / 8, c + w / 8);
+		}
+		volatile double sink = total;
+		(void)sink;
+	};
+	cases.push_back(bench);
+
+	bench.name = "IntegralImage boxFilter r7";
+	bench.bytes = 16 * n + n;
+	bench.run = [=]() { pIntegral->boxFilter(ImageViewT<unsigned char>(pOut, h, w, w), 7, pPool); };
+	cases.push_back(bench);
+
+	bench.name = "computeEnergy";
+	bench.bytes = 2 * n;
+	bench.run = [=]() { computeEnergy(pOut, pGray, w, h, pPool); };
+	cases.push_back(bench);
+
+	bench.name = "computeEnergy sobel";
+	bench.bytes = 2 * n;
+	bench.run = [=]() { computeEnergy(pOut, pGray, w, h, pPool, GRADIENT_SOBEL); };
+	cases.push_back(bench);
+
+	bench.name = "computeEnergy scharr";
+	bench.bytes = 2 * n;
+	bench.run = [=]() { computeEnergy(pOut, pGray, w, h, pPool, GRADIENT_SCHARR); };
+	cases.push_back(bench);
+
+	bench.name = "thresholdImage";
+	bench.bytes = 2 * n;
+	bench.run = [=]() { thresholdImage(pWork, w, h, 30, pPool); };
+	cases.push_back(bench);
+
+	// the same masks with one bit per pixel
+	std::shared_ptr<BitMask> pMask(new BitMask(h, w));
+	std::shared_ptr<BitMask> pMask2(new BitMask(h, w));
+	bench.name = "thresholdToMask";
+	bench.bytes = n + n / 8;
+	bench.run = [=]() { thresholdToMask(*pMask, ImageViewT<const unsigned char>(pGray, h, w, w), 30, pPool); };
+	cases.push_back(bench);
+
+	bench.name = "gradientToMask";
+	bench.bytes = n + n / 8;
+	bench.run = [=]() { gradientToMask(*pMask2, ImageViewT<const unsigned char>(pGray, h, w, w), 30, GRADIENT_CENTRAL, pPool); };
+	cases.push_back(bench);
+
+	bench.name = "BitMask and + count";
+	bench.bytes = 3 * n / 8;
+	bench.run = [=]()
+	{
+		*pMask2 &= *pMask;
+		volatile long long sink = pMask2->count();
+		(void)sink;
+	};
+	cases.push_back(bench);
+
+	bench.name = "expandMask";
+	bench.bytes = n / 8 + n;
+	bench.run = [=]() { expandMask(ImageViewT<unsigned char>(pOut, h, w, w), *pMask, 255, pPool); };
+	cases.push_back(bench);
+
+	bench.name = "morphology open 5x5";
+	bench.bytes = 2 * n;
+	bench.run = [=]()
+	{
+		morphology(ImageViewT<unsigned char>(pOut, h, w, w), ImageViewT<const unsigned char>(pWork, h, w, w),
+			MORPH_OPEN, 5, 5, pPool);
+	};
+	cases.push_back(bench);
+
+	std::shared_ptr<BitMask> pOpened(new BitMask(h, w));
+	bench.name = "morphology open 5x5 bits";
+	bench.bytes = n / 4;
+	bench.run = [=]() { morphology(*pOpened, *pMask, MORPH_OPEN, 5, 5, pPool); };
+	cases.push_back(bench);
+
+	// blobs of the gradient mask
+	std::shared_ptr<ConnectedComponents> pComponents(new ConnectedComponents(CONNECTIVITY_8));
+	bench.name = "ConnectedComponents label";
+	bench.bytes = n / 8;
+	bench.run = [=]() { pComponents->label(*pMask2, pPool); };
+	cases.push_back(bench);
+
+	bench.name = "runGrayPipelineFused";
+	bench.bytes = n / 2 + 2 * n2;
+	bench.run = [=]()
+	{
+		GrayPipelineBuffers buffers;
+		buffers.pFiltered = pHalf;
+		buffers.pEnergyThresh = pOut;
+		runGrayPipelineFused(pGray, w, h, 0.05f, 30, buffers, pPool);
+	};
+	cases.push_back(bench);
+
+	// the same as one frame of main(): line buffers and pFiltered from the arena
+	std::shared_ptr<FrameArena> pArena(new FrameArena());
+	bench.name = "runGrayPipelineFused arena";
+	bench.run = [=]()
+	{
+		GrayPipelineBuffers buffers;
+		buffers.pFiltered = pArena->allocateArray<unsigned char>((size_t)n2);
+		buffers.pEnergyThresh = pOut;
+		runGrayPipelineFused(pGray, w, h, 0.05f, 30, buffers, pPool, pArena.get());
+		pArena->reset();
+	};
+	cases.push_back(bench);
+}
+
+static void addColorCases(std::vector<BenchCase> & cases, const int size, ThreadPool * pPool,
+	const std::vector<unsigned char> & rgb, std::vector<rtcvRgbaValue> & rgba,
+	const ColorImage & planar, ColorImage & hsv, ColorSegmenter & segmenter,
+	std::vector<unsigned char> & out)
+{
+	const int numPixels = size * size;
+	const double n = numPixels;
+	const unsigned char * pRgb = &rgb[0];
+	rtcvRgbaValue * pRgba = &rgba[0];
+	unsigned char * pOut = &out[0];
+	const ColorImage * pPlanar = &planar;
+	ColorImage * pHsv = &hsv;
+	ColorSegmenter * pSegmenter = &segmenter;
+
+	BenchCase bench;
+
+	bench.name = "convertRgbToRgba";
+	bench.bytes = 7 * n;
+	bench.run = [=]() { convertRgbToRgba(pRgba, pRgb, numPixels); };
+	cases.push_back(bench);
+
+	bench.name = "dominantHueBin";
+	bench.bytes = 4 * n;
+	bench.run = [=]() { dominantHueBin(pRgba, numPixels); };
+	cases.push_back(bench);
+
+	bench.name = "segmentHue";
+	bench.bytes = 5 * n;
+	bench.run = [=]() { segmentHue(pOut, pRgba, numPixels, 3); };
+	cases.push_back(bench);
+
+	// first pass converts and counts, second pass only compares the cached planes
+	bench.name = "ColorSegmenter analyze";
+	bench.bytes = 7 * n;
+	bench.run = [=]() { pSegmenter->analyze(ColorView::fromRgba(pRgba, size, size), pPool); };
+	cases.push_back(bench);
+
+	bench.name = "ColorSegmenter segment";
+	bench.bytes = 4 * n;
+	bench.run = [=]() { pSegmenter->segment(ImageViewT<unsigned char>(pOut, size, size, size), 3, pPool); };
+	cases.push_back(bench);
+
+	std::shared_ptr<BitMask> pHueMask(new BitMask(size, size));
+	bench.name = "ColorSegmenter segment bits";
+	bench.bytes = 3 * n + n / 8;
+	bench.run = [=]() { pSegmenter->segment(*pHueMask, 3, pPool); };
+	cases.push_back(bench);
+
+	bench.name = "convertRgbToHsv rgba";
+	bench.bytes = 7 * n;
+	bench.run = [=]() { convertRgbToHsv(ColorView::fromRgba(pRgba, size, size), *pHsv, pPool); };
+	cases.push_back(bench);
+
+	bench.name = "convertRgbToHsv planar";
+	bench.bytes = 6 * n;
+	bench.run = [=]() { convertRgbToHsv(pPlanar->view(), *pHsv, pPool); };
+	cases.push_back(bench);
+}
+
+static void addFileCases(std::vector<BenchCase> & cases, const int size, const std::string & tmpDir,
+	const std::vector<unsigned char> & gray, const std::vector<rtcvRgbaValue> & rgba)
+{
+	const int w = size;
+	const int h = size;
+	const double n = (double)w * h;
+	const unsigned char * pGray = &gray[0];
+	const rtcvRgbaValue * pRgba = &rgba[0];
+	const std::string pgmName = tmpDir + "/bench_tmp.pgm";
+	const std::string ppmName = tmpDir + "/bench_tmp.ppm";
+
+	BenchCase bench;
+
+	bench.name = "writePGM";
+	bench.bytes = 2 * n;
+	bench.run = [=]() { writePGM(pgmName.c_str(), pGray, w, h); };
+	cases.push_back(bench);
+
+	bench.name = "readPGM";
+	bench.bytes = 2 * n;
+	bench.run = [=]()
+	{
+		unsigned char * pData = 0;
+		int sx, sy;
+		readPGM(pgmName.c_str(), &pData, sx, sy);
+		free(pData);
+	};
+	cases.push_back(bench);
+
+	bench.name = "writePPM";
+	bench.bytes = 7 * n;
+	bench.run = [=]() { writePPM(ppmName.c_str(), pRgba, w, h); };
+	cases.push_back(bench);
+
+	bench.name = "readPPM";
+	bench.bytes = 7 * n;
+	bench.run = [=]()
+	{
+		rtcvRgbaValue * pData = 0;
+		int sx, sy;
+		readPPM(ppmName.c_str(), &pData, sx, sy);
+		free(pData);
+	};
+	cases.push_back(bench);
+}
+
+static void addImageCases(std::vector<BenchCase> & cases, const int size, Image & src, Image & second,
+	Image & work)
+/*the methods that replace their argument work on a copy of src, which is part of the time*/
+{
+	const double n = (double)size * size;
+	Image * pSrc = &src;
+	Image * pSecond = &second;
+	Image * pWork = &work;
+	const int rows = size;
+	const int cols = size;
+
+	BenchCase bench;
+
+	bench.name = "Image copy";
+	bench.bytes = 2 * n;
+	bench.run = [=]() { *pWork = *pSrc; };
+	cases.push_back(bench);
+
+	bench.name = "Image getPixelVal";
+	bench.bytes = n;
+	bench.run = [=]()
+	{
+		unsigned int sum = 0;
+		for (int r = 0; r < rows; r++)
+			for (int c = 0; c < cols; c++)
+				sum += pSrc->getPixelVal(r, c);
+		volatile unsigned int sink = sum;
+		(void)sink;
+	};
+	cases.push_back(bench);
+
+	bench.name = "Image setPixelVal";
+	bench.bytes = n;
+	bench.run = [=]()
+	{
+		for (int r = 0; r < rows; r++)
+			for (int c = 0; c < cols; c++)
+				pWork->setPixelVal(r, c, (unsigned char)(r + c));
+	};
+	cases.push_back(bench);
+
+	bench.name = "Image inBounds";
+	bench.bytes = 0;
+	bench.run = [=]()
+	{
+		int inside = 0;
+		for (int r = -1; r <= rows; r++)
+			for (int c = -1; c <= cols; c++)
+				inside += pSrc->inBounds(r, c);
+		volatile int sink = inside;
+		(void)sink;
+	};
+	cases.push_back(bench);
+
+	// copies the centre quarter out of the image
+	bench.name = "Image getSubImage";
+	bench.bytes = 2 * n + n / 2;
+	bench.run = [=]() { *pWork = *pSrc; pWork->getSubImage(rows / 4, cols / 4, rows * 3 / 4, cols * 3 / 4, *pWork); };
+	cases.push_back(bench);
+
+	bench.name = "Image meanGray";
+	bench.bytes = n;
+	bench.run = [=]()
+	{
+		volatile int sink = pSrc->meanGray();
+		(void)sink;
+	};
+	cases.push_back(bench);
+
+	bench.name = "Image enlargeImage x2";
+	bench.bytes = 2 * n + 4 * n;
+	bench.run = [=]() { *pWork = *pSrc; pWork->enlargeImage(2, *pWork); };
+	cases.push_back(bench);
+
+	bench.name = "Image shrinkImage /2";
+	bench.bytes = 2 * n + n / 2 + n / 4;
+	bench.run = [=]() { *pWork = *pSrc; pWork->shrinkImage(2, *pWork); };
+	cases.push_back(bench);
+
+	bench.name = "Image reflectImage rows";
+	bench.bytes = 4 * n;
+	bench.run = [=]() { *pWork = *pSrc; pWork->reflectImage(true, *pWork); };
+	cases.push_back(bench);
+
+	bench.name = "Image reflectImage cols";
+	bench.bytes = 4 * n;
+	bench.run = [=]() { *pWork = *pSrc; pWork->reflectImage(false, *pWork); };
+	cases.push_back(bench);
+
+	bench.name = "Image translateImage";
+	bench.bytes = 4 * n;
+	bench.run = [=]() { *pWork = *pSrc; pWork->translateImage(16, *pWork); };
+	cases.push_back(bench);
+
+	bench.name = "Image rotateImage 30";
+	bench.bytes = 4 * n;
+	bench.run = [=]() { *pWork = *pSrc; pWork->rotateImage(30, *pWork); };
+	cases.push_back(bench);
+
+	// a per-frame normalization: four passes and temporaries with the methods,
+	// one resampling pass into a reused buffer with LazyWarp
+	bench.name = "Image normalize 4 passes";
+	bench.bytes = 2 * n + 4 * n + 4 * n + 4 * n + n + n / 4;
+	bench.run = [=]()
+	{
+		*pWork = *pSrc;
+		pWork->reflectImage(true, *pWork);
+		pWork->rotateImage(7, *pWork);
+		pWork->translateImage(16, *pWork);
+		pWork->shrinkImage(2, *pWork);
+	};
+	cases.push_back(bench);
+
+	std::shared_ptr<LazyWarp> pWarp(new LazyWarp(INTERPOLATION_BILINEAR));
+	bench.name = "LazyWarp normalize 1 pass";
+	bench.bytes = n + n / 4;
+	bench.run = [=]()
+	{
+		pWarp->setSource(static_cast<const Image &>(*pSrc).view());
+		pWarp->transform().reflect(true).rotate(7).translate(16, 16).scale(0.5);
+		pWarp->result();
+	};
+	cases.push_back(bench);
+
+	bench.name = "Image operator+";
+	bench.bytes = 3 * n;
+	bench.run = [=]() { Image sum = *pSrc + *pSecond; };
+	cases.push_back(bench);
+
+	bench.name = "Image operator-";
+	bench.bytes = 3 * n;
+	bench.run = [=]() { Image diff = *pSrc - *pSecond; };
+	cases.push_back(bench);
+
+	// the same chain with a materialized temporary and as one expression
+	bench.name = "Image (a + b) - c 2 passes";
+	bench.bytes = 3 * n + 3 * n;
+	bench.run = [=]()
+	{
+		Image sum = *pSrc + *pSecond;
+		*pWork = sum - *pSrc;
+	};
+	cases.push_back(bench);
+
+	bench.name = "Image (a + b) - c fused";
+	bench.bytes = 3 * n;
+	bench.run = [=]() { *pWork = (*pSrc + *pSecond) - *pSrc; };
+	cases.push_back(bench);
+
+	bench.name = "Image negateImage";
+	bench.bytes = 2 * n;
+	bench.run = [=]() { pSrc->negateImage(*pWork); };
+	cases.push_back(bench);
+}
+
+static bool parseSimdLevel(const char * name, SimdLevel & level)
+{
+	const SimdLevel levels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2, SIMD_AVX512 };
+	const char * names[] = { "scalar", "sse2", "avx2", "avx512" };
+	for (int i = 0; i < 4; i++)
+	{
+		if (0 == strcmp(name, names[i]))
+		{
+			level = levels[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+int main(int argc, char* argv[])
+{
+	BenchOptions options;
+	for (int i = 1; i < argc; i++)
+	{
+		SimdLevel level;
+		if (0 == strcmp(argv[i], "-min") && i + 1 < argc)
+			options.minSize = atoi(argv[++i]);
+		else if (0 == strcmp(argv[i], "-max") && i + 1 < argc)
+			options.maxSize = atoi(argv[++i]);
+		else if (0 == strcmp(argv[i], "-filter") && i + 1 < argc)
+			options.filter = argv[++i];
+		else if (0 == strcmp(argv[i], "-threads") && i + 1 < argc)
+			options.numThreads = atoi(argv[++i]);
+		else if (0 == strcmp(argv[i], "-time") && i + 1 < argc)
+			options.minTime = atof(argv[++i]);
+		else if (0 == strcmp(argv[i], "-tmp") && i + 1 < argc)
+			options.tmpDir = argv[++i];
+		else if (0 == strcmp(argv[i], "-csv"))
+			options.csv = true;
+		else if (0 == strcmp(argv[i], "-simd") && i + 1 < argc && parseSimdLevel(argv[i + 1], level))
+		{
+			setSimdLevel(level);
+			++i;
+		}
+		else
+		{
+			printf("Unknown option %s\n", argv[i]);
+			return -1;
+		}
+	}
+
+	// a single thread runs the stages without a pool, as the batch workers do
+	ThreadPool * pPool = (options.numThreads == 1) ? NULL : new ThreadPool(options.numThreads);
+
+	if (options.csv)
+		printf("kernel,size,ms,MPix/s,GB/s\n");
+	else
+		printf("SIMD: %s, threads: %d\n", simdLevelName(simdLevel()), pPool ? pPool->numThreads() : 1);
+
+	for (int size = 256; size <= 8192; size *= 2)
+	{
+		if (size < options.minSize || size > options.maxSize)
+			continue;
+
+		const size_t numPixels = (size_t)size * size;
+		std::vector<unsigned char> gray(numPixels);
+		std::vector<unsigned char> work(numPixels);
+		std::vector<unsigned char> out(numPixels);
+		std::vector<unsigned char> half(numPixels / 4);
+		std::vector<unsigned short> work16(numPixels);
+		IntegralImage integral;
+		std::vector<unsigned char> rgb(numPixels * 3);
+		std::vector<rtcvRgbaValue> rgba(numPixels);
+		fillGray(&gray[0], size, size);
+		memcpy(&work[0], &gray[0], numPixels);
+		fillRgb(&rgb[0], (int)numPixels);
+		convertRgbToRgba(&rgba[0], &rgb[0], (int)numPixels);
+		const ColorImage planar(ColorView::fromRgba(&rgba[0], size, size));
+		ColorImage hsv;
+		ColorSegmenter segmenter;
+
+		Image src(size, size, 255);
+		Image second(size, size, 255);
+		Image imgWork;
+		for (int r = 0; r < size; r++)
+		{
+			memcpy(src.rowPtr(r), &gray[(size_t)r * size], size);
+			for (int c = 0; c < size; c++)
+				second.rowPtr(r)[c] = gray[(size_t)r * size + size - 1 - c];
+		}
+
+		std::vector<BenchCase> cases;
+		addGrayCases(cases, size, pPool, gray, half, work, out, work16, integral);
+		addColorCases(cases, size, pPool, rgb, rgba, planar, hsv, segmenter, out);
+		addFileCases(cases, size, options.tmpDir, gray, rgba);
+		addImageCases(cases, size, src, second, imgWork);
+
+		for (size_t i = 0; i < cases.size(); i++)
+		{
+			if (!options.filter.empty() && cases[i].name.find(options.filter) == std::string::npos)
+				continue;
+			report(cases[i], size, timeCase(cases[i], options.minTime), options.csv);
+		}
+	}
+
+	remove((options.tmpDir + "/bench_tmp.pgm").c_str());
+	remove((options.tmpDir + "/bench_tmp.ppm").c_str());
+	delete pPool;
+
+	return 0;
+}
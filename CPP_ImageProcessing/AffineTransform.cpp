@@ -0,0 +1,108 @@
+/*
+
+Composition of geometric operations into one affine map
+
+*/
+
+#include <math.h>
+#include "AffineTransform.h"
+
+void AffineTransform::reset(int rows, int cols)
+{
+	m_fwd[0] = 1;
+	m_fwd[1] = 0;
+	m_fwd[2] = 0;
+	m_fwd[3] = 0;
+	m_fwd[4] = 1;
+	m_fwd[5] = 0;
+	m_srcRows = m_rows = rows;
+	m_srcCols = m_cols = cols;
+}
+
+void AffineTransform::append(const double b[6])
+{
+	const double a[6] = { m_fwd[0], m_fwd[1], m_fwd[2], m_fwd[3], m_fwd[4], m_fwd[5] };
+
+	m_fwd[0] = b[0] * a[0] + b[1] * a[3];
+	m_fwd[1] = b[0] * a[1] + b[1] * a[4];
+	m_fwd[2] = b[0] * a[2] + b[1] * a[5] + b[2];
+	m_fwd[3] = b[3] * a[0] + b[4] * a[3];
+	m_fwd[4] = b[3] * a[1] + b[4] * a[4];
+	m_fwd[5] = b[3] * a[2] + b[4] * a[5] + b[5];
+}
+
+AffineTransform & AffineTransform::translate(double dRow, double dCol)
+{
+	const double b[6] = { 1, 0, dCol, 0, 1, dRow };
+	append(b);
+	return *this;
+}
+
+AffineTransform & AffineTransform::rotate(double angleDegrees)
+/*the forward map of rotationMap() (Warp.h): rotation matrix [cos sin; -sin cos]
+around (c0, r0)*/
+{
+	const double rads = angleDegrees * 3.14159265358979323846 / 180.0;
+	double cosA = cos(rads);
+	double sinA = sin(rads);
+
+	// exact quarter turns keep nearest sampling free of rounding noise
+	if (fabs(cosA) < 1e-12)
+		cosA = 0;
+	if (fabs(sinA) < 1e-12)
+		sinA = 0;
+
+	const double r0 = m_rows / 2;
+	const double c0 = m_cols / 2;
+	const double b[6] = { cosA, sinA, c0 - cosA * c0 - sinA * r0, -sinA, cosA, r0 + sinA * c0 - cosA * r0 };
+	append(b);
+	return *this;
+}
+
+AffineTransform & AffineTransform::reflect(bool horizontal)
+{
+	if (horizontal)
+	{
+		const double b[6] = { 1, 0, 0, 0, -1, (double)(m_rows - 1) };
+		append(b);
+	}
+	else
+	{
+		const double b[6] = { -1, 0, (double)(m_cols - 1), 0, 1, 0 };
+		append(b);
+	}
+	return *this;
+}
+
+AffineTransform & AffineTransform::scale(double factor)
+/*pixel centers stay centered: the pixel area [x - 0.5, x + 0.5] goes to
+[(x - 0.5) * factor, (x + 0.5) * factor] shifted by 0.5*/
+{
+	const double offset = 0.5 * (factor - 1);
+	const double b[6] = { factor, 0, offset, 0, factor, offset };
+	append(b);
+
+	// the small epsilon keeps exact results like 9 * (1 / 3.) from rounding down
+	m_rows = (int)floor(m_rows * factor + 1e-9);
+	m_cols = (int)floor(m_cols * factor + 1e-9);
+	return *this;
+}
+
+bool AffineTransform::isIdentity() const
+{
+	return m_fwd[0] == 1 && m_fwd[1] == 0 && m_fwd[2] == 0 && m_fwd[3] == 0 && m_fwd[4] == 1 && m_fwd[5] == 0
+		&& m_rows == m_srcRows && m_cols == m_srcCols;
+}
+
+void AffineTransform::inverseMap(double m[6]) const
+{
+	const double det = m_fwd[0] * m_fwd[4] - m_fwd[1] * m_fwd[3];
+	const double inv = (det != 0) ? 1 / det : 0;
+
+	m[0] = m_fwd[4] * inv;
+	m[1] = -m_fwd[1] * inv;
+	m[3] = -m_fwd[3] * inv;
+	m[4] = m_fwd[0] * inv;
+	m[2] = -(m[0] * m_fwd[2] + m[1] * m_fwd[5]);
+	m[5] = -(m[3] * m_fwd[2] + m[4] * m_fwd[5]);
+}
@@ -0,0 +1,160 @@
+#ifndef __AFFINE_TRANSFORM_H__
+#define __AFFINE_TRANSFORM_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 AffineTransform.h
+///
+/// Geometric operations (translate, rotate, reflect, scale) collected into one
+/// affine matrix instead of one resampling pass each. LazyWarpT keeps the
+/// operations of a frame and resamples the source once, when the result is
+/// read after the last change, into a buffer that is reused frame after frame.
+///
+//=================================================================================
+//=================================================================================
+
+#include <string.h>
+#include "ImageProcess.h"
+#include "Warp.h"
+
+class ThreadPool;
+
+/*
+Maps positions of a source image of rows x cols pixels to the output image,
+x is the column and y the row, pixel centers are at integer positions. Every
+operation works on the output of the operations before it and may change the
+output size. Only the source and the final output clip: pixels that one step
+moves out of its frame and a later step moves back in are kept, where the
+methods of ImageT would have lost them. Apart from that, with
+INTERPOLATION_NEAREST, reflections, whole-pixel translations, rotations by
+multiples of 90 degrees and integer enlargements give the same pixels as the
+methods of ImageT.
+*/
+class AffineTransform
+{
+public:
+	// identity on an image of rows x cols pixels
+	AffineTransform(int rows = 0, int cols = 0) { reset(rows, cols); }
+	void reset(int rows, int cols);
+
+	// moves the image down by dRow and right by dCol pixels
+	// (ImageT::translateImage(v) is translate(v, v))
+	AffineTransform & translate(double dRow, double dCol);
+	// rotates by angleDegrees around pixel (rows() / 2, cols() / 2), in the
+	// direction of ImageT::rotateImage
+	AffineTransform & rotate(double angleDegrees);
+	// flips the rows (horizontal == true) or the columns, like ImageT::reflectImage
+	AffineTransform & reflect(bool horizontal);
+	// scales the image by factor with pixel centers kept centered, the output
+	// gets floor(rows() * factor) x floor(cols() * factor) pixels. Output pixel
+	// x samples the source at (x + 0.5) / factor - 0.5. ImageT::enlargeImage(v)
+	// is scale(v); ImageT::shrinkImage(v) samples x * v, which is
+	// translate((v - 1) / 2., (v - 1) / 2.).scale(1. / v)
+	AffineTransform & scale(double factor);
+
+	// size of the output image
+	int rows() const { return m_rows; }
+	int cols() const { return m_cols; }
+	// size of the source image
+	int sourceRows() const { return m_srcRows; }
+	int sourceCols() const { return m_srcCols; }
+
+	bool isIdentity() const;
+	// output position = (m[0] * x + m[1] * y + m[2], m[3] * x + m[4] * y + m[5])
+	const double * matrix() const { return m_fwd; }
+	// the source position of every output pixel, the map warpAffine() takes
+	void inverseMap(double m[6]) const;
+
+private:
+	// m_fwd = b * m_fwd
+	void append(const double b[6]);
+
+	double m_fwd[6];
+	int m_srcRows;
+	int m_srcCols;
+	int m_rows;
+	int m_cols;
+};
+
+/*
+Source view plus the operations of the current frame. transform() may be
+changed any number of times, result() resamples only if it changed since the
+last call. The source pixels must stay valid until then.
+*/
+template <typename T>
+class LazyWarpT
+{
+public:
+	explicit LazyWarpT(InterpolationMode mode = INTERPOLATION_BILINEAR, ThreadPool * pPool = NULL,
+		int grayLevels = 255)
+		: m_mode(mode), m_pPool(pPool), m_grayLevels(grayLevels), m_dirty(true)
+	{
+	}
+
+	// new frame: src with the identity transform
+	void setSource(const ImageViewT<const T> & src)
+	{
+		m_src = src;
+		m_transform.reset(src.rows(), src.cols());
+		m_dirty = true;
+	}
+
+	void setMode(InterpolationMode mode)
+	{
+		m_mode = mode;
+		m_dirty = true;
+	}
+
+	// the operations of this frame, append to them through the returned reference
+	AffineTransform & transform()
+	{
+		m_dirty = true;
+		return m_transform;
+	}
+	const AffineTransform & transform() const { return m_transform; }
+
+	// src with all operations applied, computed in one pass on first read
+	ImageViewT<const T> result()
+	{
+		if (m_dirty)
+		{
+			apply();
+			m_dirty = false;
+		}
+		return static_cast<const ImageT<T> &>(m_result).view();
+	}
+
+private:
+	void apply()
+	{
+		const int rows = m_transform.rows();
+		const int cols = m_transform.cols();
+		if (m_result.rows() != rows || m_result.cols() != cols)
+			m_result = ImageT<T>(rows, cols, m_grayLevels);
+
+		if (m_transform.isIdentity())
+		{
+			for (int y = 0; y < rows; y++)
+				memcpy(m_result.rowPtr(y), m_src.rowPtr(y), cols * sizeof(T));
+			return;
+		}
+
+		double m[6];
+		m_transform.inverseMap(m);
+		warpAffine(m_result.view(), m_src, m, m_mode, m_pPool);
+	}
+
+	ImageViewT<const T> m_src;
+	AffineTransform m_transform;
+	InterpolationMode m_mode;
+	ThreadPool * m_pPool;
+	int m_grayLevels;
+	bool m_dirty;
+	ImageT<T> m_result;
+};
+
+typedef LazyWarpT<unsigned char> LazyWarp;
+typedef LazyWarpT<unsigned short> LazyWarp16u;
+typedef LazyWarpT<float> LazyWarp32f;
+
+#endif
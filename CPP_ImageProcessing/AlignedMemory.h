@@ -0,0 +1,53 @@
+#ifndef __ALIGNED_MEMORY_H__
+#define __ALIGNED_MEMORY_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 AlignedMemory.h
+///
+/// Cache-line aligned allocation used for pixel buffers, so that every image row
+/// starts on a 64 byte boundary and can be processed with aligned vector loads.
+///
+//=================================================================================
+//=================================================================================
+
+#include <stddef.h>
+#include <stdlib.h>
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+// alignment of pixel buffers and row starts (one cache line / one AVX-512 register)
+static const size_t IMAGE_ALIGNMENT = 64;
+
+inline void * alignedMalloc( size_t size, size_t alignment = IMAGE_ALIGNMENT )
+{
+	if( size == 0 )
+		size = alignment;
+
+#if defined(_MSC_VER)
+	return _aligned_malloc( size, alignment );
+#else
+	void * ptr = 0;
+	if( 0 != posix_memalign( &ptr, alignment, size ) )
+		return 0;
+	return ptr;
+#endif
+}
+
+inline void alignedFree( void * ptr )
+{
+#if defined(_MSC_VER)
+	_aligned_free( ptr );
+#else
+	free( ptr );
+#endif
+}
+
+// rounds a row length in bytes up to the next multiple of the alignment
+inline size_t alignedPitch( size_t rowBytes, size_t alignment = IMAGE_ALIGNMENT )
+{
+	return ( rowBytes + alignment - 1 ) / alignment * alignment;
+}
+
+#endif
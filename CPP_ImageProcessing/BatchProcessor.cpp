@@ -0,0 +1,345 @@
+/*
+
+Batch mode: reader thread -> worker threads -> writer thread
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <set>
+#include <thread>
+#include "BatchProcessor.h"
+#include "BoundedQueue.h"
+#include "GrayPipeline.h"
+#include "ColorPipeline.h"
+#include "FrameArena.h"
+#include "Profiler.h"
+#include "PGM_IO.h"
+#include "PPM_IO.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+// one image on its way through the batch, the buffers are malloc'ed. The result
+// is written over the input buffer, so an item only ever owns one buffer
+struct BatchItem
+{
+	std::string name;			// file name without directory and extension, unique in the batch
+	bool isColor;
+	bool ok;
+	int width;
+	int height;
+	unsigned char * pGray;		// input of the gray pipeline
+	rtcvRgbaValue * pRgb;		// input of the color pipeline
+	unsigned char * pResult;
+	int resultWidth;
+	int resultHeight;
+};
+
+static bool hasImageExtension(const std::string & fileName, bool & isColor)
+{
+	if (fileName.size() < 4)
+		return false;
+
+	std::string ext = fileName.substr(fileName.size() - 4);
+	for (size_t i = 0; i < ext.size(); i++)
+		ext[i] = (char)tolower((unsigned char)ext[i]);
+
+	isColor = (ext == ".ppm");
+	return isColor || ext == ".pgm";
+}
+
+static std::string baseName(const std::string & path)
+/*file name without directory and extension*/
+{
+	const size_t slash = path.find_last_of("/\\");
+	std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+	const size_t dot = name.find_last_of('.');
+	if (dot != std::string::npos && dot > 0)
+		name.erase(dot);
+	return name;
+}
+
+static bool listDirectory(const std::string & dir, std::vector<std::string> & files)
+/*image files of a directory in alphabetical order, false if dir is no directory*/
+{
+	std::vector<std::string> names;
+
+#if defined(_WIN32)
+	WIN32_FIND_DATAA findData;
+	HANDLE hFind = FindFirstFileA((dir + "\\*").c_str(), &findData);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return false;
+	do
+	{
+		if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+			names.push_back(findData.cFileName);
+	} while (FindNextFileA(hFind, &findData));
+	FindClose(hFind);
+#else
+	DIR * pDir = opendir(dir.c_str());
+	if (!pDir)
+		return false;
+	while (struct dirent * pEntry = readdir(pDir))
+	{
+		struct stat st;
+		const std::string path = dir + "/" + pEntry->d_name;
+		if (0 == stat(path.c_str(), &st) && S_ISREG(st.st_mode))
+			names.push_back(pEntry->d_name);
+	}
+	closedir(pDir);
+#endif
+
+	std::sort(names.begin(), names.end());
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		bool isColor;
+		if (hasImageExtension(names[i], isColor))
+			files.push_back(dir + "/" + names[i]);
+	}
+	return true;
+}
+
+bool listImageFiles(const char * path, std::vector<std::string> & files)
+{
+	if (path[0] == '@')
+	{
+		std::ifstream list(path + 1);
+		if (!list)
+			return false;
+
+		std::string line;
+		while (std::getline(list, line))
+		{
+			while (!line.empty() && (line[line.size() - 1] == '\r' || line[line.size() - 1] == ' '))
+				line.erase(line.size() - 1);
+			if (!line.empty() && line[0] != '#')
+				files.push_back(line);
+		}
+		return true;
+	}
+
+	if (listDirectory(path, files))
+		return true;
+
+	bool isColor;
+	if (!hasImageExtension(path, isColor))
+		return false;
+	files.push_back(path);
+	return true;
+}
+
+static const char * resultSuffix(bool isColor)
+{
+	return isColor ? "_hueSegmentation.pgm" : "_energyThresh.pgm";
+}
+
+static std::vector<std::string> resultNames(const std::vector<std::string> & files)
+/*base names of the results in list order. Files of the same name from
+different directories would overwrite each other's result: the first one keeps
+its name, the others become name_2, name_3 and so on, skipping names another
+input already has*/
+{
+	std::vector<std::string> names(files.size());
+	std::vector<bool> isColor(files.size(), false);
+	std::set<std::string> inputs;
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		bool color = false;
+		hasImageExtension(files[i], color);
+		isColor[i] = color;
+		names[i] = baseName(files[i]);
+		inputs.insert(names[i] + resultSuffix(color));
+	}
+
+	std::set<std::string> used;
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		const char * suffix = resultSuffix(isColor[i]);
+		if (used.insert(names[i] + suffix).second)
+			continue;
+
+		const std::string base = names[i];
+		int n = 2;
+		do
+			names[i] = base + "_" + std::to_string(n++);
+		while (inputs.count(names[i] + suffix) || !used.insert(names[i] + suffix).second);
+	}
+	return names;
+}
+
+static void readItem(BatchItem & item, const std::string & fileName, const std::string & name)
+{
+	item.name = name;
+	item.pGray = 0;
+	item.pRgb = 0;
+	item.pResult = 0;
+	item.width = item.height = 0;
+	item.resultWidth = item.resultHeight = 0;
+
+	hasImageExtension(fileName, item.isColor);
+	if (item.isColor)
+		item.ok = readPPM(fileName.c_str(), &item.pRgb, item.width, item.height);
+	else
+		item.ok = readPGM(fileName.c_str(), &item.pGray, item.width, item.height);
+}
+
+// state a worker keeps from image to image, so images of the same size do not
+// allocate in the stages
+struct BatchWorker
+{
+	ColorSegmenter segmenter;	// keeps its HSV planes
+	FrameArena frameArena;		// scratch buffers of the current image
+};
+
+static void processItem(BatchItem & item, const BatchOptions & options, BatchWorker & worker)
+/*runs on a worker thread, the stages themselves stay single threaded*/
+{
+	if (!item.ok)
+		return;
+
+	IP_PROFILE_SCOPE_IO("batch item", (long long)item.width * item.height, 0, 0);
+
+	if (item.isColor)
+	{
+		item.resultWidth = item.width;
+		item.resultHeight = item.height;
+
+		// the segmentation only reads the HSV planes, the RGBA buffer is free
+		// once they are built
+		worker.segmenter.analyze(ColorView::fromRgba(item.pRgb, item.height, item.width));
+		item.pResult = (unsigned char*)item.pRgb;
+		item.pRgb = 0;
+		worker.segmenter.segmentDominant(ImageViewT<unsigned char>(item.pResult, item.height, item.width, item.width));
+	}
+	else
+	{
+		item.resultWidth = item.width / 2;
+		item.resultHeight = item.height / 2;
+		if (item.resultWidth < 3 || item.resultHeight < 3)
+		{
+			item.ok = false;
+			return;
+		}
+
+		// the second pass only reads pFiltered, so the thresholded result can
+		// overwrite the input
+		const size_t numPixels = (size_t)item.resultWidth * item.resultHeight;
+		GrayPipelineBuffers buffers;
+		buffers.pFiltered = worker.frameArena.allocateArray<unsigned char>(numPixels);
+		buffers.pEnergyThresh = item.pGray;
+		runGrayPipelineFused(item.pGray, item.width, item.height, options.cutOffPercentage,
+			options.threshold, buffers, NULL, &worker.frameArena);
+
+		item.pResult = item.pGray;
+		item.pGray = 0;
+	}
+
+	IP_PROFILE_COUNTER("frame arena bytes", worker.frameArena.used());
+	worker.frameArena.reset();
+}
+
+static void releaseItem(BatchItem & item)
+{
+	free(item.pGray);
+	free(item.pRgb);
+	free(item.pResult);
+	item.pGray = 0;
+	item.pRgb = 0;
+	item.pResult = 0;
+}
+
+bool runBatch(const std::vector<std::string> & files, const BatchOptions & options, BatchStats & stats)
+{
+	const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	int numWorkers = options.numWorkers;
+	if (numWorkers <= 0)
+		numWorkers = std::max(1, (int)std::thread::hardware_concurrency());
+
+	BoundedQueue<BatchItem> loaded(options.queueDepth);
+	BoundedQueue<BatchItem> processed(options.queueDepth);
+
+	stats.numImages = 0;
+	stats.numFailed = 0;
+
+	const std::vector<std::string> names = resultNames(files);
+
+	// reader: files in list order
+	std::thread reader([&]()
+	{
+		IP_PROFILE_THREAD_NAME("batch reader");
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			BatchItem item;
+			readItem(item, files[i], names[i]);
+			if (!item.ok)
+				printf("Reading %s failed!\n", files[i].c_str());
+			if (!loaded.push(item))
+			{
+				releaseItem(item);
+				break;
+			}
+		}
+		loaded.close();
+	});
+
+	// workers: one image each, as many images in parallel as there are workers
+	std::vector<std::thread> workers;
+	std::atomic<int> activeWorkers(numWorkers);
+	for (int w = 0; w < numWorkers; w++)
+	{
+		workers.push_back(std::thread([&]()
+		{
+			IP_PROFILE_THREAD_NAME("batch worker");
+			BatchWorker worker;
+			BatchItem item;
+			while (loaded.pop(item))
+			{
+				processItem(item, options, worker);
+				processed.push(item);
+			}
+			if (--activeWorkers == 0)
+				processed.close();
+		}));
+	}
+
+	// writer: runs on the calling thread
+	BatchItem item;
+	while (processed.pop(item))
+	{
+		bool ok = item.ok;
+		if (ok)
+		{
+			const std::string outName = options.outDir + "/" + item.name + resultSuffix(item.isColor);
+			ok = writePGM(outName.c_str(), item.pResult, item.resultWidth, item.resultHeight);
+			if (!ok)
+				printf("Writing %s failed!\n", outName.c_str());
+		}
+		releaseItem(item);
+
+		if (ok)
+			++stats.numImages;
+		else
+			++stats.numFailed;
+	}
+
+	reader.join();
+	for (size_t w = 0; w < workers.size(); w++)
+		workers[w].join();
+
+	stats.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	return stats.numFailed == 0;
+}
@@ -0,0 +1,45 @@
+#ifndef __BATCH_PROCESSOR_H__
+#define __BATCH_PROCESSOR_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 BatchProcessor.h
+///
+/// Runs the gray pipeline over PGM files and the hue segmentation over PPM files
+/// for many images in one process. A reader thread, worker threads and a writer
+/// thread are connected by bounded queues, so reading and writing files overlaps
+/// with the computation.
+///
+//=================================================================================
+//=================================================================================
+
+#include <string>
+#include <vector>
+
+struct BatchOptions
+{
+	std::string outDir;		// results go to outDir/<name>_energyThresh.pgm or _hueSegmentation.pgm
+	int numWorkers;			// <= 0: one per hardware thread
+	int queueDepth;			// images in flight between two stages
+	float cutOffPercentage;	// histogram stretch of the gray pipeline
+	unsigned char threshold;	// energy threshold of the gray pipeline
+
+	BatchOptions() : outDir("."), numWorkers(0), queueDepth(8), cutOffPercentage(0.05f), threshold(30) {}
+};
+
+struct BatchStats
+{
+	int numImages;		// images written
+	int numFailed;		// images that could not be read or written
+	double seconds;		// wall clock time of the whole batch
+};
+
+// appends the .pgm and .ppm files of a directory, the files listed one per line
+// in a text file given as @list.txt, or the file itself to files
+bool listImageFiles(const char * path, std::vector<std::string> & files);
+
+// processes all files, returns false if any of them failed. Files of the same
+// name from different directories get the results <name>_2, <name>_3, ...
+bool runBatch(const std::vector<std::string> & files, const BatchOptions & options, BatchStats & stats);
+
+#endif
@@ -0,0 +1,534 @@
+/*
+
+Bit-packed binary masks
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "BitMask.h"
+#include "AlignedMemory.h"
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
+#include "FrameArena.h"
+#include "Profiler.h"
+
+#if defined(IP_X86)
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+typedef BitMask::Word Word;
+
+//////////////////////////////////////////////////////////////////////////
+// BitMask
+//////////////////////////////////////////////////////////////////////////
+
+BitMask::BitMask()
+	: m_rows(0), m_cols(0), m_stride(0), m_pWords(NULL)
+{
+}
+
+BitMask::BitMask(int numRows, int numCols)
+	: m_rows(0), m_cols(0), m_stride(0), m_pWords(NULL)
+{
+	allocate(numRows, numCols);
+}
+
+BitMask::~BitMask()
+{
+	release();
+}
+
+BitMask::BitMask(const BitMask & other)
+	: m_rows(0), m_cols(0), m_stride(0), m_pWords(NULL)
+{
+	allocate(other.m_rows, other.m_cols);
+	if (m_pWords)
+		memcpy(m_pWords, other.m_pWords, (size_t)m_rows * m_stride * sizeof(Word));
+}
+
+BitMask::BitMask(BitMask && other)
+	: m_rows(other.m_rows), m_cols(other.m_cols), m_stride(other.m_stride), m_pWords(other.m_pWords)
+{
+	other.m_pWords = NULL;
+	other.release();
+}
+
+BitMask & BitMask::operator=(const BitMask & other)
+{
+	if (this == &other)
+		return *this;
+
+	if (m_rows != other.m_rows || m_cols != other.m_cols)
+		allocate(other.m_rows, other.m_cols);
+	if (m_pWords)
+		memcpy(m_pWords, other.m_pWords, (size_t)m_rows * m_stride * sizeof(Word));
+	return *this;
+}
+
+BitMask & BitMask::operator=(BitMask && other)
+{
+	if (this == &other)
+		return *this;
+
+	release();
+	m_rows = other.m_rows;
+	m_cols = other.m_cols;
+	m_stride = other.m_stride;
+	m_pWords = other.m_pWords;
+
+	other.m_pWords = NULL;
+	other.release();
+	return *this;
+}
+
+void BitMask::allocate(int numRows, int numCols)
+/*every row padded to a multiple of IMAGE_ALIGNMENT bytes, all bits 0*/
+{
+	release();
+
+	m_rows = std::max(0, numRows);
+	m_cols = std::max(0, numCols);
+	m_stride = (int)(alignedPitch(wordsPerRow() * sizeof(Word)) / sizeof(Word));
+
+	const size_t bytes = (size_t)m_rows * m_stride * sizeof(Word);
+	if (bytes > 0)
+	{
+		m_pWords = (Word *)alignedMalloc(bytes);
+		memset(m_pWords, 0, bytes);
+	}
+}
+
+void BitMask::release()
+{
+	if (m_pWords)
+		alignedFree(m_pWords);
+
+	m_pWords = NULL;
+	m_rows = 0;
+	m_cols = 0;
+	m_stride = 0;
+}
+
+void BitMask::setSize(int numRows, int numCols)
+{
+	if (numRows == m_rows && numCols == m_cols)
+		clear();
+	else
+		allocate(numRows, numCols);
+}
+
+void BitMask::set(int row, int col, bool value)
+{
+	Word & word = rowPtr(row)[col >> 6];
+	const Word bit = (Word)1 << (col & 63);
+	if (value)
+		word |= bit;
+	else
+		word &= ~bit;
+}
+
+void BitMask::clear()
+{
+	if (m_pWords)
+		memset(m_pWords, 0, (size_t)m_rows * m_stride * sizeof(Word));
+}
+
+// pA[i] = op(pA[i], pB[i]) for the words of the common rows and columns, the
+// last word of a row is masked so that bits past the narrower mask stay as they are
+template <typename Op>
+static void combine(BitMask & a, const BitMask & b, Op op)
+{
+	const int rows = std::min(a.rows(), b.rows());
+	const int cols = std::min(a.cols(), b.cols());
+	if (rows <= 0 || cols <= 0)
+		return;
+
+	const int fullWords = cols / 64;
+	const Word lastMask = (cols % 64) ? (((Word)1 << (cols % 64)) - 1) : 0;
+
+	for (int y = 0; y < rows; y++)
+	{
+		Word * pA = a.rowPtr(y);
+		const Word * pB = b.rowPtr(y);
+		for (int w = 0; w < fullWords; w++)
+			pA[w] = op(pA[w], pB[w]);
+		if (lastMask)
+			pA[fullWords] = (pA[fullWords] & ~lastMask) | (op(pA[fullWords], pB[fullWords]) & lastMask);
+	}
+}
+
+struct AndWords { Word operator()(Word a, Word b) const { return a & b; } };
+struct OrWords { Word operator()(Word a, Word b) const { return a | b; } };
+struct XorWords { Word operator()(Word a, Word b) const { return a ^ b; } };
+
+BitMask & BitMask::operator&=(const BitMask & other)
+{
+	combine(*this, other, AndWords());
+	return *this;
+}
+
+BitMask & BitMask::operator|=(const BitMask & other)
+{
+	combine(*this, other, OrWords());
+	return *this;
+}
+
+BitMask & BitMask::operator^=(const BitMask & other)
+{
+	combine(*this, other, XorWords());
+	return *this;
+}
+
+void BitMask::invert()
+{
+	if (empty())
+		return;
+
+	const int words = wordsPerRow();
+	const Word lastMask = (m_cols % 64) ? (((Word)1 << (m_cols % 64)) - 1) : ~(Word)0;
+
+	for (int y = 0; y < m_rows; y++)
+	{
+		Word * p = rowPtr(y);
+		for (int w = 0; w < words; w++)
+			p[w] = ~p[w];
+		p[words - 1] &= lastMask;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// population count
+//////////////////////////////////////////////////////////////////////////
+
+// set bits in n words
+typedef long long (*CountWordsFunc)(const Word * p, int n);
+
+static long long countWords_Scalar(const Word * p, int n)
+/*bit-parallel sums of 2, 4 and 8 bits, the byte sums added by one multiply*/
+{
+	long long count = 0;
+	for (int i = 0; i < n; i++)
+	{
+		Word v = p[i];
+		v = v - ((v >> 1) & 0x5555555555555555ULL);
+		v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+		v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+		count += (long long)((v * 0x0101010101010101ULL) >> 56);
+	}
+	return count;
+}
+
+#if defined(IP_X86)
+IP_TARGET_POPCNT
+static long long countWords_Popcnt(const Word * p, int n)
+{
+	long long count = 0;
+	for (int i = 0; i < n; i++)
+	{
+#if defined(__x86_64__) || defined(_M_X64)
+		count += (long long)_mm_popcnt_u64(p[i]);
+#else
+		count += _mm_popcnt_u32((unsigned int)p[i]) + _mm_popcnt_u32((unsigned int)(p[i] >> 32));
+#endif
+	}
+	return count;
+}
+#endif
+
+static CountWordsFunc selectCountWords()
+/*POPCNT comes with every CPU of the AVX2 level*/
+{
+#if defined(IP_X86)
+	if (simdLevel() >= SIMD_AVX2)
+		return countWords_Popcnt;
+#endif
+	return countWords_Scalar;
+}
+
+long long BitMask::count() const
+{
+	const CountWordsFunc countWords = selectCountWords();
+	const int words = wordsPerRow();
+
+	long long count = 0;
+	for (int y = 0; y < m_rows; y++)
+		count += countWords(rowPtr(y), words);
+	return count;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// builders
+//////////////////////////////////////////////////////////////////////////
+
+// bit x of pDst = pSrc[x] > threshold for n pixels, (n + 63) / 64 words
+typedef void (*ThresholdBitsFunc)(Word * pDst, const unsigned char * pSrc, int n, unsigned char threshold);
+
+static void thresholdBits_Scalar(Word * pDst, const unsigned char * pSrc, int n, unsigned char threshold)
+{
+	for (int x = 0; x < n; x += 64)
+	{
+		const int end = std::min(64, n - x);
+		Word bits = 0;
+		for (int b = 0; b < end; b++)
+			bits |= (Word)(pSrc[x + b] > threshold) << b;
+		pDst[x / 64] = bits;
+	}
+}
+
+#if defined(IP_X86)
+IP_TARGET_SSE2
+static void thresholdBits_SSE2(Word * pDst, const unsigned char * pSrc, int n, unsigned char threshold)
+{
+	const __m128i thresh = _mm_set1_epi8((char)threshold);
+	const __m128i zero = _mm_setzero_si128();
+	int x = 0;
+
+	// one word per iteration. Unsigned a > t <=> saturated a - t != 0, the byte
+	// sign bits give 16 pixels at a time
+	for (; x + 64 <= n; x += 64)
+	{
+		Word bits = 0;
+		for (int k = 0; k < 4; k++)
+		{
+			const __m128i v = _mm_loadu_si128((const __m128i *)(pSrc + x + 16 * k));
+			const unsigned int notAbove = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(v, thresh), zero));
+			bits |= (Word)(~notAbove & 0xFFFF) << (16 * k);
+		}
+		pDst[x / 64] = bits;
+	}
+
+	thresholdBits_Scalar(pDst + x / 64, pSrc + x, n - x, threshold);
+}
+
+IP_TARGET_AVX2
+static void thresholdBits_AVX2(Word * pDst, const unsigned char * pSrc, int n, unsigned char threshold)
+{
+	const __m256i thresh = _mm256_set1_epi8((char)threshold);
+	const __m256i zero = _mm256_setzero_si256();
+	int x = 0;
+
+	for (; x + 64 <= n; x += 64)
+	{
+		const __m256i lo = _mm256_loadu_si256((const __m256i *)(pSrc + x));
+		const __m256i hi = _mm256_loadu_si256((const __m256i *)(pSrc + x + 32));
+		const unsigned int notAboveLo = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_subs_epu8(lo, thresh), zero));
+		const unsigned int notAboveHi = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_subs_epu8(hi, thresh), zero));
+		pDst[x / 64] = ~((Word)notAboveLo | ((Word)notAboveHi << 32));
+	}
+
+	// the SSE2 tail is legacy encoded, mixing it with dirty upper halves costs
+	// more than the whole row
+	_mm256_zeroupper();
+	thresholdBits_SSE2(pDst + x / 64, pSrc + x, n - x, threshold);
+}
+
+#if defined(IP_HAVE_AVX512)
+IP_TARGET_AVX512
+static void thresholdBits_AVX512(Word * pDst, const unsigned char * pSrc, int n, unsigned char threshold)
+{
+	const __m512i thresh = _mm512_set1_epi8((char)threshold);
+	int x = 0;
+
+	// the compare mask is the word
+	for (; x + 64 <= n; x += 64)
+		pDst[x / 64] = (Word)_mm512_cmpgt_epu8_mask(_mm512_loadu_si512((const void *)(pSrc + x)), thresh);
+
+	thresholdBits_AVX2(pDst + x / 64, pSrc + x, n - x, threshold);
+}
+#endif
+#endif
+
+static ThresholdBitsFunc selectThresholdBits()
+/*returns the fastest row kernel the CPU supports*/
+{
+#if defined(IP_X86)
+	switch (simdLevel())
+	{
+#if defined(IP_HAVE_AVX512)
+	case SIMD_AVX512:	return thresholdBits_AVX512;
+#endif
+	case SIMD_AVX2:		return thresholdBits_AVX2;
+	case SIMD_SSE2:		return thresholdBits_SSE2;
+	default:			break;
+	}
+#endif
+	return thresholdBits_Scalar;
+}
+
+void thresholdBitsRow(Word * pDst, const unsigned char * pSrc, const int n, const unsigned char threshold)
+{
+	selectThresholdBits()(pDst, pSrc, n, threshold);
+}
+
+void thresholdToMask(BitMask & dst, const ImageViewT<const unsigned char> & src,
+	const unsigned char threshold, ThreadPool * pPool)
+{
+	// every word of a row is written, a mask of the right size needs no clearing
+	if (dst.rows() != src.rows() || dst.cols() != src.cols())
+		dst.setSize(src.rows(), src.cols());
+	if (dst.empty())
+		return;
+
+	const ThresholdBitsFunc thresholdBits = selectThresholdBits();
+	const int cols = src.cols();
+
+	parallelFor(pPool, 0, src.rows(), [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; y++)
+			thresholdBits(dst.rowPtr(y), src.rowPtr(y), cols, threshold);
+	}, MIN_BAND_ROWS);
+}
+
+void gradientToMask(BitMask & dst, const ImageViewT<const unsigned char> & src,
+	const unsigned char threshold, GradientOperator op, ThreadPool * pPool, FrameArena * pArena)
+{
+	if (dst.rows() != src.rows() || dst.cols() != src.cols())
+		dst.setSize(src.rows(), src.cols());
+	if (dst.empty())
+		return;
+
+	const ThresholdBitsFunc thresholdBits = selectThresholdBits();
+	const int rows = src.rows();
+	const int cols = src.cols();
+
+	parallelFor(pPool, 0, rows, [&](int y0, int y1)
+	{
+		ScratchBuffer<unsigned char> energyLine(pArena, cols);
+		for (int y = y0; y < y1; y++)
+		{
+			// the border rows have no energy
+			if (y == 0 || y == rows - 1)
+			{
+				memset(dst.rowPtr(y), 0, dst.wordsPerRow() * sizeof(Word));
+				continue;
+			}
+			gradientMagnitudeRow(energyLine.get(), src.rowPtr(y - 1), src.rowPtr(y), src.rowPtr(y + 1), cols, op);
+			thresholdBits(dst.rowPtr(y), energyLine.get(), cols, threshold);
+		}
+	}, MIN_BAND_ROWS);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// export
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Tables for the byte-wise conversions: expand[b] holds 0xFF in byte i for
+every set bit i of b, reversed[b] is b with the bit order reversed (PBM rows
+start with the most significant bit).
+*/
+struct BitTables
+{
+	Word expand[256];
+	unsigned char reversed[256];
+
+	BitTables()
+	{
+		for (int b = 0; b < 256; b++)
+		{
+			Word e = 0;
+			unsigned char r = 0;
+			for (int i = 0; i < 8; i++)
+			{
+				if (b & (1 << i))
+				{
+					e |= (Word)0xFF << (8 * i);
+					r |= (unsigned char)(0x80 >> i);
+				}
+			}
+			expand[b] = e;
+			reversed[b] = r;
+		}
+	}
+};
+static const BitTables s_bitTables;
+
+// pDst[x] = on if bit x is set, else 0, for n pixels
+typedef void (*ExpandBitsFunc)(unsigned char * pDst, const Word * pBits, int n, unsigned char on);
+
+static void expandBits_Scalar(unsigned char * pDst, const Word * pBits, int n, unsigned char on)
+{
+	const Word onBytes = 0x0101010101010101ULL * on;
+	int x = 0;
+
+	// 8 pixels at a time; the table entries are little endian like the words
+	for (; x + 8 <= n; x += 8)
+	{
+		const Word bytes = s_bitTables.expand[(pBits[x / 64] >> (x % 64)) & 0xFF] & onBytes;
+		memcpy(pDst + x, &bytes, 8);
+	}
+	for (; x < n; x++)
+		pDst[x] = ((pBits[x / 64] >> (x % 64)) & 1) ? on : 0;
+}
+
+#if defined(IP_HAVE_AVX512)
+IP_TARGET_AVX512
+static void expandBits_AVX512(unsigned char * pDst, const Word * pBits, int n, unsigned char on)
+{
+	const __m512i onV = _mm512_set1_epi8((char)on);
+	int x = 0;
+
+	// the word is the store mask
+	for (; x + 64 <= n; x += 64)
+		_mm512_storeu_si512((void *)(pDst + x), _mm512_maskz_mov_epi8((__mmask64)pBits[x / 64], onV));
+
+	_mm256_zeroupper();
+	expandBits_Scalar(pDst + x, pBits + x / 64, n - x, on);
+}
+#endif
+
+static ExpandBitsFunc selectExpandBits()
+/*below AVX-512 the 8 pixel table lookups beat byte shuffles*/
+{
+#if defined(IP_HAVE_AVX512)
+	if (simdLevel() == SIMD_AVX512)
+		return expandBits_AVX512;
+#endif
+	return expandBits_Scalar;
+}
+
+void expandMask(const ImageViewT<unsigned char> & dst, const BitMask & mask,
+	const unsigned char on, ThreadPool * pPool)
+{
+	const int rows = std::min(dst.rows(), mask.rows());
+	const int cols = std::min(dst.cols(), mask.cols());
+	if (rows <= 0 || cols <= 0)
+		return;
+
+	const ExpandBitsFunc expandBits = selectExpandBits();
+
+	parallelFor(pPool, 0, rows, [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; y++)
+			expandBits(dst.rowPtr(y), mask.rowPtr(y), cols, on);
+	}, MIN_BAND_ROWS);
+}
+
+bool writePBM(const char * fileName, const BitMask & mask)
+{
+	IP_PROFILE_SCOPE_IO("writePBM", (long long)mask.rows() * mask.cols(), 0, (long long)mask.rows() * ((mask.cols() + 7) / 8));
+	FILE * fp = fopen(fileName, "wb");
+	if (!fp)
+		return false;
+
+	fprintf(fp, "P4\n%d %d\n", mask.cols(), mask.rows());
+
+	const int rowBytes = (mask.cols() + 7) / 8;
+	std::vector<unsigned char> line(rowBytes);
+	bool ok = true;
+
+	for (int y = 0; y < mask.rows() && ok; y++)
+	{
+		const Word * pBits = mask.rowPtr(y);
+		for (int i = 0; i < rowBytes; i++)
+			line[i] = s_bitTables.reversed[(pBits[i / 8] >> (8 * (i % 8))) & 0xFF];
+		ok = (rowBytes == 0) || (1 == fwrite(&line[0], rowBytes, 1, fp));
+	}
+
+	fclose(fp);
+	return ok;
+}
@@ -0,0 +1,104 @@
+#ifndef __BIT_MASK_H__
+#define __BIT_MASK_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 BitMask.h
+///
+/// Binary masks with one bit per pixel, 8x smaller than the 0 / 255 byte images
+/// the threshold and segmentation stages write. The builders compare pixels
+/// with SIMD and store the comparison results directly as bits.
+///
+//=================================================================================
+//=================================================================================
+
+#include "ImageProcess.h"
+#include "Gradient.h"
+
+class ThreadPool;
+class FrameArena;
+
+/*
+rows x cols bits. Bit x of a row is bit x % 64 of its word x / 64, so the
+lowest bit is the leftmost pixel. Rows start on 64 byte boundaries, stride()
+words apart. The bits past cols() in the last word of a row are always 0, all
+operations keep them 0.
+*/
+class BitMask
+{
+public:
+	typedef unsigned long long Word;
+
+	BitMask();
+	BitMask(int numRows, int numCols);
+	~BitMask();
+	BitMask(const BitMask & other);
+	BitMask(BitMask && other);
+	BitMask & operator=(const BitMask & other);
+	BitMask & operator=(BitMask && other);
+
+	// new size, all bits 0. Keeps the buffer if the size does not change
+	void setSize(int numRows, int numCols);
+
+	int rows() const { return m_rows; }
+	int cols() const { return m_cols; }
+	// words holding the bits of one row
+	int wordsPerRow() const { return (m_cols + 63) / 64; }
+	// words between two rows
+	int stride() const { return m_stride; }
+	bool empty() const { return m_rows <= 0 || m_cols <= 0; }
+
+	Word * rowPtr(int row) { return m_pWords + (size_t)row * m_stride; }
+	const Word * rowPtr(int row) const { return m_pWords + (size_t)row * m_stride; }
+
+	bool get(int row, int col) const { return ((rowPtr(row)[col >> 6] >> (col & 63)) & 1) != 0; }
+	void set(int row, int col, bool value);
+
+	void clear();
+
+	// element-wise logic with a mask of the same size (other sizes: the common
+	// rows and columns, the rest is unchanged)
+	BitMask & operator&=(const BitMask & other);
+	BitMask & operator|=(const BitMask & other);
+	BitMask & operator^=(const BitMask & other);
+	// NOT
+	void invert();
+
+	// number of set pixels (the area of the mask)
+	long long count() const;
+
+private:
+	void allocate(int numRows, int numCols);
+	void release();
+
+	int m_rows;
+	int m_cols;
+	int m_stride;
+	Word * m_pWords;
+};
+
+// the bits of n pixels: bit x of pDst is pSrc[x] > threshold. Writes
+// (n + 63) / 64 words, the bits past n are 0
+void thresholdBitsRow(BitMask::Word * pDst, const unsigned char * pSrc, const int n,
+	const unsigned char threshold);
+
+// dst = src > threshold, dst takes the size of src. threshold 0 packs a 0 / 255 byte mask
+void thresholdToMask(BitMask & dst, const ImageViewT<const unsigned char> & src,
+	const unsigned char threshold, ThreadPool * pPool = NULL);
+
+// dst = gradientMagnitude(src, op) > threshold without an energy image: every
+// row's energy goes through a line buffer (from pArena if given). Same bits as
+// computeEnergy followed by thresholdImage; dst takes the size of src
+void gradientToMask(BitMask & dst, const ImageViewT<const unsigned char> & src,
+	const unsigned char threshold, GradientOperator op = GRADIENT_CENTRAL, ThreadPool * pPool = NULL,
+	FrameArena * pArena = NULL);
+
+// dst = on where the mask is set, 0 elsewhere (the byte mask for writePGM).
+// dst covers at most the mask
+void expandMask(const ImageViewT<unsigned char> & dst, const BitMask & mask,
+	const unsigned char on = 255, ThreadPool * pPool = NULL);
+
+// writes mask as binary PBM (P4), set pixels are 1 (black in most viewers)
+bool writePBM(const char * fileName, const BitMask & mask);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef __BOUNDED_QUEUE_H__
+#define __BOUNDED_QUEUE_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 BoundedQueue.h
+///
+/// Blocking FIFO with a fixed capacity that connects the threads of a
+/// producer/consumer chain. push() waits while the queue is full, so a fast
+/// producer cannot run ahead of its consumers by more than the capacity.
+///
+//=================================================================================
+//=================================================================================
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+template <typename T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(size_t capacity) : m_capacity(capacity > 0 ? capacity : 1), m_closed(false) {}
+
+	// waits for a free slot, false if the queue was closed meanwhile
+	bool push(const T & item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (m_items.size() >= m_capacity && !m_closed)
+			m_notFull.wait(lock);
+		if (m_closed)
+			return false;
+
+		m_items.push_back(item);
+		m_notEmpty.notify_one();
+		return true;
+	}
+
+	// waits for an item, false once the queue is closed and drained
+	bool pop(T & item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (m_items.empty() && !m_closed)
+			m_notEmpty.wait(lock);
+		if (m_items.empty())
+			return false;
+
+		item = m_items.front();
+		m_items.pop_front();
+		m_notFull.notify_one();
+		return true;
+	}
+
+	// no more pushes, consumers still get the items that are queued
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closed = true;
+		m_notEmpty.notify_all();
+		m_notFull.notify_all();
+	}
+
+private:
+	BoundedQueue(const BoundedQueue&);
+	BoundedQueue& operator=(const BoundedQueue&);
+
+	std::deque<T> m_items;
+	const size_t m_capacity;
+	bool m_closed;
+	std::mutex m_mutex;
+	std::condition_variable m_notEmpty;
+	std::condition_variable m_notFull;
+};
+
+#endif
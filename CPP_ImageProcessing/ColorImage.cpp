@@ -0,0 +1,396 @@
+/*
+
+Planar color images and the vectorized RGB to HSV conversion
+
+*/
+
+#include <string.h>
+#include <algorithm>
+#include "ColorImage.h"
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
+#include "PPM_IO.h"
+
+#if defined(IP_X86)
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+ColorView::ColorView()
+	: m_rows(0), m_cols(0), m_pixelStep(0), m_rowStride(0)
+{
+	for (int c = 0; c < 4; c++)
+		m_planes[c] = NULL;
+}
+
+ColorView::ColorView(const unsigned char * pR, const unsigned char * pG, const unsigned char * pB,
+	const unsigned char * pA, int numRows, int numCols, int pixelStep, int rowStride)
+	: m_rows(numRows), m_cols(numCols), m_pixelStep(pixelStep), m_rowStride(rowStride)
+{
+	m_planes[CHANNEL_R] = pR;
+	m_planes[CHANNEL_G] = pG;
+	m_planes[CHANNEL_B] = pB;
+	m_planes[CHANNEL_A] = pA;
+}
+
+ColorView ColorView::fromRgba(const rtcvRgbaValue * pRgba, int numRows, int numCols, int stride)
+{
+	if (stride <= 0)
+		stride = numCols;
+
+	return ColorView(&pRgba->m_r, &pRgba->m_g, &pRgba->m_b, &pRgba->m_a, numRows, numCols,
+		(int)sizeof(rtcvRgbaValue), stride * (int)sizeof(rtcvRgbaValue));
+}
+
+bool ColorView::isBgra() const
+{
+	const unsigned char * pB = m_planes[CHANNEL_B];
+	return m_pixelStep == 4 && m_planes[CHANNEL_G] == pB + 1 && m_planes[CHANNEL_R] == pB + 2;
+}
+
+ColorView ColorView::rowRange(int firstRow, int numRows) const
+{
+	const ptrdiff_t offset = (ptrdiff_t)firstRow * m_rowStride;
+	return ColorView(m_planes[CHANNEL_R] + offset, m_planes[CHANNEL_G] + offset,
+		m_planes[CHANNEL_B] + offset, m_planes[CHANNEL_A] ? m_planes[CHANNEL_A] + offset : NULL,
+		numRows, m_cols, m_pixelStep, m_rowStride);
+}
+
+ColorImage::ColorImage()
+	: m_hasAlpha(false)
+{
+}
+
+ColorImage::ColorImage(int numRows, int numCols, bool withAlpha)
+	: m_hasAlpha(false)
+{
+	setSize(numRows, numCols, withAlpha);
+}
+
+ColorImage::ColorImage(const ColorView & view)
+	: m_hasAlpha(false)
+{
+	setSize(view.rows(), view.cols(), view.hasAlpha());
+
+	const int step = view.pixelStep();
+	for (int c = 0; c < numChannels(); c++)
+	{
+		for (int r = 0; r < view.rows(); r++)
+		{
+			const unsigned char * pSrc = view.rowPtr(c, r);
+			unsigned char * pDst = m_planes[c].rowPtr(r);
+			if (step == 1)
+				memcpy(pDst, pSrc, view.cols());
+			else
+			{
+				for (int x = 0; x < view.cols(); x++)
+					pDst[x] = pSrc[x * step];
+			}
+		}
+	}
+}
+
+void ColorImage::setSize(int numRows, int numCols, bool withAlpha)
+{
+	m_hasAlpha = withAlpha;
+	for (int c = 0; c < 3; c++)
+		m_planes[c].setImageInfo(numRows, numCols, 255);
+	if (withAlpha)
+		m_planes[CHANNEL_A].setImageInfo(numRows, numCols, 255);
+	else
+		m_planes[CHANNEL_A] = Image();
+}
+
+ColorView ColorImage::view() const
+{
+	return ColorView(m_planes[CHANNEL_R].data(), m_planes[CHANNEL_G].data(), m_planes[CHANNEL_B].data(),
+		m_hasAlpha ? m_planes[CHANNEL_A].data() : NULL, rows(), cols(), 1, m_planes[CHANNEL_R].stride());
+}
+
+void ColorImage::toRgba(rtcvRgbaValue * pDst) const
+{
+	for (int r = 0; r < rows(); r++)
+	{
+		const unsigned char * pR = m_planes[CHANNEL_R].rowPtr(r);
+		const unsigned char * pG = m_planes[CHANNEL_G].rowPtr(r);
+		const unsigned char * pB = m_planes[CHANNEL_B].rowPtr(r);
+		const unsigned char * pA = m_hasAlpha ? m_planes[CHANNEL_A].rowPtr(r) : NULL;
+		for (int x = 0; x < cols(); x++, pDst++)
+		{
+			pDst->m_r = pR[x];
+			pDst->m_g = pG[x];
+			pDst->m_b = pB[x];
+			pDst->m_a = pA ? pA[x] : 255;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// RGB to HSV
+//
+// With v = max(r,g,b) and d = v - min(r,g,b) the reference computes
+//   hue = offset + 43 * n / d   (integer division, truncated towards 0)
+//   sat = 255 * d / v
+// where n is g-b, b-r or r-g and offset 0, 85 or 171 depending on which
+// channel is the maximum. Both quotients are (num +- 0.5) * (1/den) in float:
+// the numerators are exact in float and (num +- 0.5) / den stays at least
+// 0.5 / 255 away from an integer, far more than the rounding error of the
+// reciprocal, so truncation gives exactly the integer quotient.
+//////////////////////////////////////////////////////////////////////////
+
+// 1/i for i = 1..255, 0 for i = 0 (d == 0 and v == 0 give hue and sat 0)
+struct ReciprocalTable
+{
+	float rcp[256];
+
+	ReciprocalTable()
+	{
+		rcp[0] = 0.f;
+		for (int i = 1; i < 256; i++)
+			rcp[i] = 1.f / i;
+	}
+};
+
+static const ReciprocalTable s_rcpTable;
+
+// hue, sat and val of n pixels, channel samples are pixelStep bytes apart
+typedef void (*HsvRowFunc)(unsigned char * pH, unsigned char * pS, unsigned char * pV,
+	const unsigned char * pR, const unsigned char * pG, const unsigned char * pB,
+	int pixelStep, int n);
+
+static void hsvRow_Scalar(unsigned char * pH, unsigned char * pS, unsigned char * pV,
+	const unsigned char * pR, const unsigned char * pG, const unsigned char * pB,
+	int pixelStep, int n)
+{
+	const float * rcp = s_rcpTable.rcp;
+
+	for (int x = 0; x < n; x++)
+	{
+		const int r = pR[x * pixelStep];
+		const int g = pG[x * pixelStep];
+		const int b = pB[x * pixelStep];
+
+		const int v = std::max(r, std::max(g, b));
+		const int d = v - std::min(r, std::min(g, b));
+
+		int num, offset;
+		if (v == r)
+		{
+			num = g - b;
+			offset = 0;
+		}
+		else if (v == g)
+		{
+			num = b - r;
+			offset = 85;
+		}
+		else
+		{
+			num = r - g;
+			offset = 171;
+		}
+
+		const float half = num < 0 ? -0.5f : 0.5f;
+		pH[x] = (unsigned char)(offset + (int)((43 * num + half) * rcp[d]));
+		pS[x] = (unsigned char)(int)((255 * d + 0.5f) * rcp[v]);
+		pV[x] = (unsigned char)v;
+	}
+}
+
+#if defined(IP_X86)
+IP_TARGET_AVX2
+static inline void hsv_AVX2(__m256i r, __m256i g, __m256i b, __m256i & h, __m256i & s, __m256i & v)
+/*hue, sat and val of 8 pixels in 32 bit lanes*/
+{
+	const float * rcp = s_rcpTable.rcp;
+
+	v = _mm256_max_epi32(r, _mm256_max_epi32(g, b));
+	const __m256i d = _mm256_sub_epi32(v, _mm256_min_epi32(r, _mm256_min_epi32(g, b)));
+
+	// select numerator and offset by the channel that is the maximum, red first
+	const __m256i isR = _mm256_cmpeq_epi32(v, r);
+	const __m256i isG = _mm256_cmpeq_epi32(v, g);
+	__m256i num = _mm256_blendv_epi8(_mm256_sub_epi32(r, g), _mm256_sub_epi32(b, r), isG);
+	num = _mm256_blendv_epi8(num, _mm256_sub_epi32(g, b), isR);
+	__m256i offset = _mm256_blendv_epi8(_mm256_set1_epi32(171), _mm256_set1_epi32(85), isG);
+	offset = _mm256_andnot_si256(isR, offset);
+
+	const __m256 numF = _mm256_cvtepi32_ps(_mm256_mullo_epi32(num, _mm256_set1_epi32(43)));
+	const __m256 half = _mm256_or_ps(_mm256_set1_ps(0.5f), _mm256_and_ps(numF, _mm256_set1_ps(-0.f)));
+	const __m256 quotH = _mm256_mul_ps(_mm256_add_ps(numF, half), _mm256_i32gather_ps(rcp, d, 4));
+	h = _mm256_and_si256(_mm256_add_epi32(offset, _mm256_cvttps_epi32(quotH)), _mm256_set1_epi32(0xFF));
+
+	const __m256 satF = _mm256_cvtepi32_ps(_mm256_mullo_epi32(d, _mm256_set1_epi32(255)));
+	const __m256 quotS = _mm256_mul_ps(_mm256_add_ps(satF, _mm256_set1_ps(0.5f)), _mm256_i32gather_ps(rcp, v, 4));
+	s = _mm256_cvttps_epi32(quotS);
+}
+
+IP_TARGET_AVX2
+static inline void store8_AVX2(unsigned char * pDst, __m256i x)
+/*stores 8 lanes holding 0..255 as bytes*/
+{
+	const __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+	_mm_storel_epi64((__m128i *)pDst, _mm_packus_epi16(words, words));
+}
+
+IP_TARGET_AVX2
+static void hsvRow_AVX2(unsigned char * pH, unsigned char * pS, unsigned char * pV,
+	const unsigned char * pR, const unsigned char * pG, const unsigned char * pB,
+	int pixelStep, int n)
+{
+	int x = 0;
+
+	if (pixelStep == 1)
+	{
+		for (; x + 8 <= n; x += 8)
+		{
+			const __m256i r = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(pR + x)));
+			const __m256i g = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(pG + x)));
+			const __m256i b = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(pB + x)));
+
+			__m256i h, s, v;
+			hsv_AVX2(r, g, b, h, s, v);
+			store8_AVX2(pH + x, h);
+			store8_AVX2(pS + x, s);
+			store8_AVX2(pV + x, v);
+		}
+	}
+	else if (pixelStep == 4 && pG == pB + 1 && pR == pB + 2)
+	{
+		// B,G,R,A pixels are one 32 bit lane each
+		const __m256i mask = _mm256_set1_epi32(0xFF);
+		for (; x + 8 <= n; x += 8)
+		{
+			const __m256i bgra = _mm256_loadu_si256((const __m256i *)(pB + 4 * x));
+			const __m256i b = _mm256_and_si256(bgra, mask);
+			const __m256i g = _mm256_and_si256(_mm256_srli_epi32(bgra, 8), mask);
+			const __m256i r = _mm256_and_si256(_mm256_srli_epi32(bgra, 16), mask);
+
+			__m256i h, s, v;
+			hsv_AVX2(r, g, b, h, s, v);
+			store8_AVX2(pH + x, h);
+			store8_AVX2(pS + x, s);
+			store8_AVX2(pV + x, v);
+		}
+	}
+
+	hsvRow_Scalar(pH + x, pS + x, pV + x, pR + x * pixelStep, pG + x * pixelStep, pB + x * pixelStep,
+		pixelStep, n - x);
+}
+
+#if defined(IP_HAVE_AVX512)
+IP_TARGET_AVX512
+static inline void hsv_AVX512(__m512i r, __m512i g, __m512i b, __m512i & h, __m512i & s, __m512i & v)
+/*hue, sat and val of 16 pixels in 32 bit lanes*/
+{
+	const float * rcp = s_rcpTable.rcp;
+
+	v = _mm512_max_epi32(r, _mm512_max_epi32(g, b));
+	const __m512i d = _mm512_sub_epi32(v, _mm512_min_epi32(r, _mm512_min_epi32(g, b)));
+
+	const __mmask16 isR = _mm512_cmpeq_epi32_mask(v, r);
+	const __mmask16 isG = _mm512_cmpeq_epi32_mask(v, g);
+	__m512i num = _mm512_mask_blend_epi32(isG, _mm512_sub_epi32(r, g), _mm512_sub_epi32(b, r));
+	num = _mm512_mask_blend_epi32(isR, num, _mm512_sub_epi32(g, b));
+	__m512i offset = _mm512_mask_blend_epi32(isG, _mm512_set1_epi32(171), _mm512_set1_epi32(85));
+	offset = _mm512_maskz_mov_epi32((__mmask16)~isR, offset);
+
+	const __m512i numI = _mm512_mullo_epi32(num, _mm512_set1_epi32(43));
+	const __m512i halfI = _mm512_or_si512(_mm512_castps_si512(_mm512_set1_ps(0.5f)),
+		_mm512_and_si512(numI, _mm512_set1_epi32((int)0x80000000)));
+	const __m512 quotH = _mm512_mul_ps(_mm512_add_ps(_mm512_cvtepi32_ps(numI), _mm512_castsi512_ps(halfI)),
+		_mm512_i32gather_ps(d, rcp, 4));
+	h = _mm512_and_si512(_mm512_add_epi32(offset, _mm512_cvttps_epi32(quotH)), _mm512_set1_epi32(0xFF));
+
+	const __m512 satF = _mm512_cvtepi32_ps(_mm512_mullo_epi32(d, _mm512_set1_epi32(255)));
+	const __m512 quotS = _mm512_mul_ps(_mm512_add_ps(satF, _mm512_set1_ps(0.5f)), _mm512_i32gather_ps(v, rcp, 4));
+	s = _mm512_cvttps_epi32(quotS);
+}
+
+IP_TARGET_AVX512
+static void hsvRow_AVX512(unsigned char * pH, unsigned char * pS, unsigned char * pV,
+	const unsigned char * pR, const unsigned char * pG, const unsigned char * pB,
+	int pixelStep, int n)
+{
+	int x = 0;
+
+	if (pixelStep == 1)
+	{
+		for (; x + 16 <= n; x += 16)
+		{
+			const __m512i r = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(pR + x)));
+			const __m512i g = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(pG + x)));
+			const __m512i b = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(pB + x)));
+
+			__m512i h, s, v;
+			hsv_AVX512(r, g, b, h, s, v);
+			_mm_storeu_si128((__m128i *)(pH + x), _mm512_cvtepi32_epi8(h));
+			_mm_storeu_si128((__m128i *)(pS + x), _mm512_cvtepi32_epi8(s));
+			_mm_storeu_si128((__m128i *)(pV + x), _mm512_cvtepi32_epi8(v));
+		}
+	}
+	else if (pixelStep == 4 && pG == pB + 1 && pR == pB + 2)
+	{
+		const __m512i mask = _mm512_set1_epi32(0xFF);
+		for (; x + 16 <= n; x += 16)
+		{
+			const __m512i bgra = _mm512_loadu_si512((const void *)(pB + 4 * x));
+			const __m512i b = _mm512_and_si512(bgra, mask);
+			const __m512i g = _mm512_and_si512(_mm512_srli_epi32(bgra, 8), mask);
+			const __m512i r = _mm512_and_si512(_mm512_srli_epi32(bgra, 16), mask);
+
+			__m512i h, s, v;
+			hsv_AVX512(r, g, b, h, s, v);
+			_mm_storeu_si128((__m128i *)(pH + x), _mm512_cvtepi32_epi8(h));
+			_mm_storeu_si128((__m128i *)(pS + x), _mm512_cvtepi32_epi8(s));
+			_mm_storeu_si128((__m128i *)(pV + x), _mm512_cvtepi32_epi8(v));
+		}
+	}
+
+	hsvRow_AVX2(pH + x, pS + x, pV + x, pR + x * pixelStep, pG + x * pixelStep, pB + x * pixelStep,
+		pixelStep, n - x);
+}
+#endif
+#endif
+
+static HsvRowFunc selectHsvRow()
+/*returns the fastest row kernel the CPU supports, SSE2 has no gather and
+stays scalar*/
+{
+#if defined(IP_X86)
+	switch (simdLevel())
+	{
+#if defined(IP_HAVE_AVX512)
+	case SIMD_AVX512:	return hsvRow_AVX512;
+#endif
+	case SIMD_AVX2:		return hsvRow_AVX2;
+	default:			break;
+	}
+#endif
+	return hsvRow_Scalar;
+}
+
+void convertRgbToHsv(const ColorView & src, const ImageViewT<unsigned char> & hue,
+	const ImageViewT<unsigned char> & sat, const ImageViewT<unsigned char> & val,
+	ThreadPool * pPool)
+{
+	if (src.empty())
+		return;
+
+	const HsvRowFunc hsvRow = selectHsvRow();
+
+	parallelFor(pPool, 0, src.rows(), [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; y++)
+		{
+			hsvRow(hue.rowPtr(y), sat.rowPtr(y), val.rowPtr(y), src.rowPtr(CHANNEL_R, y),
+				src.rowPtr(CHANNEL_G, y), src.rowPtr(CHANNEL_B, y), src.pixelStep(), src.cols());
+		}
+	}, MIN_BAND_ROWS);
+}
+
+void convertRgbToHsv(const ColorView & src, ColorImage & dst, ThreadPool * pPool)
+{
+	dst.setSize(src.rows(), src.cols());
+	convertRgbToHsv(src, dst.plane(0).view(), dst.plane(1).view(), dst.plane(2).view(), pPool);
+}
@@ -0,0 +1,117 @@
+#ifndef __COLOR_IMAGE_H__
+#define __COLOR_IMAGE_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 ColorImage.h
+///
+/// Planar 8 bit color images: one Image plane per channel instead of the
+/// interleaved B,G,R,A bytes of rtcvRgbaValue. ColorView reads either layout, so
+/// rtcvRgbaValue arrays go through the planar kernels without being copied.
+///
+//=================================================================================
+//=================================================================================
+
+#include "ImageProcess.h"
+
+union rtcvRgbaValue;
+class ThreadPool;
+
+// plane index of a channel in ColorView and ColorImage
+enum ColorChannel
+{
+	CHANNEL_R = 0,
+	CHANNEL_G,
+	CHANNEL_B,
+	CHANNEL_A
+};
+
+/*
+Read-only view on an 8 bit color image with planar or interleaved channels.
+Sample (row, col) of a channel is at plane + row * rowStride + col * pixelStep
+bytes: planar images have a pixelStep of 1, rtcvRgbaValue arrays of 4.
+*/
+class ColorView
+{
+public:
+	ColorView();
+	ColorView(const unsigned char * pR, const unsigned char * pG, const unsigned char * pB,
+		const unsigned char * pA, int numRows, int numCols, int pixelStep, int rowStride);
+
+	// zero-copy view on numRows x numCols rtcvRgbaValue pixels, rows are stride pixels apart
+	static ColorView fromRgba(const rtcvRgbaValue * pRgba, int numRows, int numCols, int stride = 0);
+
+	int rows() const { return m_rows; }
+	int cols() const { return m_cols; }
+	int pixelStep() const { return m_pixelStep; }
+	int rowStride() const { return m_rowStride; }
+	bool hasAlpha() const { return m_planes[CHANNEL_A] != NULL; }
+	bool empty() const { return m_planes[CHANNEL_R] == NULL || m_rows <= 0 || m_cols <= 0; }
+
+	// channels in separate planes
+	bool isPlanar() const { return m_pixelStep == 1; }
+	// interleaved B,G,R,A bytes as in rtcvRgbaValue
+	bool isBgra() const;
+
+	const unsigned char * plane(int channel) const { return m_planes[channel]; }
+	const unsigned char * rowPtr(int channel, int row) const
+	{
+		return m_planes[channel] + (ptrdiff_t)row * m_rowStride;
+	}
+
+	// rows [firstRow, firstRow + numRows) in O(1)
+	ColorView rowRange(int firstRow, int numRows) const;
+
+private:
+	const unsigned char * m_planes[4];
+	int m_rows;
+	int m_cols;
+	int m_pixelStep;
+	int m_rowStride;
+};
+
+/*
+Color image with one 64 byte aligned Image plane per channel (R, G, B and an
+optional alpha plane). The planes may hold other color spaces as well, e.g.
+H, S and V from convertRgbToHsv.
+*/
+class ColorImage
+{
+public:
+	ColorImage();
+	ColorImage(int numRows, int numCols, bool withAlpha = false);
+	// copies and deinterleaves the pixels seen through view
+	explicit ColorImage(const ColorView & view);
+
+	void setSize(int numRows, int numCols, bool withAlpha = false);
+
+	int rows() const { return m_planes[CHANNEL_R].rows(); }
+	int cols() const { return m_planes[CHANNEL_R].cols(); }
+	int numChannels() const { return m_hasAlpha ? 4 : 3; }
+	bool hasAlpha() const { return m_hasAlpha; }
+
+	Image & plane(int channel) { return m_planes[channel]; }
+	const Image & plane(int channel) const { return m_planes[channel]; }
+
+	ColorView view() const;
+
+	// interleaves the planes into rows x cols rtcvRgbaValue pixels, alpha is
+	// 255 without an alpha plane
+	void toRgba(rtcvRgbaValue * pDst) const;
+
+private:
+	Image m_planes[4];
+	bool m_hasAlpha;
+};
+
+// H, S and V planes in one pass, bit-identical to rtcvRgbaValue::getHue,
+// getSat and getV. The divisions are replaced by a table of reciprocals;
+// planar and rtcvRgbaValue layouts run vectorized (AVX2 / AVX-512)
+void convertRgbToHsv(const ColorView & src, const ImageViewT<unsigned char> & hue,
+	const ImageViewT<unsigned char> & sat, const ImageViewT<unsigned char> & val,
+	ThreadPool * pPool = NULL);
+
+// same, the H, S and V planes of dst take the place of R, G and B
+void convertRgbToHsv(const ColorView & src, ColorImage & dst, ThreadPool * pPool = NULL);
+
+#endif
@@ -0,0 +1,333 @@
+/*
+
+Stages of the color pipeline
+
+*/
+
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include "ColorPipeline.h"
+#include "ColorImage.h"
+#include "BitMask.h"
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
+#include "FrameArena.h"
+#include "Profiler.h"
+#include "PPM_IO.h"
+
+#if defined(IP_X86)
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+// pixels converted to HSV at a time, the planes stay in the L1 cache
+static const int HSV_CHUNK = 2048;
+
+static void convertChunk(unsigned char * pH, unsigned char * pS, unsigned char * pV,
+	const rtcvRgbaValue * pRgb, const int n)
+/*H, S and V of n pixels through the zero-copy rtcvRgbaValue view*/
+{
+	convertRgbToHsv(ColorView::fromRgba(pRgb, 1, n), ImageViewT<unsigned char>(pH, 1, n, n),
+		ImageViewT<unsigned char>(pS, 1, n, n), ImageViewT<unsigned char>(pV, 1, n, n));
+}
+
+int dominantHueBin(const rtcvRgbaValue * pRgb, const int numPixels)
+{
+	unsigned char hue[HSV_CHUNK], sat[HSV_CHUNK], val[HSV_CHUNK];
+
+	// Compute hue-histogram with 8 bins
+	unsigned int hueHist[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	for (int i = 0; i < numPixels; i += HSV_CHUNK)
+	{
+		const int n = std::min(HSV_CHUNK, numPixels - i);
+		convertChunk(hue, sat, val, pRgb + i, n);
+		for (int x = 0; x < n; x++)
+			++hueHist[hue[x] >> 5];
+	}
+
+	// Find maximum in histogram
+	unsigned int maxHist = 0;
+	int maxHue = -1;
+	for (int h = 0; h < 8; h++)
+	{
+		if (hueHist[h] > maxHist)
+		{
+			maxHist = hueHist[h];
+			maxHue = h;
+		}
+	}
+
+	return maxHue;
+}
+
+void segmentHue(unsigned char * pSeg, const rtcvRgbaValue * pRgb, const int numPixels,
+	const int hueBin)
+{
+	unsigned char hue[HSV_CHUNK], sat[HSV_CHUNK], val[HSV_CHUNK];
+
+	for (int i = 0; i < numPixels; i += HSV_CHUNK)
+	{
+		const int n = std::min(HSV_CHUNK, numPixels - i);
+		convertChunk(hue, sat, val, pRgb + i, n);
+		for (int x = 0; x < n; x++)
+		{
+			if ((hue[x] >> 5) == hueBin && sat[x] > 100 && val[x] > 100)
+				pSeg[i + x] = 255;
+			else
+				pSeg[i + x] = 0;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ColorSegmenter
+//////////////////////////////////////////////////////////////////////////
+
+// dst[i] = 255 if hLo <= h[i] <= hHi, s[i] >= sLo and v[i] >= vLo, else 0
+typedef void (*RangeRowFunc)(unsigned char * pDst, const unsigned char * pH, const unsigned char * pS,
+	const unsigned char * pV, unsigned char hLo, unsigned char hHi, unsigned char sLo, unsigned char vLo, int n);
+
+static void rangeRow_Scalar(unsigned char * pDst, const unsigned char * pH, const unsigned char * pS,
+	const unsigned char * pV, unsigned char hLo, unsigned char hHi, unsigned char sLo, unsigned char vLo, int n)
+{
+	for (int x = 0; x < n; x++)
+		pDst[x] = (pH[x] >= hLo && pH[x] <= hHi && pS[x] >= sLo && pV[x] >= vLo) ? 255 : 0;
+}
+
+#if defined(IP_X86)
+IP_TARGET_SSE2
+static void rangeRow_SSE2(unsigned char * pDst, const unsigned char * pH, const unsigned char * pS,
+	const unsigned char * pV, unsigned char hLo, unsigned char hHi, unsigned char sLo, unsigned char vLo, int n)
+{
+	const __m128i hLoV = _mm_set1_epi8((char)hLo);
+	const __m128i hHiV = _mm_set1_epi8((char)hHi);
+	const __m128i sLoV = _mm_set1_epi8((char)sLo);
+	const __m128i vLoV = _mm_set1_epi8((char)vLo);
+	int x = 0;
+
+	// unsigned compares: a >= b <=> max(a, b) == a
+	for (; x + 16 <= n; x += 16)
+	{
+		const __m128i h = _mm_loadu_si128((const __m128i *)(pH + x));
+		const __m128i s = _mm_loadu_si128((const __m128i *)(pS + x));
+		const __m128i v = _mm_loadu_si128((const __m128i *)(pV + x));
+
+		__m128i mask = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(h, hLoV), h), _mm_cmpeq_epi8(_mm_min_epu8(h, hHiV), h));
+		mask = _mm_and_si128(mask, _mm_cmpeq_epi8(_mm_max_epu8(s, sLoV), s));
+		mask = _mm_and_si128(mask, _mm_cmpeq_epi8(_mm_max_epu8(v, vLoV), v));
+		_mm_storeu_si128((__m128i *)(pDst + x), mask);
+	}
+
+	rangeRow_Scalar(pDst + x, pH + x, pS + x, pV + x, hLo, hHi, sLo, vLo, n - x);
+}
+
+IP_TARGET_AVX2
+static void rangeRow_AVX2(unsigned char * pDst, const unsigned char * pH, const unsigned char * pS,
+	const unsigned char * pV, unsigned char hLo, unsigned char hHi, unsigned char sLo, unsigned char vLo, int n)
+{
+	const __m256i hLoV = _mm256_set1_epi8((char)hLo);
+	const __m256i hHiV = _mm256_set1_epi8((char)hHi);
+	const __m256i sLoV = _mm256_set1_epi8((char)sLo);
+	const __m256i vLoV = _mm256_set1_epi8((char)vLo);
+	int x = 0;
+
+	for (; x + 32 <= n; x += 32)
+	{
+		const __m256i h = _mm256_loadu_si256((const __m256i *)(pH + x));
+		const __m256i s = _mm256_loadu_si256((const __m256i *)(pS + x));
+		const __m256i v = _mm256_loadu_si256((const __m256i *)(pV + x));
+
+		__m256i mask = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(h, hLoV), h),
+			_mm256_cmpeq_epi8(_mm256_min_epu8(h, hHiV), h));
+		mask = _mm256_and_si256(mask, _mm256_cmpeq_epi8(_mm256_max_epu8(s, sLoV), s));
+		mask = _mm256_and_si256(mask, _mm256_cmpeq_epi8(_mm256_max_epu8(v, vLoV), v));
+		_mm256_storeu_si256((__m256i *)(pDst + x), mask);
+	}
+
+	rangeRow_SSE2(pDst + x, pH + x, pS + x, pV + x, hLo, hHi, sLo, vLo, n - x);
+}
+
+#if defined(IP_HAVE_AVX512)
+IP_TARGET_AVX512
+static void rangeRow_AVX512(unsigned char * pDst, const unsigned char * pH, const unsigned char * pS,
+	const unsigned char * pV, unsigned char hLo, unsigned char hHi, unsigned char sLo, unsigned char vLo, int n)
+{
+	const __m512i hLoV = _mm512_set1_epi8((char)hLo);
+	const __m512i hHiV = _mm512_set1_epi8((char)hHi);
+	const __m512i sLoV = _mm512_set1_epi8((char)sLo);
+	const __m512i vLoV = _mm512_set1_epi8((char)vLo);
+	int x = 0;
+
+	for (; x + 64 <= n; x += 64)
+	{
+		const __m512i h = _mm512_loadu_si512((const void *)(pH + x));
+		const __m512i s = _mm512_loadu_si512((const void *)(pS + x));
+		const __m512i v = _mm512_loadu_si512((const void *)(pV + x));
+
+		const __mmask64 mask = _mm512_cmpge_epu8_mask(h, hLoV) & _mm512_cmple_epu8_mask(h, hHiV) &
+			_mm512_cmpge_epu8_mask(s, sLoV) & _mm512_cmpge_epu8_mask(v, vLoV);
+		_mm512_storeu_si512((void *)(pDst + x), _mm512_movm_epi8(mask));
+	}
+
+	rangeRow_AVX2(pDst + x, pH + x, pS + x, pV + x, hLo, hHi, sLo, vLo, n - x);
+}
+#endif
+#endif
+
+static RangeRowFunc selectRangeRow()
+/*returns the fastest row kernel the CPU supports*/
+{
+#if defined(IP_X86)
+	switch (simdLevel())
+	{
+#if defined(IP_HAVE_AVX512)
+	case SIMD_AVX512:	return rangeRow_AVX512;
+#endif
+	case SIMD_AVX2:		return rangeRow_AVX2;
+	case SIMD_SSE2:		return rangeRow_SSE2;
+	default:			break;
+	}
+#endif
+	return rangeRow_Scalar;
+}
+
+ColorSegmenter::ColorSegmenter(const HueSegmentationParams & params)
+{
+	setParams(params);
+}
+
+void ColorSegmenter::setParams(const HueSegmentationParams & params)
+{
+	m_params = params;
+	m_params.numBins = std::min(256, std::max(1, params.numBins));
+	m_hueHist.assign(m_params.numBins, 0);
+}
+
+void ColorSegmenter::analyze(const ColorView & src, ThreadPool * pPool)
+{
+	IP_PROFILE_SCOPE_IO("ColorSegmenter analyze", (long long)src.rows() * src.cols(), 4LL * src.rows() * src.cols(),
+		3LL * src.rows() * src.cols());
+	m_hsv.setSize(src.rows(), src.cols());
+	m_hueHist.assign(m_params.numBins, 0);
+	if (src.empty())
+		return;
+
+	// per-band histograms of the 256 hue values, every row is counted right
+	// after its conversion while it is still in the cache
+	unsigned int hueCount[256] = { 0 };
+	std::mutex mergeMutex;
+	const ImageViewT<unsigned char> hue = m_hsv.plane(0).view();
+	const ImageViewT<unsigned char> sat = m_hsv.plane(1).view();
+	const ImageViewT<unsigned char> val = m_hsv.plane(2).view();
+	const int cols = src.cols();
+
+	parallelFor(pPool, 0, src.rows(), [&](int y0, int y1)
+	{
+		unsigned int bandCount[256] = { 0 };
+		for (int y = y0; y < y1; y++)
+		{
+			convertRgbToHsv(src.rowRange(y, 1), hue.subView(y, 0, y + 1, cols),
+				sat.subView(y, 0, y + 1, cols), val.subView(y, 0, y + 1, cols));
+
+			const unsigned char * pHue = hue.rowPtr(y);
+			for (int x = 0; x < cols; x++)
+				++bandCount[pHue[x]];
+		}
+
+		std::lock_guard<std::mutex> lock(mergeMutex);
+		for (int i = 0; i < 256; i++)
+			hueCount[i] += bandCount[i];
+	}, MIN_BAND_ROWS);
+
+	for (int i = 0; i < 256; i++)
+		m_hueHist[i * m_params.numBins / 256] += hueCount[i];
+}
+
+int ColorSegmenter::dominantBin() const
+{
+	unsigned int maxHist = 0;
+	int maxBin = -1;
+	for (int b = 0; b < (int)m_hueHist.size(); b++)
+	{
+		if (m_hueHist[b] > maxHist)
+		{
+			maxHist = m_hueHist[b];
+			maxBin = b;
+		}
+	}
+	return maxBin;
+}
+
+bool ColorSegmenter::segmentRange(int hueBin, unsigned char & hLo, unsigned char & hHi) const
+{
+	const int numBins = m_params.numBins;
+
+	// hue range of the bin: the h with h * numBins / 256 == hueBin
+	hLo = (unsigned char)((hueBin * 256 + numBins - 1) / numBins);
+	hHi = (unsigned char)(((hueBin + 1) * 256 + numBins - 1) / numBins - 1);
+	return !(hueBin < 0 || hueBin >= numBins || m_params.minSat == 255 || m_params.minVal == 255);
+}
+
+void ColorSegmenter::segment(const ImageViewT<unsigned char> & dst, int hueBin, ThreadPool * pPool) const
+{
+	IP_PROFILE_SCOPE_IO("ColorSegmenter segment", (long long)m_hsv.rows() * m_hsv.cols(), 3LL * m_hsv.rows() * m_hsv.cols(),
+		(long long)m_hsv.rows() * m_hsv.cols());
+	const int rows = std::min(dst.rows(), m_hsv.rows());
+	const int cols = std::min(dst.cols(), m_hsv.cols());
+
+	unsigned char hLo, hHi;
+	const bool empty = !segmentRange(hueBin, hLo, hHi);
+
+	const RangeRowFunc rangeRow = selectRangeRow();
+
+	parallelFor(pPool, 0, rows, [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; y++)
+		{
+			if (empty)
+				memset(dst.rowPtr(y), 0, cols);
+			else
+				rangeRow(dst.rowPtr(y), m_hsv.plane(0).rowPtr(y), m_hsv.plane(1).rowPtr(y),
+					m_hsv.plane(2).rowPtr(y), hLo, hHi,
+					(unsigned char)(m_params.minSat + 1), (unsigned char)(m_params.minVal + 1), cols);
+		}
+	}, MIN_BAND_ROWS);
+}
+
+void ColorSegmenter::segment(BitMask & dst, int hueBin, ThreadPool * pPool, FrameArena * pArena) const
+/*the byte compare results of a row go through a line buffer in the L1 cache
+and are packed to bits right away*/
+{
+	IP_PROFILE_SCOPE_IO("ColorSegmenter segment bits", (long long)m_hsv.rows() * m_hsv.cols(),
+		3LL * m_hsv.rows() * m_hsv.cols(), (long long)m_hsv.rows() * m_hsv.cols() / 8);
+	const int rows = m_hsv.rows();
+	const int cols = m_hsv.cols();
+
+	unsigned char hLo, hHi;
+	if (!segmentRange(hueBin, hLo, hHi))
+	{
+		dst.setSize(rows, cols);
+		return;
+	}
+
+	// every word of a row is written, a mask of the right size needs no clearing
+	if (dst.rows() != rows || dst.cols() != cols)
+		dst.setSize(rows, cols);
+	if (dst.empty())
+		return;
+
+	const RangeRowFunc rangeRow = selectRangeRow();
+
+	parallelFor(pPool, 0, rows, [&](int y0, int y1)
+	{
+		ScratchBuffer<unsigned char> line(pArena, cols);
+		for (int y = y0; y < y1; y++)
+		{
+			rangeRow(line.get(), m_hsv.plane(0).rowPtr(y), m_hsv.plane(1).rowPtr(y),
+				m_hsv.plane(2).rowPtr(y), hLo, hHi,
+				(unsigned char)(m_params.minSat + 1), (unsigned char)(m_params.minVal + 1), cols);
+			thresholdBitsRow(dst.rowPtr(y), line.get(), cols, 0);
+		}
+	}, MIN_BAND_ROWS);
+}
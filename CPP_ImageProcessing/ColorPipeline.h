@@ -0,0 +1,89 @@
+#ifndef __COLOR_PIPELINE_H__
+#define __COLOR_PIPELINE_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 ColorPipeline.h
+///
+/// Stages of the color pipeline in main(): dominant color from a hue histogram
+/// and segmentation of that color in HSV space. ColorSegmenter converts a frame
+/// to HSV once and reuses the planes for the histogram and the segmentation.
+///
+//=================================================================================
+//=================================================================================
+
+#include <vector>
+#include "ColorImage.h"
+
+union rtcvRgbaValue;
+class ThreadPool;
+class BitMask;
+class FrameArena;
+
+// index of the fullest of the 8 hue bins (hue >> 5), -1 for an empty image
+int dominantHueBin(const rtcvRgbaValue * pRgb, const int numPixels);
+
+// pSeg is 255 where the hue bin equals hueBin and saturation and value are
+// above 100, 0 elsewhere
+void segmentHue(unsigned char * pSeg, const rtcvRgbaValue * pRgb, const int numPixels,
+	const int hueBin);
+
+struct HueSegmentationParams
+{
+	int numBins;			// hue bins of the histogram, hue h falls into bin h * numBins / 256
+	unsigned char minSat;	// segmented pixels have a saturation above minSat
+	unsigned char minVal;	// and a value above minVal
+
+	HueSegmentationParams() : numBins(8), minSat(100), minVal(100) {}
+};
+
+/*
+Hue histogram and segmentation of one frame after the other. analyze() converts
+the frame to HSV and builds the histogram in the same pass, segment() only
+compares the cached planes against the bin's hue range and the thresholds.
+*/
+class ColorSegmenter
+{
+public:
+	explicit ColorSegmenter(const HueSegmentationParams & params = HueSegmentationParams());
+
+	void setParams(const HueSegmentationParams & params);
+	const HueSegmentationParams & params() const { return m_params; }
+
+	// converts src to HSV and builds the hue histogram
+	void analyze(const ColorView & src, ThreadPool * pPool = NULL);
+
+	// histogram of the last analyze(), numBins entries
+	const std::vector<unsigned int> & hueHistogram() const { return m_hueHist; }
+	// fullest bin, -1 for an empty frame
+	int dominantBin() const;
+
+	// dst is 255 where the hue is in hueBin and saturation and value are above
+	// the thresholds, 0 elsewhere. dst has the size of the analyzed frame
+	void segment(const ImageViewT<unsigned char> & dst, int hueBin, ThreadPool * pPool = NULL) const;
+	void segmentDominant(const ImageViewT<unsigned char> & dst, ThreadPool * pPool = NULL) const
+	{
+		segment(dst, dominantBin(), pPool);
+	}
+
+	// same pixels as bits, dst takes the size of the analyzed frame. The line
+	// buffers of the bands come from pArena if given
+	void segment(BitMask & dst, int hueBin, ThreadPool * pPool = NULL, FrameArena * pArena = NULL) const;
+	void segmentDominant(BitMask & dst, ThreadPool * pPool = NULL, FrameArena * pArena = NULL) const
+	{
+		segment(dst, dominantBin(), pPool, pArena);
+	}
+
+	// H, S and V planes of the last analyze()
+	const ColorImage & hsv() const { return m_hsv; }
+
+private:
+	// hue range [hLo, hHi] of hueBin, false if no pixel can be segmented
+	bool segmentRange(int hueBin, unsigned char & hLo, unsigned char & hHi) const;
+
+	HueSegmentationParams m_params;
+	ColorImage m_hsv;
+	std::vector<unsigned int> m_hueHist;
+};
+
+#endif
@@ -0,0 +1,369 @@
+/*
+
+Connected component labeling of binary masks
+
+*/
+
+#include <algorithm>
+#include "ConnectedComponents.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+typedef BitMask::Word Word;
+
+// rows labeled together by one task. Small enough for a few tiles per thread
+// on a 4K mask, large enough that the merge only sees a few tile borders
+static const int TILE_ROWS = 64;
+
+static inline int lowestBit(Word w)
+/*index of the lowest set bit, w is not 0*/
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, w);
+	return (int)index;
+#elif defined(_MSC_VER)
+	unsigned long index;
+	if (_BitScanForward(&index, (unsigned long)w))
+		return (int)index;
+	_BitScanForward(&index, (unsigned long)(w >> 32));
+	return (int)index + 32;
+#else
+	return __builtin_ctzll(w);
+#endif
+}
+
+static inline int findRoot(std::vector<int> & parent, int i)
+/*union-find root with path halving. Roots are the smallest index of their set,
+so parent[i] <= i everywhere*/
+{
+	while (parent[i] != i)
+	{
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+static void setBitRange(Word * pRow, int x0, int x1)
+/*sets bits x0 .. x1 - 1 of a mask row, x0 < x1*/
+{
+	const int first = x0 >> 6;
+	const int last = (x1 - 1) >> 6;
+	const Word firstBits = ~(Word)0 << (x0 & 63);
+	const Word lastBits = ~(Word)0 >> (63 - ((x1 - 1) & 63));
+
+	if (first == last)
+	{
+		pRow[first] |= firstBits & lastBits;
+		return;
+	}
+	pRow[first] |= firstBits;
+	for (int i = first + 1; i < last; i++)
+		pRow[i] = ~(Word)0;
+	pRow[last] |= lastBits;
+}
+
+static void addRun(ComponentStats & stats, int x0, int x1, int y)
+/*adds the pixels x0 .. x1 - 1 of row y, the centroids hold the sums of x and y*/
+{
+	const int length = x1 - x0;
+	stats.area += length;
+	stats.left = std::min(stats.left, x0);
+	stats.right = std::max(stats.right, x1 - 1);
+	stats.top = std::min(stats.top, y);
+	stats.bottom = std::max(stats.bottom, y);
+	stats.centroidX += 0.5 * (x0 + x1 - 1) * length;
+	stats.centroidY += (double)y * length;
+}
+
+static void addComponent(ComponentStats & stats, const ComponentStats & other)
+{
+	stats.area += other.area;
+	stats.left = std::min(stats.left, other.left);
+	stats.right = std::max(stats.right, other.right);
+	stats.top = std::min(stats.top, other.top);
+	stats.bottom = std::max(stats.bottom, other.bottom);
+	stats.centroidX += other.centroidX;
+	stats.centroidY += other.centroidY;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ConnectedComponents
+//////////////////////////////////////////////////////////////////////////
+
+ConnectedComponents::ConnectedComponents(Connectivity connectivity)
+	: m_connectivity(connectivity), m_rows(0), m_cols(0)
+{
+}
+
+int ConnectedComponents::label(const ImageViewT<const unsigned char> & mask, ThreadPool * pPool)
+{
+	thresholdToMask(m_packed, mask, 0, pPool);
+	return label(m_packed, pPool);
+}
+
+int ConnectedComponents::label(const BitMask & mask, ThreadPool * pPool)
+/*tiles of TILE_ROWS rows in parallel, then the serial merge. The tile vectors
+keep their capacity from frame to frame*/
+{
+	IP_PROFILE_SCOPE_IO("ConnectedComponents label", (long long)mask.rows() * mask.cols(),
+		(long long)mask.rows() * mask.stride() * 8, 0);
+	m_rows = mask.empty() ? 0 : mask.rows();
+	m_cols = mask.empty() ? 0 : mask.cols();
+
+	const int numTiles = (m_rows + TILE_ROWS - 1) / TILE_ROWS;
+	m_tiles.resize(numTiles);
+	for (int t = 0; t < numTiles; t++)
+	{
+		m_tiles[t].top = t * TILE_ROWS;
+		m_tiles[t].numRows = std::min(TILE_ROWS, m_rows - t * TILE_ROWS);
+	}
+
+	parallelFor(pPool, 0, numTiles, [&](int tileBegin, int tileEnd)
+	{
+		for (int t = tileBegin; t < tileEnd; t++)
+			labelTile(m_tiles[t], mask);
+	});
+
+	mergeTiles();
+	return numComponents();
+}
+
+void ConnectedComponents::labelTile(Tile & tile, const BitMask & mask) const
+/*collects the runs of every row and joins them with the touching runs of the
+row above (overlapping columns, or one column apart for 8-connectivity), then
+numbers the union-find roots in run order and sums their stats*/
+{
+	const int words = mask.wordsPerRow();
+	const int reach = m_connectivity == CONNECTIVITY_8 ? 1 : 0;
+	std::vector<Run> & runs = tile.runs;
+	std::vector<int> & parent = tile.parent;
+
+	runs.clear();
+	parent.clear();
+	tile.rowStart.resize(tile.numRows + 1);
+
+	for (int r = 0; r < tile.numRows; r++)
+	{
+		const Word * pRow = mask.rowPtr(tile.top + r);
+		const int rowBegin = (int)runs.size();
+		tile.rowStart[r] = rowBegin;
+
+		// runs from the bit transitions, two bit scans per run. start is a run
+		// still open at the end of the previous word
+		int start = -1;
+		for (int i = 0; i < words; i++)
+		{
+			Word w = pRow[i];
+			if (start >= 0)
+			{
+				if (w == ~(Word)0)
+					continue;
+				const int end = lowestBit(~w);
+				Run run = { start, i * 64 + end, 0 };
+				runs.push_back(run);
+				start = -1;
+				w &= ~(Word)1 << end;
+			}
+			while (w != 0)
+			{
+				const int begin = lowestBit(w);
+				const Word filled = w | ((((Word)1) << begin) - 1);
+				if (filled == ~(Word)0)
+				{
+					start = i * 64 + begin;
+					break;
+				}
+				const int end = lowestBit(~filled);
+				Run run = { i * 64 + begin, i * 64 + end, 0 };
+				runs.push_back(run);
+				w &= ~(Word)1 << end;
+			}
+		}
+		if (start >= 0)
+		{
+			Run run = { start, mask.cols(), 0 };
+			runs.push_back(run);
+		}
+
+		const int rowEnd = (int)runs.size();
+		for (int i = rowBegin; i < rowEnd; i++)
+			parent.push_back(i);
+
+		if (r == 0)
+			continue;
+
+		// both rows are sorted by x: step past the run that ends first
+		int a = tile.rowStart[r - 1];
+		int b = rowBegin;
+		while (a < rowBegin && b < rowEnd)
+		{
+			if (runs[a].x0 < runs[b].x1 + reach && runs[b].x0 < runs[a].x1 + reach)
+			{
+				const int rootA = findRoot(parent, a);
+				const int rootB = findRoot(parent, b);
+				if (rootA < rootB)
+					parent[rootB] = rootA;
+				else if (rootB < rootA)
+					parent[rootA] = rootB;
+			}
+			if (runs[a].x1 < runs[b].x1)
+				a++;
+			else
+				b++;
+		}
+	}
+	tile.rowStart[tile.numRows] = (int)runs.size();
+
+	// every parent is smaller than its run and already numbered
+	tile.components.clear();
+	for (int r = 0; r < tile.numRows; r++)
+	{
+		const int y = tile.top + r;
+		for (int i = tile.rowStart[r]; i < tile.rowStart[r + 1]; i++)
+		{
+			const int p = parent[i];
+			if (p == i)
+			{
+				ComponentStats stats = { 0, 0, runs[i].x0, y, runs[i].x1 - 1, y, 0.0, 0.0 };
+				runs[i].id = (int)tile.components.size();
+				tile.components.push_back(stats);
+			}
+			else
+				runs[i].id = runs[p].id;
+			addRun(tile.components[runs[i].id], runs[i].x0, runs[i].x1, y);
+		}
+	}
+}
+
+void ConnectedComponents::mergeTiles()
+/*joins the components touching across the tile borders with a union-find over
+all tile components, then numbers the roots in tile order. A component's first
+tile component holds its top left pixel, so labels follow the raster order*/
+{
+	const int reach = m_connectivity == CONNECTIVITY_8 ? 1 : 0;
+	const int numTiles = (int)m_tiles.size();
+
+	int total = 0;
+	for (int t = 0; t < numTiles; t++)
+	{
+		m_tiles[t].firstComponent = total;
+		total += (int)m_tiles[t].components.size();
+	}
+
+	// parents first, replaced by the labels below
+	m_labels.resize(total);
+	for (int i = 0; i < total; i++)
+		m_labels[i] = i;
+
+	for (int t = 1; t < numTiles; t++)
+	{
+		const Tile & above = m_tiles[t - 1];
+		const Tile & below = m_tiles[t];
+		int a = above.rowStart[above.numRows - 1];
+		const int aEnd = above.rowStart[above.numRows];
+		int b = below.rowStart[0];
+		const int bEnd = below.rowStart[1];
+
+		while (a < aEnd && b < bEnd)
+		{
+			const Run & runA = above.runs[a];
+			const Run & runB = below.runs[b];
+			if (runA.x0 < runB.x1 + reach && runB.x0 < runA.x1 + reach)
+			{
+				const int rootA = findRoot(m_labels, above.firstComponent + runA.id);
+				const int rootB = findRoot(m_labels, below.firstComponent + runB.id);
+				if (rootA < rootB)
+					m_labels[rootB] = rootA;
+				else if (rootB < rootA)
+					m_labels[rootA] = rootB;
+			}
+			if (runA.x1 < runB.x1)
+				a++;
+			else
+				b++;
+		}
+	}
+
+	m_components.clear();
+	for (int t = 0; t < numTiles; t++)
+	{
+		const Tile & tile = m_tiles[t];
+		for (int c = 0; c < (int)tile.components.size(); c++)
+		{
+			const int i = tile.firstComponent + c;
+			const int p = m_labels[i];
+			if (p == i)
+			{
+				m_components.push_back(tile.components[c]);
+				m_labels[i] = (int)m_components.size();
+				m_components.back().label = m_labels[i];
+			}
+			else
+			{
+				m_labels[i] = m_labels[p];
+				addComponent(m_components[m_labels[i] - 1], tile.components[c]);
+			}
+		}
+	}
+
+	for (size_t k = 0; k < m_components.size(); k++)
+	{
+		m_components[k].centroidX /= (double)m_components[k].area;
+		m_components[k].centroidY /= (double)m_components[k].area;
+	}
+}
+
+void ConnectedComponents::labelImage(const ImageViewT<int> & dst, ThreadPool * pPool) const
+{
+	const int rows = std::min(dst.rows(), m_rows);
+	const int cols = std::min(dst.cols(), m_cols);
+	if (dst.empty() || rows <= 0 || cols <= 0)
+		return;
+
+	parallelFor(pPool, 0, (int)m_tiles.size(), [&](int tileBegin, int tileEnd)
+	{
+		for (int t = tileBegin; t < tileEnd; t++)
+		{
+			const Tile & tile = m_tiles[t];
+			for (int r = 0; r < tile.numRows && tile.top + r < rows; r++)
+			{
+				int * pDst = dst.rowPtr(tile.top + r);
+				std::fill(pDst, pDst + cols, 0);
+				for (int i = tile.rowStart[r]; i < tile.rowStart[r + 1] && tile.runs[i].x0 < cols; i++)
+				{
+					const Run & run = tile.runs[i];
+					std::fill(pDst + run.x0, pDst + std::min(run.x1, cols), m_labels[tile.firstComponent + run.id]);
+				}
+			}
+		}
+	});
+}
+
+void ConnectedComponents::filterByArea(BitMask & dst, const long long minArea, ThreadPool * pPool) const
+{
+	dst.setSize(m_rows, m_cols);
+
+	parallelFor(pPool, 0, (int)m_tiles.size(), [&](int tileBegin, int tileEnd)
+	{
+		for (int t = tileBegin; t < tileEnd; t++)
+		{
+			const Tile & tile = m_tiles[t];
+			for (int r = 0; r < tile.numRows; r++)
+			{
+				Word * pRow = dst.rowPtr(tile.top + r);
+				for (int i = tile.rowStart[r]; i < tile.rowStart[r + 1]; i++)
+				{
+					const Run & run = tile.runs[i];
+					if (m_components[m_labels[tile.firstComponent + run.id] - 1].area >= minArea)
+						setBitRange(pRow, run.x0, run.x1);
+				}
+			}
+		}
+	});
+}
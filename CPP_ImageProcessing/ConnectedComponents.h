@@ -0,0 +1,98 @@
+#ifndef __CONNECTED_COMPONENTS_H__
+#define __CONNECTED_COMPONENTS_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 ConnectedComponents.h
+///
+/// Connected component labeling of binary masks (blobs of the energy threshold
+/// or the hue segmentation). Works on the horizontal runs of set bits: tiles of
+/// rows are labeled in parallel with a union-find over their runs, a serial
+/// merge joins the components touching across tile borders. Area, bounding box
+/// and centroid are summed while the tiles are labeled.
+///
+//=================================================================================
+//=================================================================================
+
+#include <vector>
+#include "BitMask.h"
+
+class ThreadPool;
+
+enum Connectivity
+{
+	CONNECTIVITY_4 = 4,	// left, right, up, down
+	CONNECTIVITY_8 = 8	// and the diagonals
+};
+
+struct ComponentStats
+{
+	int label;			// 1 .. numComponents(), raster order of the top left pixel
+	long long area;		// pixels
+	int left, top;		// bounding box, inclusive
+	int right, bottom;
+	double centroidX;	// mean column and row of the pixels
+	double centroidY;
+};
+
+/*
+Labels one mask after the other and keeps its buffers, so labeling frames of the
+same size does not allocate. Labels do not depend on the number of threads.
+*/
+class ConnectedComponents
+{
+public:
+	explicit ConnectedComponents(Connectivity connectivity = CONNECTIVITY_8);
+
+	void setConnectivity(Connectivity connectivity) { m_connectivity = connectivity; }
+	Connectivity connectivity() const { return m_connectivity; }
+
+	// labels the set pixels of mask, returns the number of components
+	int label(const BitMask & mask, ThreadPool * pPool = NULL);
+	// same for a byte mask, every pixel above 0 is set
+	int label(const ImageViewT<const unsigned char> & mask, ThreadPool * pPool = NULL);
+
+	// results of the last label()
+	int numComponents() const { return (int)m_components.size(); }
+	// component k has label k + 1
+	const std::vector<ComponentStats> & components() const { return m_components; }
+
+	// dst = label of every pixel, 0 for the background. dst covers at most the mask
+	void labelImage(const ImageViewT<int> & dst, ThreadPool * pPool = NULL) const;
+	// dst = the pixels of all components of at least minArea pixels (drops the
+	// specks), dst takes the size of the mask
+	void filterByArea(BitMask & dst, const long long minArea, ThreadPool * pPool = NULL) const;
+
+private:
+	// horizontal run of set pixels [x0, x1) in a row
+	struct Run
+	{
+		int x0;
+		int x1;
+		int id;		// component of the tile
+	};
+
+	struct Tile
+	{
+		int top;						// first row
+		int numRows;
+		std::vector<Run> runs;			// runs of all rows, rows top to bottom
+		std::vector<int> rowStart;		// runs of row top + r: rowStart[r] .. rowStart[r + 1] - 1
+		std::vector<int> parent;		// union-find parent of every run
+		std::vector<ComponentStats> components;	// components of the tile alone
+		int firstComponent;				// index of components[0] among all tiles
+	};
+
+	void labelTile(Tile & tile, const BitMask & mask) const;
+	void mergeTiles();
+
+	Connectivity m_connectivity;
+	int m_rows;
+	int m_cols;
+	std::vector<Tile> m_tiles;
+	std::vector<int> m_labels;		// label of every tile component, all tiles in order
+	std::vector<ComponentStats> m_components;
+	BitMask m_packed;				// byte masks packed to bits
+};
+
+#endif
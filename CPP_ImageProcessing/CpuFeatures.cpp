@@ -0,0 +1,111 @@
+/*
+
+Runtime CPU feature detection for the SIMD kernels
+
+*/
+
+#include "CpuFeatures.h"
+
+#if defined(IP_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(IP_X86)
+static void cpuid(int leaf, int subLeaf, unsigned int regs[4])
+/*executes cpuid, regs receives eax, ebx, ecx, edx*/
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuidex(info, leaf, subLeaf);
+	for (int i = 0; i < 4; i++)
+		regs[i] = (unsigned int)info[i];
+#else
+	__cpuid_count(leaf, subLeaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static unsigned long long xgetbv0()
+/*returns the register state the OS saves on context switches (XCR0)*/
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+#endif
+
+SimdLevel detectSimdLevel()
+/*checks the CPUID feature bits and whether the OS enabled the AVX/AVX-512 registers*/
+{
+#if defined(IP_X86)
+	unsigned int regs[4];
+	cpuid(0, 0, regs);
+	const unsigned int maxLeaf = regs[0];
+
+	cpuid(1, 0, regs);
+	const bool sse2 = (regs[3] & (1u << 26)) != 0;
+	const bool osxsave = (regs[2] & (1u << 27)) != 0;
+	const bool popcnt = (regs[2] & (1u << 23)) != 0;
+	if (!sse2)
+		return SIMD_SCALAR;
+	if (!osxsave || maxLeaf < 7)
+		return SIMD_SSE2;
+
+	const unsigned long long xcr0 = xgetbv0();
+	const bool osAvx = (xcr0 & 0x06) == 0x06;		// XMM and YMM state
+	const bool osAvx512 = (xcr0 & 0xE6) == 0xE6;	// plus opmask and ZMM state
+
+	cpuid(7, 0, regs);
+	const bool avx2 = (regs[1] & (1u << 5)) != 0;
+	const bool avx512f = (regs[1] & (1u << 16)) != 0;
+	const bool avx512bw = (regs[1] & (1u << 30)) != 0;
+
+	// every AVX2 CPU has POPCNT, checked anyway as kernels rely on it
+	if (osAvx512 && avx512f && avx512bw && avx2 && popcnt)
+		return SIMD_AVX512;
+	if (osAvx && avx2 && popcnt)
+		return SIMD_AVX2;
+	return SIMD_SSE2;
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+static const SimdLevel s_detectedLevel = detectSimdLevel();
+static SimdLevel s_maxLevel = SIMD_AVX512;
+
+SimdLevel simdLevel()
+/*never more than the kernels were compiled for*/
+{
+#if defined(IP_HAVE_AVX512)
+	const SimdLevel compiledLevel = SIMD_AVX512;
+#else
+	const SimdLevel compiledLevel = SIMD_AVX2;
+#endif
+	const SimdLevel level = s_detectedLevel < s_maxLevel ? s_detectedLevel : s_maxLevel;
+	return level < compiledLevel ? level : compiledLevel;
+}
+
+void setSimdLevel(SimdLevel maxLevel)
+{
+	s_maxLevel = maxLevel;
+}
+
+const char * simdLevelName(SimdLevel level)
+{
+	switch (level)
+	{
+	case SIMD_SSE2:		return "SSE2";
+	case SIMD_AVX2:		return "AVX2";
+	case SIMD_AVX512:	return "AVX-512";
+	default:			return "scalar";
+	}
+}
@@ -0,0 +1,63 @@
+#ifndef __CPU_FEATURES_H__
+#define __CPU_FEATURES_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 CpuFeatures.h
+///
+/// Runtime detection of the SIMD instruction sets a kernel may use. Kernels are
+/// compiled for every level the compiler supports and pick their implementation
+/// from simdLevel(). Also holds the platform macros shared by the library.
+///
+//=================================================================================
+//=================================================================================
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define IP_X86 1
+#endif
+
+// GCC/Clang need a per function target to emit AVX code in a translation unit
+// that is not compiled with -mavx2, MSVC accepts the intrinsics everywhere
+#if defined(IP_X86) && (defined(__GNUC__) || defined(__clang__))
+#define IP_TARGET_SSE2		__attribute__((target("sse2")))
+#define IP_TARGET_AVX2		__attribute__((target("avx2")))
+#define IP_TARGET_AVX512	__attribute__((target("avx512f,avx512bw")))
+#define IP_TARGET_POPCNT	__attribute__((target("popcnt")))
+#else
+#define IP_TARGET_SSE2
+#define IP_TARGET_AVX2
+#define IP_TARGET_AVX512
+#define IP_TARGET_POPCNT
+#endif
+
+// the AVX-512 intrinsics came with VS2017 15.3, older MSVC builds stop at AVX2
+#if defined(IP_X86) && (defined(__GNUC__) || defined(__clang__) || (defined(_MSC_VER) && _MSC_VER >= 1911))
+#define IP_HAVE_AVX512 1
+#endif
+
+// VS2013 has no thread_local, its __declspec(thread) does for plain pointers
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define IP_THREAD_LOCAL __declspec(thread)
+#else
+#define IP_THREAD_LOCAL thread_local
+#endif
+
+enum SimdLevel
+{
+	SIMD_SCALAR = 0,
+	SIMD_SSE2,
+	SIMD_AVX2, // AVX2 + POPCNT
+	SIMD_AVX512 // AVX-512 F + BW
+};
+// best level supported by CPU, OS and compiler, limited by setSimdLevel()
+SimdLevel simdLevel();
+
+// best level supported by CPU and OS
+SimdLevel detectSimdLevel();
+
+// caps the level used by all kernels, e.g. to compare or benchmark the code paths
+void setSimdLevel(SimdLevel maxLevel);
+
+const char * simdLevelName(SimdLevel level);
+
+#endif
@@ -0,0 +1,88 @@
+/*
+
+Per-frame bump allocator
+
+*/
+
+#include <stdint.h>
+#include <algorithm>
+#include "FrameArena.h"
+
+// the block grows in steps of this, so frames that vary a little in size do not
+// make it grow again and again
+static const size_t BLOCK_GRANULARITY = 64 * 1024;
+
+FrameArena::FrameArena(size_t initialBytes)
+	: m_pBlock(NULL), m_capacity(0), m_offset(0), m_overflowBytes(0), m_peak(0)
+{
+	if (initialBytes > 0)
+	{
+		m_capacity = alignedPitch(initialBytes, BLOCK_GRANULARITY);
+		m_pBlock = (unsigned char *)alignedMalloc(m_capacity);
+	}
+}
+
+FrameArena::~FrameArena()
+{
+	for (size_t i = 0; i < m_overflow.size(); i++)
+		alignedFree(m_overflow[i]);
+	alignedFree(m_pBlock);
+}
+
+void * FrameArena::allocate(size_t bytes, size_t alignment)
+/*claims [start, start + bytes) of the block with a compare-exchange, so bands
+allocating at the same time get disjoint ranges without a lock*/
+{
+	if (bytes == 0)
+		bytes = 1;
+
+	const uintptr_t base = (uintptr_t)m_pBlock;
+	size_t offset = m_offset.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		const size_t start = (size_t)(((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base);
+		const size_t end = start + bytes;
+		if (m_pBlock == NULL || end > m_capacity)
+			break;
+		if (m_offset.compare_exchange_weak(offset, end, std::memory_order_relaxed))
+			return m_pBlock + start;
+	}
+
+	// full: a block of its own, kept until reset()
+	void * p = alignedMalloc(bytes, std::max(alignment, sizeof(void *)));
+	std::lock_guard<std::mutex> lock(m_overflowMutex);
+	m_overflow.push_back(p);
+	m_overflowBytes += bytes + alignment;
+	return p;
+}
+
+void FrameArena::reset()
+{
+	const size_t frameBytes = used();
+	m_peak = std::max(m_peak, frameBytes);
+
+	for (size_t i = 0; i < m_overflow.size(); i++)
+		alignedFree(m_overflow[i]);
+	m_overflow.clear();
+	m_overflowBytes = 0;
+
+	if (m_peak > m_capacity)
+	{
+		alignedFree(m_pBlock);
+		m_capacity = alignedPitch(m_peak, BLOCK_GRANULARITY);
+		m_pBlock = (unsigned char *)alignedMalloc(m_capacity);
+	}
+	m_offset.store(0, std::memory_order_relaxed);
+}
+
+size_t FrameArena::used() const
+{
+	std::lock_guard<std::mutex> lock(m_overflowMutex);
+	return m_offset.load(std::memory_order_relaxed) + m_overflowBytes;
+}
+
+int FrameArena::numOverflows() const
+{
+	std::lock_guard<std::mutex> lock(m_overflowMutex);
+	return (int)m_overflow.size();
+}
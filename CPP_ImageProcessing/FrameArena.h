@@ -0,0 +1,91 @@
+#ifndef __FRAME_ARENA_H__
+#define __FRAME_ARENA_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 FrameArena.h
+///
+/// Bump allocator for the scratch buffers and temporary images of one frame.
+/// Allocating moves a pointer through one aligned block, reset() hands the whole
+/// block back at once. A frame that does not fit spills into extra heap blocks,
+/// reset() then grows the block to the frame's size, so processing frames of the
+/// same size settles at no heap allocations at all.
+///
+//=================================================================================
+//=================================================================================
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "AlignedMemory.h"
+
+/*
+allocate() may be called from several threads at once (the bands of a stage),
+reset() only when no allocation of the frame is in use any more. Memory is not
+initialized and nothing is destructed, only trivial types go into the arena.
+*/
+class FrameArena
+{
+public:
+	// initialBytes: size of the block before the first reset()
+	explicit FrameArena(size_t initialBytes = 0);
+	~FrameArena();
+
+	// bytes aligned to alignment (a power of 2), valid until the next reset()
+	void * allocate(size_t bytes, size_t alignment = IMAGE_ALIGNMENT);
+	template <typename T>
+	T * allocateArray(size_t count) { return (T *)allocate(count * sizeof(T)); }
+
+	// frees everything allocated since the last reset(), the block grows to the
+	// size of the largest frame so far
+	void reset();
+
+	size_t capacity() const { return m_capacity; }
+	// bytes handed out since the last reset()
+	size_t used() const;
+	// heap blocks allocated since the last reset() because the block was full
+	int numOverflows() const;
+
+private:
+	FrameArena(const FrameArena &);
+	FrameArena & operator=(const FrameArena &);
+
+	unsigned char * m_pBlock;
+	size_t m_capacity;
+	std::atomic<size_t> m_offset;		// bytes of the block in use
+	mutable std::mutex m_overflowMutex;
+	std::vector<void *> m_overflow;		// blocks of the allocations that did not fit
+	size_t m_overflowBytes;
+	size_t m_peak;						// most bytes any frame needed
+};
+
+/*
+Scratch array of a stage: from the arena if there is one, from the heap
+otherwise (and freed at the end of the scope).
+*/
+template <typename T>
+class ScratchBuffer
+{
+public:
+	ScratchBuffer(FrameArena * pArena, size_t count) : m_pArena(pArena)
+	{
+		m_pData = pArena ? pArena->allocateArray<T>(count) : (T *)alignedMalloc(count * sizeof(T));
+	}
+	~ScratchBuffer()
+	{
+		if (!m_pArena)
+			alignedFree(m_pData);
+	}
+
+	T * get() const { return m_pData; }
+	T & operator[](size_t i) const { return m_pData[i]; }
+
+private:
+	ScratchBuffer(const ScratchBuffer &);
+	ScratchBuffer & operator=(const ScratchBuffer &);
+
+	FrameArena * m_pArena;
+	T * m_pData;
+};
+
+#endif
@@ -0,0 +1,223 @@
+/*
+
+Separable 3x3 Gaussian with SIMD row kernels
+
+*/
+
+#include <string.h>
+#include "GaussFilter.h"
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
+#include "FrameArena.h"
+#include "Profiler.h"
+
+#if defined(IP_X86)
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+// dst[i] = (a[i] + 2*b[i] + c[i]) / 4 for i < n
+typedef void (*GaussRowFunc)(unsigned char * pDst, const unsigned char * pA,
+	const unsigned char * pB, const unsigned char * pC, int n);
+
+static void gaussRow_Scalar(unsigned char * pDst, const unsigned char * pA,
+	const unsigned char * pB, const unsigned char * pC, int n)
+{
+	for (int x = 0; x < n; x++)
+	{
+		const unsigned int sum = (int)pA[x] + 2 * (int)pB[x] + (int)pC[x];
+		pDst[x] = sum / 4;
+	}
+}
+
+#if defined(IP_X86)
+IP_TARGET_SSE2
+static void gaussRow_SSE2(unsigned char * pDst, const unsigned char * pA,
+	const unsigned char * pB, const unsigned char * pC, int n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int x = 0;
+
+	// 16 pixels per iteration, sums in 16 bit lanes (max 4*255)
+	for (; x + 16 <= n; x += 16)
+	{
+		const __m128i a = _mm_loadu_si128((const __m128i *)(pA + x));
+		const __m128i b = _mm_loadu_si128((const __m128i *)(pB + x));
+		const __m128i c = _mm_loadu_si128((const __m128i *)(pC + x));
+
+		__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(c, zero));
+		__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(c, zero));
+		lo = _mm_add_epi16(lo, _mm_slli_epi16(_mm_unpacklo_epi8(b, zero), 1));
+		hi = _mm_add_epi16(hi, _mm_slli_epi16(_mm_unpackhi_epi8(b, zero), 1));
+
+		_mm_storeu_si128((__m128i *)(pDst + x),
+			_mm_packus_epi16(_mm_srli_epi16(lo, 2), _mm_srli_epi16(hi, 2)));
+	}
+
+	gaussRow_Scalar(pDst + x, pA + x, pB + x, pC + x, n - x);
+}
+
+IP_TARGET_AVX2
+static void gaussRow_AVX2(unsigned char * pDst, const unsigned char * pA,
+	const unsigned char * pB, const unsigned char * pC, int n)
+{
+	int x = 0;
+
+	// 32 pixels per iteration
+	for (; x + 32 <= n; x += 32)
+	{
+		const __m256i a = _mm256_loadu_si256((const __m256i *)(pA + x));
+		const __m256i b = _mm256_loadu_si256((const __m256i *)(pB + x));
+		const __m256i c = _mm256_loadu_si256((const __m256i *)(pC + x));
+
+		__m256i lo = _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(a)),
+			_mm256_cvtepu8_epi16(_mm256_castsi256_si128(c)));
+		__m256i hi = _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(a, 1)),
+			_mm256_cvtepu8_epi16(_mm256_extracti128_si256(c, 1)));
+		lo = _mm256_add_epi16(lo, _mm256_slli_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(b)), 1));
+		hi = _mm256_add_epi16(hi, _mm256_slli_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(b, 1)), 1));
+
+		// packus works per 128 bit lane, restore the pixel order afterwards
+		const __m256i packed = _mm256_packus_epi16(_mm256_srli_epi16(lo, 2), _mm256_srli_epi16(hi, 2));
+		_mm256_storeu_si256((__m256i *)(pDst + x), _mm256_permute4x64_epi64(packed, 0xD8));
+	}
+
+	gaussRow_SSE2(pDst + x, pA + x, pB + x, pC + x, n - x);
+}
+
+#if defined(IP_HAVE_AVX512)
+IP_TARGET_AVX512
+static void gaussRow_AVX512(unsigned char * pDst, const unsigned char * pA,
+	const unsigned char * pB, const unsigned char * pC, int n)
+{
+	int x = 0;
+
+	// 64 pixels per iteration, two halves of 32 pixels in 16 bit lanes
+	for (; x + 64 <= n; x += 64)
+	{
+		for (int h = 0; h < 64; h += 32)
+		{
+			const __m512i a = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(pA + x + h)));
+			const __m512i b = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(pB + x + h)));
+			const __m512i c = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(pC + x + h)));
+
+			const __m512i sum = _mm512_add_epi16(_mm512_add_epi16(a, c), _mm512_slli_epi16(b, 1));
+			_mm256_storeu_si256((__m256i *)(pDst + x + h), _mm512_cvtepi16_epi8(_mm512_srli_epi16(sum, 2)));
+		}
+	}
+
+	gaussRow_AVX2(pDst + x, pA + x, pB + x, pC + x, n - x);
+}
+#endif
+#endif
+
+static GaussRowFunc selectGaussRow()
+/*returns the fastest row kernel the CPU supports*/
+{
+#if defined(IP_X86)
+	switch (simdLevel())
+	{
+#if defined(IP_HAVE_AVX512)
+	case SIMD_AVX512:	return gaussRow_AVX512;
+#endif
+	case SIMD_AVX2:		return gaussRow_AVX2;
+	case SIMD_SSE2:		return gaussRow_SSE2;
+	default:			break;
+	}
+#endif
+	return gaussRow_Scalar;
+}
+
+void filterGauss3x1(unsigned char * pImgDst, const unsigned char * pImgSrc,
+	const int width, const int height)
+{
+	if (width < 3)
+		return;
+
+	const GaussRowFunc gaussRow = selectGaussRow();
+
+	for (int y = 0; y < height; y++)
+	{
+		unsigned char * pDst = pImgDst + y* width + 1;
+		const unsigned char *pSrc = pImgSrc + y* width;
+
+		gaussRow(pDst, pSrc, pSrc + 1, pSrc + 2, width - 2);
+	}
+}
+
+
+void filterGauss1x3(unsigned char * pImgDst, const unsigned char * pImgSrc,
+	const int width, const int height)
+{
+	const GaussRowFunc gaussRow = selectGaussRow();
+
+	for (int y = 1; y < height - 1; y++)
+	{
+		unsigned char * pDst = pImgDst + y* width;
+		const unsigned char *pSrc = pImgSrc + y* width;
+
+		gaussRow(pDst, pSrc - width, pSrc, pSrc + width, width);
+	}
+}
+
+void filterGaussian3x3(unsigned char * pImg, const int width, const int height,
+	FrameArena * pArena)
+{
+	IP_PROFILE_SCOPE_IO("filterGaussian3x3", width * height, 2 * width * height, 2 * width * height);
+	ScratchBuffer<unsigned char> fltY(pArena, (size_t)width*height);
+	unsigned char * pFltY = fltY.get();
+
+	filterGauss1x3(pFltY, pImg, width, height);
+
+	// copy border
+	memcpy(pFltY, pImg, width);
+	memcpy(pFltY + width*(height - 1), pImg + width*(height - 1), width);
+
+	filterGauss3x1(pImg, pFltY, width, height);
+}
+
+void filterGaussian3x3Line(unsigned char * pDst, const unsigned char * pAbove,
+	const unsigned char * pRow, const unsigned char * pBelow, const int width,
+	unsigned char * pLineBuf)
+{
+	const GaussRowFunc gaussRow = selectGaussRow();
+
+	// vertical pass into the line buffer, border rows stay unfiltered
+	if (pAbove == NULL || pBelow == NULL)
+		memcpy(pLineBuf, pRow, width);
+	else
+		gaussRow(pLineBuf, pAbove, pRow, pBelow, width);
+
+	// horizontal pass, border columns keep the unfiltered source value
+	pDst[0] = pRow[0];
+	pDst[width - 1] = pRow[width - 1];
+	if (width >= 3)
+		gaussRow(pDst + 1, pLineBuf, pLineBuf + 1, pLineBuf + 2, width - 2);
+}
+
+void filterGaussian3x3Rows(unsigned char * pImgDst, const unsigned char * pImgSrc,
+	const int width, const int height, const int y0, const int y1, unsigned char * pLineBuf)
+{
+	for (int y = y0; y < y1; y++)
+	{
+		const unsigned char * pSrc = pImgSrc + y * width;
+		const bool border = (y == 0 || y == height - 1);
+
+		filterGaussian3x3Line(pImgDst + y * width, border ? NULL : pSrc - width, pSrc,
+			border ? NULL : pSrc + width, width, pLineBuf);
+	}
+}
+
+void filterGaussian3x3(unsigned char * pImgDst, const unsigned char * pImgSrc,
+	const int width, const int height, ThreadPool * pPool, FrameArena * pArena)
+{
+	IP_PROFILE_SCOPE_IO("filterGaussian3x3", width * height, width * height, width * height);
+	if (width <= 0)
+		return;
+
+	parallelFor(pPool, 0, height, [=](int y0, int y1)
+	{
+		ScratchBuffer<unsigned char> lineBuf(pArena, width);
+		filterGaussian3x3Rows(pImgDst, pImgSrc, width, height, y0, y1, lineBuf.get());
+	}, MIN_BAND_ROWS);
+}
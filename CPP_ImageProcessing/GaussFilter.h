@@ -0,0 +1,49 @@
+#ifndef __GAUSS_FILTER_H__
+#define __GAUSS_FILTER_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 GaussFilter.h
+///
+/// Separable 3x3 Gaussian ([1 2 1]/4 in x and y) on 8 bit gray images.
+/// The row kernel is available as scalar, SSE2, AVX2 and AVX-512 code, the best
+/// one is chosen at runtime (see CpuFeatures.h). All paths give identical results.
+///
+//=================================================================================
+//=================================================================================
+
+// horizontal [1 2 1]/4 pass, columns 0 and width-1 of pImgDst are not written
+void filterGauss3x1(unsigned char * pImgDst, const unsigned char * pImgSrc,
+	const int width, const int height);
+
+// vertical [1 2 1]/4 pass, rows 0 and height-1 of pImgDst are not written
+void filterGauss1x3(unsigned char * pImgDst, const unsigned char * pImgSrc,
+	const int width, const int height);
+
+class ThreadPool;
+class FrameArena;
+
+// in place 3x3 Gaussian, border rows/columns are only filtered in one direction.
+// The intermediate image comes from pArena if given
+void filterGaussian3x3(unsigned char * pImg, const int width, const int height,
+	FrameArena * pArena = NULL);
+
+// out of place 3x3 Gaussian, same result as the in place version. Rows are
+// filtered in bands on pPool (NULL: calling thread only), the line buffers of
+// the bands come from pArena if given
+void filterGaussian3x3(unsigned char * pImgDst, const unsigned char * pImgSrc,
+	const int width, const int height, ThreadPool * pPool, FrameArena * pArena = NULL);
+
+// out of place 3x3 Gaussian of rows [y0, y1), reads rows y0-1 .. y1 of pImgSrc
+// as halo. pLineBuf is scratch memory of width bytes
+void filterGaussian3x3Rows(unsigned char * pImgDst, const unsigned char * pImgSrc,
+	const int width, const int height, const int y0, const int y1, unsigned char * pLineBuf);
+
+// 3x3 Gaussian of a single row from the rows above and below it. pAbove and
+// pBelow are NULL for the first and last image row (no vertical filtering).
+// pLineBuf is scratch memory of width bytes
+void filterGaussian3x3Line(unsigned char * pDst, const unsigned char * pAbove,
+	const unsigned char * pRow, const unsigned char * pBelow, const int width,
+	unsigned char * pLineBuf);
+
+#endif
@@ -0,0 +1,267 @@
+/*
+
+Gradient magnitude with SIMD row kernels
+
+*/
+
+#include <math.h>
+#include <string.h>
+#include "Gradient.h"
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
+
+#if defined(IP_X86)
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+/*
+Parameters of one operator. The squared gradient s = gx^2 + gy^2 is halved in
+integer arithmetic, which keeps it below 2^24 (exact in float) even for Scharr,
+and scaled by invNorm, an exact power of two since (2 * w0 + w1)^2 is one:
+	floor(sqrt((s >> 1) * invNorm)) = floor(sqrt(s / 2) / (2 * w0 + w1))
+Float sqrt is correctly rounded and the argument is at least 1 / 256 away
+from the next square, so truncating the root gives the exact integer result.
+*/
+struct GradientParams
+{
+	int w0;
+	int w1;
+	float invNorm;
+};
+
+static GradientParams gradientParams(GradientOperator op)
+{
+	GradientParams params;
+	switch (op)
+	{
+	case GRADIENT_SOBEL:
+		params.w0 = 1;
+		params.w1 = 2;
+		params.invNorm = 1.f / 16;
+		break;
+	case GRADIENT_SCHARR:
+		params.w0 = 3;
+		params.w1 = 10;
+		params.invNorm = 1.f / 256;
+		break;
+	default:
+		params.w0 = 0;
+		params.w1 = 1;
+		params.invNorm = 1.f;
+		break;
+	}
+	return params;
+}
+
+// pDst[x] for x in [begin, end), all of them need their left and right neighbours
+typedef void (*GradientRowFunc)(unsigned char * pDst, const unsigned char * pA,
+	const unsigned char * pB, const unsigned char * pC, int begin, int end, const GradientParams & params);
+
+static void gradientRow_Scalar(unsigned char * pDst, const unsigned char * pA,
+	const unsigned char * pB, const unsigned char * pC, int begin, int end, const GradientParams & params)
+{
+	const int w0 = params.w0;
+	const int w1 = params.w1;
+
+	for (int x = begin; x < end; x++)
+	{
+		const int gradX = w0 * (pA[x + 1] - pA[x - 1] + pC[x + 1] - pC[x - 1]) + w1 * (pB[x + 1] - pB[x - 1]);
+		const int gradY = w0 * (pC[x - 1] - pA[x - 1] + pC[x + 1] - pA[x + 1]) + w1 * (pC[x] - pA[x]);
+		const int halfSquare = (gradX * gradX + gradY * gradY) >> 1;
+		pDst[x] = (unsigned char)sqrtf((float)halfSquare * params.invNorm);
+	}
+}
+
+#if defined(IP_X86)
+IP_TARGET_SSE2
+static inline __m128i loadWiden_SSE2(const unsigned char * p)
+{
+	return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)p), _mm_setzero_si128());
+}
+
+IP_TARGET_SSE2
+static void gradientRow_SSE2(unsigned char * pDst, const unsigned char * pA,
+	const unsigned char * pB, const unsigned char * pC, int begin, int end, const GradientParams & params)
+{
+	const __m128i w0 = _mm_set1_epi16((short)params.w0);
+	const __m128i w1 = _mm_set1_epi16((short)params.w1);
+	const __m128 invNorm = _mm_set1_ps(params.invNorm);
+	int x = begin;
+
+	// 8 pixels per iteration, gradients in 16 bit lanes
+	for (; x + 8 <= end; x += 8)
+	{
+		// vertical smoothing and difference of the columns left and right of x
+		const __m128i smoothL = _mm_add_epi16(_mm_mullo_epi16(_mm_add_epi16(loadWiden_SSE2(pA + x - 1),
+			loadWiden_SSE2(pC + x - 1)), w0), _mm_mullo_epi16(loadWiden_SSE2(pB + x - 1), w1));
+		const __m128i smoothR = _mm_add_epi16(_mm_mullo_epi16(_mm_add_epi16(loadWiden_SSE2(pA + x + 1),
+			loadWiden_SSE2(pC + x + 1)), w0), _mm_mullo_epi16(loadWiden_SSE2(pB + x + 1), w1));
+		const __m128i diffL = _mm_sub_epi16(loadWiden_SSE2(pC + x - 1), loadWiden_SSE2(pA + x - 1));
+		const __m128i diffC = _mm_sub_epi16(loadWiden_SSE2(pC + x), loadWiden_SSE2(pA + x));
+		const __m128i diffR = _mm_sub_epi16(loadWiden_SSE2(pC + x + 1), loadWiden_SSE2(pA + x + 1));
+
+		const __m128i gradX = _mm_sub_epi16(smoothR, smoothL);
+		const __m128i gradY = _mm_add_epi16(_mm_mullo_epi16(_mm_add_epi16(diffL, diffR), w0), _mm_mullo_epi16(diffC, w1));
+
+		// gx^2 + gy^2 of interleaved (gx, gy) pairs in one multiply-add
+		const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(gradX, gradY), _mm_unpacklo_epi16(gradX, gradY));
+		const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(gradX, gradY), _mm_unpackhi_epi16(gradX, gradY));
+		const __m128i magLo = _mm_cvttps_epi32(_mm_sqrt_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(lo, 1)), invNorm)));
+		const __m128i magHi = _mm_cvttps_epi32(_mm_sqrt_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(hi, 1)), invNorm)));
+
+		const __m128i mag = _mm_packs_epi32(magLo, magHi);
+		_mm_storel_epi64((__m128i *)(pDst + x), _mm_packus_epi16(mag, mag));
+	}
+
+	gradientRow_Scalar(pDst, pA, pB, pC, x, end, params);
+}
+
+IP_TARGET_AVX2
+static inline __m256i loadWiden_AVX2(const unsigned char * p)
+{
+	return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p));
+}
+
+IP_TARGET_AVX2
+static void gradientRow_AVX2(unsigned char * pDst, const unsigned char * pA,
+	const unsigned char * pB, const unsigned char * pC, int begin, int end, const GradientParams & params)
+{
+	const __m256i w0 = _mm256_set1_epi16((short)params.w0);
+	const __m256i w1 = _mm256_set1_epi16((short)params.w1);
+	const __m256 invNorm = _mm256_set1_ps(params.invNorm);
+	int x = begin;
+
+	// 16 pixels per iteration
+	for (; x + 16 <= end; x += 16)
+	{
+		const __m256i smoothL = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_add_epi16(loadWiden_AVX2(pA + x - 1),
+			loadWiden_AVX2(pC + x - 1)), w0), _mm256_mullo_epi16(loadWiden_AVX2(pB + x - 1), w1));
+		const __m256i smoothR = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_add_epi16(loadWiden_AVX2(pA + x + 1),
+			loadWiden_AVX2(pC + x + 1)), w0), _mm256_mullo_epi16(loadWiden_AVX2(pB + x + 1), w1));
+		const __m256i diffL = _mm256_sub_epi16(loadWiden_AVX2(pC + x - 1), loadWiden_AVX2(pA + x - 1));
+		const __m256i diffC = _mm256_sub_epi16(loadWiden_AVX2(pC + x), loadWiden_AVX2(pA + x));
+		const __m256i diffR = _mm256_sub_epi16(loadWiden_AVX2(pC + x + 1), loadWiden_AVX2(pA + x + 1));
+
+		const __m256i gradX = _mm256_sub_epi16(smoothR, smoothL);
+		const __m256i gradY = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_add_epi16(diffL, diffR), w0),
+			_mm256_mullo_epi16(diffC, w1));
+
+		// unpack and pack both work per 128 bit lane, so the pixel order survives
+		// up to the final byte pack
+		const __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(gradX, gradY), _mm256_unpacklo_epi16(gradX, gradY));
+		const __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(gradX, gradY), _mm256_unpackhi_epi16(gradX, gradY));
+		const __m256i magLo = _mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(lo, 1)), invNorm)));
+		const __m256i magHi = _mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(hi, 1)), invNorm)));
+
+		const __m256i mag = _mm256_packs_epi32(magLo, magHi);
+		const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(mag, mag), 0xD8);
+		_mm_storeu_si128((__m128i *)(pDst + x), _mm256_castsi256_si128(packed));
+	}
+
+	gradientRow_SSE2(pDst, pA, pB, pC, x, end, params);
+}
+
+#if defined(IP_HAVE_AVX512)
+IP_TARGET_AVX512
+static inline __m512i loadWiden_AVX512(const unsigned char * p)
+{
+	return _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)p));
+}
+
+IP_TARGET_AVX512
+static void gradientRow_AVX512(unsigned char * pDst, const unsigned char * pA,
+	const unsigned char * pB, const unsigned char * pC, int begin, int end, const GradientParams & params)
+{
+	const __m512i w0 = _mm512_set1_epi16((short)params.w0);
+	const __m512i w1 = _mm512_set1_epi16((short)params.w1);
+	const __m512 invNorm = _mm512_set1_ps(params.invNorm);
+	int x = begin;
+
+	// 32 pixels per iteration
+	for (; x + 32 <= end; x += 32)
+	{
+		const __m512i smoothL = _mm512_add_epi16(_mm512_mullo_epi16(_mm512_add_epi16(loadWiden_AVX512(pA + x - 1),
+			loadWiden_AVX512(pC + x - 1)), w0), _mm512_mullo_epi16(loadWiden_AVX512(pB + x - 1), w1));
+		const __m512i smoothR = _mm512_add_epi16(_mm512_mullo_epi16(_mm512_add_epi16(loadWiden_AVX512(pA + x + 1),
+			loadWiden_AVX512(pC + x + 1)), w0), _mm512_mullo_epi16(loadWiden_AVX512(pB + x + 1), w1));
+		const __m512i diffL = _mm512_sub_epi16(loadWiden_AVX512(pC + x - 1), loadWiden_AVX512(pA + x - 1));
+		const __m512i diffC = _mm512_sub_epi16(loadWiden_AVX512(pC + x), loadWiden_AVX512(pA + x));
+		const __m512i diffR = _mm512_sub_epi16(loadWiden_AVX512(pC + x + 1), loadWiden_AVX512(pA + x + 1));
+
+		const __m512i gradX = _mm512_sub_epi16(smoothR, smoothL);
+		const __m512i gradY = _mm512_add_epi16(_mm512_mullo_epi16(_mm512_add_epi16(diffL, diffR), w0),
+			_mm512_mullo_epi16(diffC, w1));
+
+		const __m512i lo = _mm512_madd_epi16(_mm512_unpacklo_epi16(gradX, gradY), _mm512_unpacklo_epi16(gradX, gradY));
+		const __m512i hi = _mm512_madd_epi16(_mm512_unpackhi_epi16(gradX, gradY), _mm512_unpackhi_epi16(gradX, gradY));
+		const __m512i magLo = _mm512_cvttps_epi32(_mm512_sqrt_ps(_mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_srli_epi32(lo, 1)), invNorm)));
+		const __m512i magHi = _mm512_cvttps_epi32(_mm512_sqrt_ps(_mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_srli_epi32(hi, 1)), invNorm)));
+
+		// the 32 bit pack keeps the pixel order per lane, the magnitudes fit a byte
+		_mm256_storeu_si256((__m256i *)(pDst + x), _mm512_cvtepi16_epi8(_mm512_packs_epi32(magLo, magHi)));
+	}
+
+	gradientRow_AVX2(pDst, pA, pB, pC, x, end, params);
+}
+#endif
+#endif
+
+static GradientRowFunc selectGradientRow()
+/*returns the fastest row kernel the CPU supports*/
+{
+#if defined(IP_X86)
+	switch (simdLevel())
+	{
+#if defined(IP_HAVE_AVX512)
+	case SIMD_AVX512:	return gradientRow_AVX512;
+#endif
+	case SIMD_AVX2:		return gradientRow_AVX2;
+	case SIMD_SSE2:		return gradientRow_SSE2;
+	default:			break;
+	}
+#endif
+	return gradientRow_Scalar;
+}
+
+static void magnitudeRow(GradientRowFunc gradientRow, unsigned char * pDst, const unsigned char * pAbove,
+	const unsigned char * pRow, const unsigned char * pBelow, const int width, const GradientParams & params)
+{
+	if (width <= 0)
+		return;
+
+	pDst[0] = 0;
+	gradientRow(pDst, pAbove, pRow, pBelow, 1, width - 1, params);
+	pDst[width - 1] = 0;
+}
+
+void gradientMagnitudeRow(unsigned char * pDst, const unsigned char * pAbove,
+	const unsigned char * pRow, const unsigned char * pBelow, const int width,
+	GradientOperator op)
+{
+	magnitudeRow(selectGradientRow(), pDst, pAbove, pRow, pBelow, width, gradientParams(op));
+}
+
+void gradientMagnitude(const ImageViewT<unsigned char> & dst, const ImageViewT<const unsigned char> & src,
+	GradientOperator op, ThreadPool * pPool)
+{
+	if (dst.empty() || src.empty())
+		return;
+
+	const GradientRowFunc gradientRow = selectGradientRow();
+	const GradientParams params = gradientParams(op);
+	const int rows = dst.rows();
+	const int cols = dst.cols();
+
+	// rows y-1 and y+1 are read from src, so every band sees its halo rows
+	parallelFor(pPool, 0, rows, [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			if (y == 0 || y == rows - 1)
+				memset(dst.rowPtr(y), 0, cols);
+			else
+				magnitudeRow(gradientRow, dst.rowPtr(y), src.rowPtr(y - 1), src.rowPtr(y), src.rowPtr(y + 1), cols, params);
+		}
+	}, MIN_BAND_ROWS);
+}
@@ -0,0 +1,50 @@
+#ifndef __GRADIENT_H__
+#define __GRADIENT_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 Gradient.h
+///
+/// Gradient magnitude of 8 bit gray images with central differences, Sobel or
+/// Scharr. Gradients are 16 bit integers, the magnitude is an exact integer
+/// square root taken with float sqrt on 4, 8 or 16 lanes (SSE2, AVX2,
+/// AVX-512). All code paths give identical results.
+///
+//=================================================================================
+//=================================================================================
+
+#include "ImageProcess.h"
+
+class ThreadPool;
+
+/*
+Derivative operators, as a smoothing column w0 w1 w0 across the difference
+	central		gx = p(x+1, y) - p(x-1, y)						(w0 = 0, w1 = 1)
+	Sobel		[1 2 1] smoothing, gradients up to 4 * 255		(w0 = 1, w1 = 2)
+	Scharr		[3 10 3] smoothing, gradients up to 16 * 255	(w0 = 3, w1 = 10)
+*/
+enum GradientOperator
+{
+	GRADIENT_CENTRAL = 0,
+	GRADIENT_SOBEL,
+	GRADIENT_SCHARR
+};
+
+/*
+Magnitude of one row, scaled to 0..255:
+	floor(sqrt(gx^2 + gy^2) / (sqrt(2) * (2 * w0 + w1)))
+For central differences this is the energy of computeEnergy() (GrayPipeline.h),
+bit-identical to the earlier float formula sqrt((float)(gx^2 + gy^2)) / sqrt(2.f)
+for all 511 * 511 possible (gx, gy) pairs. pAbove and pBelow are the
+neighbouring rows, the first and last pixel of pDst are set to 0.
+*/
+void gradientMagnitudeRow(unsigned char * pDst, const unsigned char * pAbove,
+	const unsigned char * pRow, const unsigned char * pBelow, const int width,
+	GradientOperator op = GRADIENT_CENTRAL);
+
+// gradient magnitude of src, the one pixel border of dst is set to 0. dst and
+// src have the same size and must not overlap
+void gradientMagnitude(const ImageViewT<unsigned char> & dst, const ImageViewT<const unsigned char> & src,
+	GradientOperator op = GRADIENT_CENTRAL, ThreadPool * pPool = NULL);
+
+#endif
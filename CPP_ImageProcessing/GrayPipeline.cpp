@@ -0,0 +1,261 @@
+/*
+
+Band-parallel stages of the gray-value pipeline
+
+*/
+
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#include "GrayPipeline.h"
+#include "ThreadPool.h"
+#include "GaussFilter.h"
+#include "FrameArena.h"
+#include "Profiler.h"
+#include "Histogram.h"
+#include "StripPNM_IO.h"
+
+static void scaleHalfRow(unsigned char * pDst, const unsigned char * pSrcRow, const int widthScl)
+{
+	for (int x = 0; x < widthScl; x++)
+		pDst[x] = pSrcRow[2 * x];
+}
+
+void scaleHalf(unsigned char * pDst, const unsigned char * pSrc,
+	const int width, const int height, ThreadPool * pPool)
+{
+	IP_PROFILE_SCOPE_IO("scaleHalf", (width / 2) * (height / 2), (height / 2) * width, (width / 2) * (height / 2));
+	const int widthScl = width / 2;
+	const int heightScl = height / 2;
+
+	parallelFor(pPool, 0, heightScl, [=](int y0, int y1)
+	{
+		for (int y = y0; y < y1; y++)
+			scaleHalfRow(pDst + y*widthScl, pSrc + 2 * y*width, widthScl);
+	}, MIN_BAND_ROWS);
+}
+
+void stretchHistogram(unsigned char * pImg, const int width, const int height,
+	const float cutOffPercentage, ThreadPool * pPool)
+{
+	IP_PROFILE_SCOPE_IO("stretchHistogram", width * height, 2 * width * height, width * height);
+	stretchPercentile(ImageViewT<unsigned char>(pImg, height, width, width), cutOffPercentage, pPool);
+}
+
+void computeEnergy(unsigned char * pEnergy, const unsigned char * pSrc,
+	const int width, const int height, ThreadPool * pPool, GradientOperator op)
+{
+	IP_PROFILE_SCOPE_IO("computeEnergy", width * height, width * height, width * height);
+	gradientMagnitude(ImageViewT<unsigned char>(pEnergy, height, width, width),
+		ImageViewT<const unsigned char>(pSrc, height, width, width), op, pPool);
+}
+
+void computeEnergyLine(unsigned char * pDst, const unsigned char * pAbove,
+	const unsigned char * pRow, const unsigned char * pBelow, const int width)
+{
+	if (pAbove == NULL || pBelow == NULL)
+		memset(pDst, 0, width);
+	else
+		gradientMagnitudeRow(pDst, pAbove, pRow, pBelow, width);
+}
+
+void thresholdImage(unsigned char * pImg, const int width, const int height,
+	const unsigned char threshold, ThreadPool * pPool)
+{
+	IP_PROFILE_SCOPE_IO("thresholdImage", width * height, width * height, width * height);
+	parallelFor(pPool, 0, height, [=](int y0, int y1)
+	{
+		unsigned char * p = pImg + y0 * width;
+		const int count = (y1 - y0) * width;
+		for (int i = 0; i < count; i++)
+		{
+			if (p[i] > threshold)
+				p[i] = 255;
+			else
+				p[i] = 0;
+		}
+	}, MIN_BAND_ROWS);
+}
+
+void runGrayPipelineFused(const unsigned char * pSrc, const int width, const int height,
+	const float cutOffPercentage, const unsigned char threshold,
+	const GrayPipelineBuffers & buffers, ThreadPool * pPool, FrameArena * pArena)
+{
+	IP_PROFILE_SCOPE_IO("runGrayPipelineFused", (width / 2) * (height / 2),
+		(height / 2) * width + (width / 2) * (height / 2), 2 * (width / 2) * (height / 2));
+	const int widthScl = width / 2;
+	const int heightScl = height / 2;
+	if (widthScl <= 0 || heightScl <= 0)
+		return;
+
+	//////////////////////////////////////////////////////////////////////////
+	// Pass 1: decimate, blur and histogram. Every band decimates its rows plus
+	// one halo row above and below into a ring of three lines
+	//////////////////////////////////////////////////////////////////////////
+	unsigned int histogram[256];
+	memset(histogram, 0, 256 * sizeof(unsigned int));
+	std::mutex mergeMutex;
+
+	parallelFor(pPool, 0, heightScl, [&](int y0, int y1)
+	{
+		ScratchBuffer<unsigned char> lines(pArena, 4 * widthScl);
+		unsigned char * pRing[3] = { &lines[0], &lines[widthScl], &lines[2 * widthScl] };
+		unsigned char * pLineBuf = &lines[3 * widthScl];
+
+		LaneHistogram bandHist;
+
+		for (int y = std::max(0, y0 - 1); y < std::min(heightScl, y0 + 1); y++)
+			scaleHalfRow(pRing[y % 3], pSrc + 2 * y*width, widthScl);
+
+		for (int y = y0; y < y1; y++)
+		{
+			if (y + 1 < heightScl)
+				scaleHalfRow(pRing[(y + 1) % 3], pSrc + 2 * (y + 1)*width, widthScl);
+
+			const bool border = (y == 0 || y == heightScl - 1);
+			const unsigned char * pRow = pRing[y % 3];
+			unsigned char * pOut = buffers.pFiltered + y*widthScl;
+
+			filterGaussian3x3Line(pOut, border ? NULL : pRing[(y + 2) % 3], pRow,
+				border ? NULL : pRing[(y + 1) % 3], widthScl, pLineBuf);
+
+			bandHist.add(pOut, widthScl);
+
+			if (buffers.pHalf)
+				memcpy(buffers.pHalf + y*widthScl, pRow, widthScl);
+		}
+
+		std::lock_guard<std::mutex> lock(mergeMutex);
+		bandHist.mergeInto(histogram);
+	}, MIN_BAND_ROWS);
+
+	int lowerBound, upperBound;
+	percentileBounds(histogram, 256, cutOffPercentage, lowerBound, upperBound);
+
+	// the stretch as a table, same mapping as stretchHistogram
+	unsigned char stretchLut[256];
+	buildStretchLut(stretchLut, lowerBound, upperBound);
+
+	//////////////////////////////////////////////////////////////////////////
+	// Pass 2: stretch, energy and threshold over a ring of three stretched lines
+	//////////////////////////////////////////////////////////////////////////
+	parallelFor(pPool, 0, heightScl, [&](int y0, int y1)
+	{
+		ScratchBuffer<unsigned char> lines(pArena, 4 * widthScl);
+		unsigned char * pRing[3] = { &lines[0], &lines[widthScl], &lines[2 * widthScl] };
+		unsigned char * pEnergyLine = &lines[3 * widthScl];
+
+		for (int y = std::max(0, y0 - 1); y < std::min(heightScl, y0 + 1); y++)
+			applyLutRow(pRing[y % 3], buffers.pFiltered + y*widthScl, widthScl, stretchLut);
+
+		for (int y = y0; y < y1; y++)
+		{
+			if (y + 1 < heightScl)
+				applyLutRow(pRing[(y + 1) % 3], buffers.pFiltered + (y + 1)*widthScl, widthScl, stretchLut);
+
+			if (y == 0 || y == heightScl - 1)
+				memset(pEnergyLine, 0, widthScl);
+			else
+				gradientMagnitudeRow(pEnergyLine, pRing[(y + 2) % 3], pRing[y % 3], pRing[(y + 1) % 3], widthScl);
+
+			unsigned char * pOut = buffers.pEnergyThresh + y*widthScl;
+			for (int x = 0; x < widthScl; x++)
+				pOut[x] = pEnergyLine[x] > threshold ? 255 : 0;
+
+			if (buffers.pStretched)
+				memcpy(buffers.pStretched + y*widthScl, pRing[y % 3], widthScl);
+			if (buffers.pEnergy)
+				memcpy(buffers.pEnergy + y*widthScl, pEnergyLine, widthScl);
+		}
+	}, MIN_BAND_ROWS);
+}
+
+bool runGrayStagesStreamed(const char * inFileName, const char * outFileName,
+	const int stages, const int stripRows, const unsigned char threshold, ThreadPool * pPool)
+{
+	IP_PROFILE_SCOPE("runGrayStagesStreamed");
+	PNMStripReader reader;
+	if (!reader.open(inFileName) || reader.channels() != 1 || reader.maxVal() > 255)
+		return false;
+
+	const int width = reader.width();
+	const int height = reader.height();
+
+	PNMStripWriter writer;
+	if (!writer.open(outFileName, width, height))
+		return false;
+
+	// every stage with a 3x3 neighborhood needs one more halo row
+	const int haloRows = ((stages & STREAM_GAUSSIAN) ? 1 : 0) + ((stages & STREAM_ENERGY) ? 1 : 0);
+	StripIterator strip(reader, stripRows, haloRows);
+
+	// ping-pong buffers of strip + halo rows, row i of a buffer is image row bufFirst + i
+	const int bufRows = stripRows + 2 * haloRows;
+	std::vector<unsigned char> bufA((size_t)bufRows * width);
+	std::vector<unsigned char> bufB((size_t)bufRows * width);
+	// line buffers of the bands, freed per strip so the arena settles after the first
+	FrameArena stripArena;
+	FrameArena * pArena = &stripArena;
+
+	while (strip.next())
+	{
+		// rows [first, end) of the current data, as pointers into strip or buffer
+		int first = strip.firstRow() - strip.haloAbove();
+		int end = strip.firstRow() + strip.numRows() + strip.haloBelow();
+		const unsigned char * pCur = strip.rowPtr(-strip.haloAbove());
+		unsigned char * pNext = &bufA[0];
+		unsigned char * pSpare = &bufB[0];
+
+		for (int stage = STREAM_GAUSSIAN; stage <= STREAM_ENERGY; stage <<= 1)
+		{
+			if (!(stages & stage))
+				continue;
+
+			// the output shrinks by the halo row on each side, except at the image border
+			const int outFirst = (first == 0) ? 0 : first + 1;
+			const int outEnd = (end == height) ? height : end - 1;
+			const unsigned char * pIn = pCur;
+			unsigned char * pOut = pNext;
+			const int inFirst = first;
+
+			parallelFor(pPool, outFirst, outEnd, [=](int y0, int y1)
+			{
+				ScratchBuffer<unsigned char> lineBuf(pArena, width);
+				for (int y = y0; y < y1; y++)
+				{
+					const unsigned char * pRow = pIn + (size_t)(y - inFirst) * width;
+					const unsigned char * pAbove = (y > 0) ? pRow - width : NULL;
+					const unsigned char * pBelow = (y < height - 1) ? pRow + width : NULL;
+					unsigned char * pDst = pOut + (size_t)(y - outFirst) * width;
+
+					if (stage == STREAM_GAUSSIAN)
+						filterGaussian3x3Line(pDst, pAbove, pRow, pBelow, width, lineBuf.get());
+					else
+						computeEnergyLine(pDst, pAbove, pRow, pBelow, width);
+				}
+			}, MIN_BAND_ROWS);
+
+			first = outFirst;
+			end = outEnd;
+			pCur = pNext;
+			std::swap(pNext, pSpare);
+		}
+
+		// strip rows of the final result
+		const unsigned char * pResult = pCur + (size_t)(strip.firstRow() - first) * width;
+		if (stages & STREAM_THRESHOLD)
+		{
+			unsigned char * pOut = pNext;
+			memcpy(pOut, pResult, (size_t)strip.numRows() * width);
+			thresholdImage(pOut, width, strip.numRows(), threshold, pPool);
+			pResult = pOut;
+		}
+
+		if (!writer.writeRows(pResult, strip.numRows()))
+			return false;
+		stripArena.reset();
+	}
+
+	return writer.close();
+}
@@ -0,0 +1,80 @@
+#ifndef __GRAY_PIPELINE_H__
+#define __GRAY_PIPELINE_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 GrayPipeline.h
+///
+/// Stages of the gray-value pipeline in main(): 2x decimation, histogram
+/// stretch, gradient energy and thresholding (the Gaussian is in GaussFilter.h).
+/// Every stage works on horizontal row bands on an optional thread pool,
+/// images are 8 bit, width x height, without row padding.
+///
+//=================================================================================
+//=================================================================================
+
+#include "Gradient.h"
+
+class ThreadPool;
+class FrameArena;
+
+// picks every second pixel of every second row, pDst is width/2 x height/2
+void scaleHalf(unsigned char * pDst, const unsigned char * pSrc,
+	const int width, const int height, ThreadPool * pPool);
+
+// cuts cutOffPercentage of the darkest and brightest pixels and stretches the
+// remaining gray-values linearly to 0..255, in place
+void stretchHistogram(unsigned char * pImg, const int width, const int height,
+	const float cutOffPercentage, ThreadPool * pPool);
+
+// gradient magnitude divided by sqrt(2) (see gradientMagnitudeRow() for the
+// other operators), the one pixel border of pEnergy is set to 0
+void computeEnergy(unsigned char * pEnergy, const unsigned char * pSrc,
+	const int width, const int height, ThreadPool * pPool, GradientOperator op = GRADIENT_CENTRAL);
+
+// energy of one row from the rows above and below it, pAbove and pBelow are
+// NULL for the first and last image row (all 0 there)
+void computeEnergyLine(unsigned char * pDst, const unsigned char * pAbove,
+	const unsigned char * pRow, const unsigned char * pBelow, const int width);
+
+// sets pixels above threshold to 255, all others to 0, in place
+void thresholdImage(unsigned char * pImg, const int width, const int height,
+	const unsigned char threshold, ThreadPool * pPool);
+
+// buffers of the fused pipeline, NULL entries are not written. Except for
+// pFiltered and pEnergyThresh they only exist to inspect intermediate results
+struct GrayPipelineBuffers
+{
+	unsigned char * pHalf;			// 2x decimated image
+	unsigned char * pFiltered;		// after the Gaussian, required (input of the second pass)
+	unsigned char * pStretched;		// after the histogram stretch
+	unsigned char * pEnergy;		// gradient energy
+	unsigned char * pEnergyThresh;	// thresholded energy, required, may be pSrc
+
+	GrayPipelineBuffers() : pHalf(0), pFiltered(0), pStretched(0), pEnergy(0), pEnergyThresh(0) {}
+};
+
+// the whole pipeline (scaleHalf, filterGaussian3x3, stretchHistogram,
+// computeEnergy, thresholdImage) in two streaming passes over rolling line
+// buffers: pass 1 decimates, blurs and builds the histogram, pass 2 stretches,
+// computes the energy and thresholds. Results are identical to the single stages.
+// All buffers are width/2 x height/2. The line buffers come from pArena if given
+void runGrayPipelineFused(const unsigned char * pSrc, const int width, const int height,
+	const float cutOffPercentage, const unsigned char threshold,
+	const GrayPipelineBuffers & buffers, ThreadPool * pPool, FrameArena * pArena = NULL);
+
+// stages for runGrayStagesStreamed, applied in this order
+enum GrayStreamStage
+{
+	STREAM_GAUSSIAN = 1,	// filterGaussian3x3
+	STREAM_ENERGY = 2,		// computeEnergy
+	STREAM_THRESHOLD = 4	// thresholdImage
+};
+
+// runs the selected stages on the 8 bit P5 file inFileName and writes the result
+// to outFileName, holding only strips of stripRows rows (plus halo rows) in
+// memory. Results are identical to the full-frame stages
+bool runGrayStagesStreamed(const char * inFileName, const char * outFileName,
+	const int stages, const int stripRows, const unsigned char threshold, ThreadPool * pPool);
+
+#endif
@@ -0,0 +1,318 @@
+/*
+
+Privatized histograms and the percentile stretch
+
+*/
+
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include "Histogram.h"
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
+
+#if defined(IP_X86)
+#include <immintrin.h>
+#endif
+
+void LaneHistogram::clear()
+{
+	memset(m_lanes, 0, sizeof(m_lanes));
+}
+
+void LaneHistogram::add(const unsigned char * pPixels, size_t count)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		++m_lanes[0][pPixels[i]];
+		++m_lanes[1][pPixels[i + 1]];
+		++m_lanes[2][pPixels[i + 2]];
+		++m_lanes[3][pPixels[i + 3]];
+	}
+	for (; i < count; i++)
+		++m_lanes[0][pPixels[i]];
+}
+
+void LaneHistogram::mergeInto(unsigned int histogram[256]) const
+{
+	for (int h = 0; h < 256; h++)
+		histogram[h] += m_lanes[0][h] + m_lanes[1][h] + m_lanes[2][h] + m_lanes[3][h];
+}
+
+void computeHistogram(const ImageViewT<const unsigned char> & img, unsigned int histogram[256],
+	ThreadPool * pPool)
+{
+	memset(histogram, 0, 256 * sizeof(unsigned int));
+	if (img.empty())
+		return;
+
+	// one private histogram per band, merged afterwards
+	std::mutex mergeMutex;
+	parallelFor(pPool, 0, img.rows(), [&](int y0, int y1)
+	{
+		LaneHistogram bandHist;
+		if (img.stride() == img.cols())
+			bandHist.add(img.rowPtr(y0), (size_t)(y1 - y0) * img.cols());
+		else
+		{
+			for (int y = y0; y < y1; y++)
+				bandHist.add(img.rowPtr(y), img.cols());
+		}
+
+		std::lock_guard<std::mutex> lock(mergeMutex);
+		bandHist.mergeInto(histogram);
+	}, MIN_BAND_ROWS);
+}
+
+void computeHistogram(const ImageViewT<const unsigned short> & img, const int maxVal,
+	std::vector<unsigned int> & histogram, ThreadPool * pPool)
+{
+	const int numBins = std::max(1, maxVal + 1);
+	histogram.assign(numBins, 0);
+	if (img.empty())
+		return;
+
+	std::mutex mergeMutex;
+	parallelFor(pPool, 0, img.rows(), [&](int y0, int y1)
+	{
+		std::vector<unsigned int> bandHist(numBins, 0);
+		for (int y = y0; y < y1; y++)
+		{
+			const unsigned short * p = img.rowPtr(y);
+			for (int x = 0; x < img.cols(); x++)
+				++bandHist[std::min<int>(p[x], numBins - 1)];
+		}
+
+		std::lock_guard<std::mutex> lock(mergeMutex);
+		for (int h = 0; h < numBins; h++)
+			histogram[h] += bandHist[h];
+	}, MIN_BAND_ROWS);
+}
+
+void percentileBounds(const unsigned int * histogram, const int numBins, const float cutOffPercentage,
+	int & lowerBound, int & upperBound)
+{
+	unsigned int numPixels = 0;
+	for (int h = 0; h < numBins; h++)
+		numPixels += histogram[h];
+
+	unsigned int		histAccu = 0;
+	const unsigned int	lowerPercentile = cutOffPercentage * numPixels;
+	const unsigned int	upperPercentile = (1 - cutOffPercentage) * numPixels;
+
+	lowerBound = 0;
+	upperBound = numBins - 1;
+	for (int h = 0; h < numBins; h++)
+	{
+		histAccu += histogram[h];
+		if (histAccu <= lowerPercentile)
+		{
+			lowerBound = h;
+			continue;
+		}
+		if (histAccu >= upperPercentile)
+		{
+			upperBound = h;
+			break;
+		}
+	}
+}
+
+void buildStretchLut(unsigned char lut[256], const int lowerBound, const int upperBound)
+{
+	if (upperBound <= lowerBound)
+	{
+		for (int v = 0; v < 256; v++)
+			lut[v] = (unsigned char)v;
+		return;
+	}
+
+	const float histScale = 255. / (upperBound - lowerBound);
+	for (int v = 0; v < 256; v++)
+	{
+		const int newVal = histScale * (v - lowerBound);
+		lut[v] = std::min<int>(255, std::max<int>(0, newVal));
+	}
+}
+
+void buildStretchLut(std::vector<unsigned short> & lut, const int maxVal, const int lowerBound,
+	const int upperBound)
+{
+	lut.resize(maxVal + 1);
+	if (upperBound <= lowerBound)
+	{
+		for (int v = 0; v <= maxVal; v++)
+			lut[v] = (unsigned short)v;
+		return;
+	}
+
+	const float histScale = (double)maxVal / (upperBound - lowerBound);
+	for (int v = 0; v <= maxVal; v++)
+	{
+		const int newVal = histScale * (v - lowerBound);
+		lut[v] = std::min<int>(maxVal, std::max<int>(0, newVal));
+	}
+}
+
+// pDst[i] = lut[pSrc[i]] for i < n
+typedef void (*LutRowFunc)(unsigned char * pDst, const unsigned char * pSrc, int n,
+	const unsigned char * lut);
+
+static void lutRow_Scalar(unsigned char * pDst, const unsigned char * pSrc, int n,
+	const unsigned char * lut)
+{
+	// a local copy of the table cannot alias pDst, so the loads need not wait
+	// for the stores
+	unsigned char table[256];
+	memcpy(table, lut, 256);
+
+	for (int x = 0; x < n; x++)
+		pDst[x] = table[pSrc[x]];
+}
+
+#if defined(IP_X86)
+IP_TARGET_AVX2
+static void lutRow_AVX2(unsigned char * pDst, const unsigned char * pSrc, int n,
+	const unsigned char * lut)
+{
+	// the table as 16 rows of 16 entries: the low nibble selects the entry
+	// with a byte shuffle, the high nibble the row
+	__m256i rows[16];
+	for (int k = 0; k < 16; k++)
+		rows[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(lut + 16 * k)));
+
+	const __m256i nibble = _mm256_set1_epi8(0x0F);
+	int x = 0;
+
+	for (; x + 32 <= n; x += 32)
+	{
+		const __m256i v = _mm256_loadu_si256((const __m256i *)(pSrc + x));
+		const __m256i lo = _mm256_and_si256(v, nibble);
+		const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+
+		__m256i result = _mm256_setzero_si256();
+		for (int k = 0; k < 16; k++)
+		{
+			const __m256i select = _mm256_cmpeq_epi8(hi, _mm256_set1_epi8((char)k));
+			result = _mm256_or_si256(result, _mm256_and_si256(select, _mm256_shuffle_epi8(rows[k], lo)));
+		}
+		_mm256_storeu_si256((__m256i *)(pDst + x), result);
+	}
+
+	lutRow_Scalar(pDst + x, pSrc + x, n - x, lut);
+}
+
+#if defined(IP_HAVE_AVX512)
+IP_TARGET_AVX512
+static void lutRow_AVX512(unsigned char * pDst, const unsigned char * pSrc, int n,
+	const unsigned char * lut)
+{
+	__m512i rows[16];
+	for (int k = 0; k < 16; k++)
+		rows[k] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(lut + 16 * k)));
+
+	const __m512i nibble = _mm512_set1_epi8(0x0F);
+	int x = 0;
+
+	for (; x + 64 <= n; x += 64)
+	{
+		const __m512i v = _mm512_loadu_si512((const void *)(pSrc + x));
+		const __m512i lo = _mm512_and_si512(v, nibble);
+		const __m512i hi = _mm512_and_si512(_mm512_srli_epi16(v, 4), nibble);
+
+		__m512i result = _mm512_setzero_si512();
+		for (int k = 0; k < 16; k++)
+		{
+			const __mmask64 select = _mm512_cmpeq_epi8_mask(hi, _mm512_set1_epi8((char)k));
+			result = _mm512_mask_shuffle_epi8(result, select, rows[k], lo);
+		}
+		_mm512_storeu_si512((void *)(pDst + x), result);
+	}
+
+	lutRow_AVX2(pDst + x, pSrc + x, n - x, lut);
+}
+#endif
+#endif
+
+static LutRowFunc selectLutRow()
+/*returns the fastest row kernel the CPU supports, byte shuffles need AVX2*/
+{
+#if defined(IP_X86)
+	switch (simdLevel())
+	{
+#if defined(IP_HAVE_AVX512)
+	case SIMD_AVX512:	return lutRow_AVX512;
+#endif
+	case SIMD_AVX2:		return lutRow_AVX2;
+	default:			break;
+	}
+#endif
+	return lutRow_Scalar;
+}
+
+void applyLutRow(unsigned char * pDst, const unsigned char * pSrc, const int n, const unsigned char lut[256])
+{
+	selectLutRow()(pDst, pSrc, n, lut);
+}
+
+void applyLut(const ImageViewT<unsigned char> & img, const unsigned char lut[256], ThreadPool * pPool)
+{
+	const LutRowFunc lutRow = selectLutRow();
+
+	parallelFor(pPool, 0, img.rows(), [&](int y0, int y1)
+	{
+		if (img.stride() == img.cols())
+			lutRow(img.rowPtr(y0), img.rowPtr(y0), (y1 - y0) * img.cols(), lut);
+		else
+		{
+			for (int y = y0; y < y1; y++)
+				lutRow(img.rowPtr(y), img.rowPtr(y), img.cols(), lut);
+		}
+	}, MIN_BAND_ROWS);
+}
+
+void applyLut(const ImageViewT<unsigned short> & img, const unsigned short * lut, ThreadPool * pPool)
+{
+	parallelFor(pPool, 0, img.rows(), [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; y++)
+		{
+			unsigned short * p = img.rowPtr(y);
+			for (int x = 0; x < img.cols(); x++)
+				p[x] = lut[p[x]];
+		}
+	}, MIN_BAND_ROWS);
+}
+
+void stretchPercentile(const ImageViewT<unsigned char> & img, const float cutOffPercentage,
+	ThreadPool * pPool)
+{
+	unsigned int histogram[256];
+	computeHistogram(img, histogram, pPool);
+
+	int lowerBound, upperBound;
+	percentileBounds(histogram, 256, cutOffPercentage, lowerBound, upperBound);
+
+	unsigned char lut[256];
+	buildStretchLut(lut, lowerBound, upperBound);
+	applyLut(img, lut, pPool);
+}
+
+void stretchPercentile(const ImageViewT<unsigned short> & img, const int maxVal,
+	const float cutOffPercentage, ThreadPool * pPool)
+{
+	const int maxSample = std::min(65535, std::max(1, maxVal));
+
+	std::vector<unsigned int> histogram;
+	computeHistogram(img, maxSample, histogram, pPool);
+
+	int lowerBound, upperBound;
+	percentileBounds(&histogram[0], (int)histogram.size(), cutOffPercentage, lowerBound, upperBound);
+
+	// samples above maxVal were counted as maxVal and are mapped like it
+	std::vector<unsigned short> lut;
+	buildStretchLut(lut, maxSample, lowerBound, upperBound);
+	lut.resize(65536, lut[maxSample]);
+	applyLut(img, &lut[0], pPool);
+}
@@ -0,0 +1,78 @@
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 Histogram.h
+///
+/// Gray-value histograms of 8 and 16 bit images and the percentile stretch.
+/// Every band of rows counts into private sub-histograms that are merged at the
+/// end, so the threads never share a counter. The stretch is applied through a
+/// lookup table, one entry per gray-value.
+///
+//=================================================================================
+//=================================================================================
+
+#include <vector>
+#include "ImageProcess.h"
+
+class ThreadPool;
+
+/*
+8 bit histogram in HISTOGRAM_LANES interleaved sub-histograms: consecutive
+pixels increment different tables, so runs of equal gray-values do not stall
+on the same counter.
+*/
+class LaneHistogram
+{
+public:
+	enum { HISTOGRAM_LANES = 4 };
+
+	LaneHistogram() { clear(); }
+
+	void clear();
+	void add(const unsigned char * pPixels, size_t count);
+	// adds the counts of all lanes to histogram
+	void mergeInto(unsigned int histogram[256]) const;
+
+private:
+	unsigned int m_lanes[HISTOGRAM_LANES][256];
+};
+
+// histogram of an 8 bit image, 256 entries
+void computeHistogram(const ImageViewT<const unsigned char> & img, unsigned int histogram[256],
+	ThreadPool * pPool = NULL);
+
+// histogram of a 16 bit image with samples 0..maxVal, histogram gets maxVal + 1
+// entries. Samples above maxVal are counted in the last entry
+void computeHistogram(const ImageViewT<const unsigned short> & img, const int maxVal,
+	std::vector<unsigned int> & histogram, ThreadPool * pPool = NULL);
+
+// bounds of the percentile stretch over numBins gray-values: lowerBound is the
+// last gray-value with at most cutOffPercentage of the pixels at or below it
+// (0 if there is none), upperBound the first one with at least
+// 1 - cutOffPercentage of the pixels at or below it (numBins - 1 if there is none)
+void percentileBounds(const unsigned int * histogram, const int numBins, const float cutOffPercentage,
+	int & lowerBound, int & upperBound);
+
+// table of the linear stretch that maps lowerBound to 0 and upperBound to 255
+// (maxVal), clamped. Identity if upperBound <= lowerBound
+void buildStretchLut(unsigned char lut[256], const int lowerBound, const int upperBound);
+void buildStretchLut(std::vector<unsigned short> & lut, const int maxVal, const int lowerBound,
+	const int upperBound);
+
+// pDst[i] = lut[pSrc[i]] for one row of n pixels, pDst may be pSrc
+void applyLutRow(unsigned char * pDst, const unsigned char * pSrc, const int n, const unsigned char lut[256]);
+
+// img = lut[img], in place. The 16 bit table needs an entry for every sample
+void applyLut(const ImageViewT<unsigned char> & img, const unsigned char lut[256], ThreadPool * pPool = NULL);
+void applyLut(const ImageViewT<unsigned short> & img, const unsigned short * lut, ThreadPool * pPool = NULL);
+
+// cuts cutOffPercentage of the darkest and brightest pixels and stretches the
+// remaining gray-values linearly to 0..255 (0..maxVal), in place
+void stretchPercentile(const ImageViewT<unsigned char> & img, const float cutOffPercentage,
+	ThreadPool * pPool = NULL);
+void stretchPercentile(const ImageViewT<unsigned short> & img, const int maxVal,
+	const float cutOffPercentage, ThreadPool * pPool = NULL);
+
+#endif
@@ -0,0 +1,721 @@
+#ifndef __IMAGE_EXPR_H__
+#define __IMAGE_EXPR_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 ImageExpr.h
+///
+/// Lazily evaluated element-wise image arithmetic. Operators and the functions
+/// below only record what to compute; assigning the expression to an ImageT or
+/// passing it to evaluate() runs one loop over the output pixels, so a chain
+/// like (a + b) - c needs no temporary images and one output allocation.
+/// Expressions of 8 bit images are evaluated in 8 or 16 bit SSE2 lanes.
+///
+//=================================================================================
+//=================================================================================
+
+#include <string.h>
+#include <type_traits>
+#include "ImageProcess.h"
+#include "ThreadPool.h"
+#include "CpuFeatures.h"
+
+#if defined(IP_X86)
+#include <emmintrin.h>
+#endif
+
+/*
+Every expression node derives from ImageExpr<Node> and provides
+	PixelType			pixel type of the image the expression evaluates to
+	Value				type the node computes in (PixelTraits<>::AccumType of
+						its operands, float once a float factor is involved)
+	inRange()			true if every value fits PixelType without saturation
+	rows(), cols()		size of the result
+	grayLevels()		gray levels of the result
+	Row row(y)			reader for row y with Value operator[](int x)
+The readers are small value types that inline into the evaluation loop.
+*/
+struct ImageExprBase {};
+
+template <typename Derived>
+struct ImageExpr : ImageExprBase
+{
+	const Derived & derived() const { return static_cast<const Derived &>(*this); }
+};
+
+// reads the pixels of an image or view
+template <typename T>
+class ImageLeafExpr : public ImageExpr<ImageLeafExpr<T> >
+{
+public:
+	typedef T PixelType;
+	typedef typename PixelTraits<T>::AccumType Value;
+
+	struct Row
+	{
+		const T * p;
+		Value operator[](int x) const { return p[x]; }
+	};
+
+	ImageLeafExpr(const ImageViewT<const T> & view, int grayLevels) : m_view(view), m_grayLevels(grayLevels) {}
+
+	int rows() const { return m_view.rows(); }
+	int cols() const { return m_view.cols(); }
+	int grayLevels() const { return m_grayLevels; }
+	bool inRange() const { return true; }
+	Row row(int y) const { Row r = { m_view.rowPtr(y) }; return r; }
+
+private:
+	ImageViewT<const T> m_view;
+	int m_grayLevels;
+};
+
+/*
+What may appear as an operand: expression nodes, ImageT and ImageViewT.
+ExprOperand<X>::make() turns the operand into its node; for anything else
+IS_OPERAND is 0, which removes the operators below from overload resolution.
+*/
+template <typename X, typename Enable = void>
+struct ExprOperand
+{
+	enum { IS_OPERAND = 0 };
+};
+
+template <typename X>
+struct ExprOperand<X, typename std::enable_if<std::is_base_of<ImageExprBase, X>::value>::type>
+{
+	enum { IS_OPERAND = 1 };
+	typedef X Type;
+	static const X & make(const X & x) { return x; }
+};
+
+template <typename T>
+struct ExprOperand<ImageT<T>, void>
+{
+	enum { IS_OPERAND = 1 };
+	typedef ImageLeafExpr<T> Type;
+	static Type make(const ImageT<T> & img) { return Type(img.view(), img.grayLevels()); }
+};
+
+// views carry no gray levels, the full 8 bit range is assumed
+template <typename T>
+struct ExprOperand<ImageViewT<T>, void>
+{
+	enum { IS_OPERAND = 1 };
+	typedef ImageLeafExpr<typename std::remove_const<T>::type> Type;
+	static Type make(const ImageViewT<T> & view) { return Type(view, 255); }
+};
+
+/*
+Node with two operands, the result covers the pixels both operands have.
+Op::apply(a, b) computes one pixel, Op::KEEPS_RANGE is 1 if the result of two
+non-negative pixel values never exceeds the larger one.
+*/
+template <typename Op, typename A, typename B>
+class BinaryImageExpr : public ImageExpr<BinaryImageExpr<Op, A, B> >
+{
+public:
+	typedef typename A::PixelType PixelType;
+	typedef typename std::common_type<typename A::Value, typename B::Value>::type Value;
+
+	struct Row
+	{
+		typename A::Row a;
+		typename B::Row b;
+		Op op;
+		Value operator[](int x) const { return op.apply((Value)a[x], (Value)b[x]); }
+	};
+
+	BinaryImageExpr(const A & a, const B & b, const Op & op) : m_a(a), m_b(b), m_op(op) {}
+
+	int rows() const { return m_a.rows() < m_b.rows() ? m_a.rows() : m_b.rows(); }
+	int cols() const { return m_a.cols() < m_b.cols() ? m_a.cols() : m_b.cols(); }
+	int grayLevels() const { return m_a.grayLevels(); }
+	bool inRange() const { return Op::KEEPS_RANGE && m_a.inRange() && m_b.inRange(); }
+	Row row(int y) const { Row r = { m_a.row(y), m_b.row(y), m_op }; return r; }
+
+private:
+	A m_a;
+	B m_b;
+	Op m_op;
+};
+
+// node with one operand, Op::Value is the type Op::apply() returns.
+// Op::keepsRange(maxPixel) is true if the result of a value in 0..maxPixel
+// stays in 0..maxPixel
+template <typename Op, typename A>
+class UnaryImageExpr : public ImageExpr<UnaryImageExpr<Op, A> >
+{
+public:
+	typedef typename A::PixelType PixelType;
+	typedef typename std::common_type<typename A::Value, typename Op::Value>::type Value;
+
+	struct Row
+	{
+		typename A::Row a;
+		Op op;
+		Value operator[](int x) const { return op.apply((Value)a[x]); }
+	};
+
+	UnaryImageExpr(const A & a, const Op & op) : m_a(a), m_op(op) {}
+
+	int rows() const { return m_a.rows(); }
+	int cols() const { return m_a.cols(); }
+	int grayLevels() const { return m_a.grayLevels(); }
+	bool inRange() const { return m_a.inRange() && m_op.keepsRange((int)(PixelType)~0); }
+	Row row(int y) const { Row r = { m_a.row(y), m_op }; return r; }
+
+private:
+	A m_a;
+	Op m_op;
+};
+
+// pixel operations
+struct AverageOp
+{
+	enum { KEEPS_RANGE = 1 };
+	template <typename V> V apply(V a, V b) const { return (a + b) / 2; }
+};
+
+struct AddOp
+{
+	enum { KEEPS_RANGE = 0 };
+	template <typename V> V apply(V a, V b) const { return a + b; }
+};
+
+// |a - b|, differences below threshold become 0
+struct AbsDiffOp
+{
+	enum { KEEPS_RANGE = 1 };
+	int threshold;
+	template <typename V> V apply(V a, V b) const
+	{
+		V d = a - b;
+		d = (d < 0) ? -d : d;
+		return (d < (V)threshold) ? 0 : d;
+	}
+};
+
+struct NegateOp
+{
+	typedef int Value;
+	int maxVal;
+	template <typename V> V apply(V a) const { return (V)maxVal - a; }
+	// a smaller maxVal goes below 0 for pixels above it
+	bool keepsRange(int maxPixel) const { return maxVal == maxPixel; }
+};
+
+// a * factor + offset
+struct ScaleOp
+{
+	typedef float Value;
+	float factor;
+	float offset;
+	template <typename V> V apply(V a) const { return a * factor + offset; }
+	bool keepsRange(int) const { return false; }
+};
+
+struct ClampOp
+{
+	typedef int Value;
+	int lo;
+	int hi;
+	template <typename V> V apply(V a) const
+	{
+		const V v = (a < (V)lo) ? (V)lo : a;
+		return (v > (V)hi) ? (V)hi : v;
+	}
+	bool keepsRange(int maxPixel) const { return 0 <= lo && lo <= hi && hi <= maxPixel; }
+};
+
+// builds the node of a binary operation; empty unless A and B are both operands
+template <typename Op, typename A, typename B, typename Enable = void>
+struct BinaryExprOf {};
+
+template <typename Op, typename A, typename B>
+struct BinaryExprOf<Op, A, B, typename std::enable_if<ExprOperand<A>::IS_OPERAND && ExprOperand<B>::IS_OPERAND>::type>
+{
+	typedef BinaryImageExpr<Op, typename ExprOperand<A>::Type, typename ExprOperand<B>::Type> Type;
+	static Type make(const A & a, const B & b, const Op & op)
+	{
+		return Type(ExprOperand<A>::make(a), ExprOperand<B>::make(b), op);
+	}
+};
+
+template <typename Op, typename A, typename Enable = void>
+struct UnaryExprOf {};
+
+template <typename Op, typename A>
+struct UnaryExprOf<Op, A, typename std::enable_if<ExprOperand<A>::IS_OPERAND>::type>
+{
+	typedef UnaryImageExpr<Op, typename ExprOperand<A>::Type> Type;
+	static Type make(const A & a, const Op & op) { return Type(ExprOperand<A>::make(a), op); }
+};
+
+// (a + b) / 2, the average of two images
+template <typename A, typename B>
+typename BinaryExprOf<AverageOp, A, B>::Type operator+(const A & a, const B & b)
+{
+	return BinaryExprOf<AverageOp, A, B>::make(a, b, AverageOp());
+}
+
+// |a - b|, differences below 35 become 0 to hide sensor noise
+template <typename A, typename B>
+typename BinaryExprOf<AbsDiffOp, A, B>::Type operator-(const A & a, const B & b)
+{
+	const AbsDiffOp op = { 35 };
+	return BinaryExprOf<AbsDiffOp, A, B>::make(a, b, op);
+}
+
+template <typename A, typename B>
+typename BinaryExprOf<AverageOp, A, B>::Type average(const A & a, const B & b)
+{
+	return BinaryExprOf<AverageOp, A, B>::make(a, b, AverageOp());
+}
+
+// a + b, saturated when stored
+template <typename A, typename B>
+typename BinaryExprOf<AddOp, A, B>::Type addSaturate(const A & a, const B & b)
+{
+	return BinaryExprOf<AddOp, A, B>::make(a, b, AddOp());
+}
+
+template <typename A, typename B>
+typename BinaryExprOf<AbsDiffOp, A, B>::Type absDiff(const A & a, const B & b, int threshold = 0)
+{
+	const AbsDiffOp op = { threshold };
+	return BinaryExprOf<AbsDiffOp, A, B>::make(a, b, op);
+}
+
+// maxVal - a
+template <typename A>
+typename UnaryExprOf<NegateOp, A>::Type negated(const A & a, int maxVal = 255)
+{
+	const NegateOp op = { maxVal };
+	return UnaryExprOf<NegateOp, A>::make(a, op);
+}
+
+// a * factor + offset, rounded to the nearest integer when stored
+template <typename A>
+typename UnaryExprOf<ScaleOp, A>::Type scaled(const A & a, float factor, float offset = 0)
+{
+	const ScaleOp op = { factor, offset };
+	return UnaryExprOf<ScaleOp, A>::make(a, op);
+}
+
+template <typename A>
+typename UnaryExprOf<ClampOp, A>::Type clamped(const A & a, int lo, int hi)
+{
+	const ClampOp op = { lo, hi };
+	return UnaryExprOf<ClampOp, A>::make(a, op);
+}
+
+/*
+Converts a computed value to the pixel type: integer pixels saturate to their
+range and round float values to nearest, float pixels take the value as is.
+Expressions that stay in range skip the saturation, which keeps their loops
+free of min / max that SSE2 has no instructions for on 32 bit integers.
+*/
+template <typename T, bool inRange>
+struct ExprStore
+{
+	static T store(int v)
+	{
+		const int maxVal = (int)(T)~0;
+		return (T)(v < 0 ? 0 : (v > maxVal ? maxVal : v));
+	}
+	static T store(float v)
+	{
+		const float maxVal = (float)(T)~0;
+		return (T)(v < 0 ? 0 : (v > maxVal ? maxVal : v + 0.5f));
+	}
+};
+
+template <typename T>
+struct ExprStore<T, true>
+{
+	template <typename V> static T store(V v) { return (T)v; }
+};
+
+template <>
+struct ExprStore<float, false>
+{
+	static float store(float v) { return v; }
+};
+
+// evaluates a row with SIMD code if available(row) is true for the expression
+template <typename T, typename E, typename Enable = void>
+struct ExprRowKernel
+{
+	static bool available(const typename E::Row &) { return false; }
+	static void run(T *, const typename E::Row &, int) {}
+};
+
+#if defined(IP_X86)
+/*
+SSE2 rows for 8 bit images, 16 pixels per iteration. The compiler vectorizes
+the generic loop only in 32 bit lanes, and saturating stores not at all.
+ExprLanes<E>::BYTES expressions (averages and absolute differences of 8 bit
+images) never leave 0..255 and run in 8 bit lanes. WORDS expressions also
+take sums, negations and clamps and run in 16 bit lanes, if range() shows that
+no value they compute leaves the 16 bit range.
+*/
+inline bool fitsWordLane(long long lo, long long hi) { return lo >= -32768 && hi <= 32767; }
+
+// the operation on lanes, range() gives the result range from the operand
+// ranges and is false if a value the 16 bit code computes does not fit
+template <typename Op>
+struct ExprLaneOp
+{
+	enum { BYTES = 0, WORDS = 0 };
+};
+
+template <>
+struct ExprLaneOp<AverageOp>
+{
+	enum { BYTES = 1, WORDS = 1 };
+
+	// pavgb rounds up, (a + b) / 2 is lower by the low bit of a ^ b
+	IP_TARGET_SSE2
+	static __m128i bytes(const AverageOp &, __m128i a, __m128i b)
+	{
+		const __m128i lowBit = _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1));
+		return _mm_sub_epi8(_mm_avg_epu8(a, b), lowBit);
+	}
+	// adding the sign bit before the shift rounds toward 0 like the division
+	IP_TARGET_SSE2
+	static __m128i words(const AverageOp &, __m128i a, __m128i b)
+	{
+		const __m128i sum = _mm_add_epi16(a, b);
+		return _mm_srai_epi16(_mm_add_epi16(sum, _mm_srli_epi16(sum, 15)), 1);
+	}
+	static bool range(const AverageOp &, int aLo, int aHi, int bLo, int bHi, int & lo, int & hi)
+	{
+		lo = (aLo + bLo) / 2;
+		hi = (aHi + bHi) / 2;
+		return fitsWordLane(aLo + bLo, aHi + bHi);
+	}
+};
+
+template <>
+struct ExprLaneOp<AddOp>
+{
+	enum { BYTES = 0, WORDS = 1 };
+
+	IP_TARGET_SSE2
+	static __m128i words(const AddOp &, __m128i a, __m128i b) { return _mm_add_epi16(a, b); }
+	static bool range(const AddOp &, int aLo, int aHi, int bLo, int bHi, int & lo, int & hi)
+	{
+		lo = aLo + bLo;
+		hi = aHi + bHi;
+		return fitsWordLane(lo, hi);
+	}
+};
+
+template <>
+struct ExprLaneOp<AbsDiffOp>
+{
+	enum { BYTES = 1, WORDS = 1 };
+
+	// |a - b| as the OR of both saturated differences, d >= threshold as
+	// max(d, threshold) == d. A threshold above 255 clears every pixel
+	IP_TARGET_SSE2
+	static __m128i bytes(const AbsDiffOp & op, __m128i a, __m128i b)
+	{
+		const int threshold = op.threshold < 0 ? 0 : op.threshold;
+		const __m128i t = _mm_set1_epi8((char)(threshold > 255 ? 255 : threshold));
+		const __m128i enable = _mm_set1_epi8(threshold > 255 ? 0 : -1);
+		const __m128i d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+		const __m128i keep = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(d, t), d), enable);
+		return _mm_and_si128(d, keep);
+	}
+	// d >= threshold as d > threshold - 1, which fits 16 bits once clipped
+	IP_TARGET_SSE2
+	static __m128i words(const AbsDiffOp & op, __m128i a, __m128i b)
+	{
+		const long long below = (long long)op.threshold - 1;
+		const __m128i t = _mm_set1_epi16((short)(below < -1 ? -1 : (below > 32767 ? 32767 : below)));
+		const __m128i diff = _mm_sub_epi16(a, b);
+		const __m128i d = _mm_max_epi16(diff, _mm_sub_epi16(_mm_setzero_si128(), diff));
+		return _mm_and_si128(d, _mm_cmpgt_epi16(d, t));
+	}
+	static bool range(const AbsDiffOp &, int aLo, int aHi, int bLo, int bHi, int & lo, int & hi)
+	{
+		const int dLo = aLo - bHi;
+		const int dHi = aHi - bLo;
+		lo = 0;
+		hi = (-dLo > dHi) ? -dLo : dHi;
+		return fitsWordLane(-(long long)hi, hi);
+	}
+};
+
+template <>
+struct ExprLaneOp<NegateOp>
+{
+	enum { BYTES = 0, WORDS = 1 };
+
+	IP_TARGET_SSE2
+	static __m128i words(const NegateOp & op, __m128i a) { return _mm_sub_epi16(_mm_set1_epi16((short)op.maxVal), a); }
+	static bool range(const NegateOp & op, int aLo, int aHi, int & lo, int & hi)
+	{
+		if (!fitsWordLane(op.maxVal, op.maxVal) || !fitsWordLane((long long)op.maxVal - aHi, (long long)op.maxVal - aLo))
+			return false;
+		lo = op.maxVal - aHi;
+		hi = op.maxVal - aLo;
+		return true;
+	}
+};
+
+template <>
+struct ExprLaneOp<ClampOp>
+{
+	enum { BYTES = 0, WORDS = 1 };
+
+	// the operands fit 16 bits, so clipping the limits to 16 bits changes nothing
+	IP_TARGET_SSE2
+	static __m128i words(const ClampOp & op, __m128i a)
+	{
+		const __m128i lo = _mm_set1_epi16((short)(op.lo < -32768 ? -32768 : (op.lo > 32767 ? 32767 : op.lo)));
+		const __m128i hi = _mm_set1_epi16((short)(op.hi < -32768 ? -32768 : (op.hi > 32767 ? 32767 : op.hi)));
+		return _mm_min_epi16(_mm_max_epi16(a, lo), hi);
+	}
+	static bool range(const ClampOp & op, int aLo, int aHi, int & lo, int & hi)
+	{
+		lo = op.apply(aLo);
+		hi = op.apply(aHi);
+		return fitsWordLane(lo, hi);
+	}
+};
+
+// the expression on lanes: bytes() gives 16 pixels in 8 bit lanes, words() in
+// two registers of 16 bit lanes, range() as for ExprLaneOp
+template <typename E>
+struct ExprLanes
+{
+	enum { BYTES = 0, WORDS = 0 };
+};
+
+template <>
+struct ExprLanes<ImageLeafExpr<unsigned char> >
+{
+	enum { BYTES = 1, WORDS = 1 };
+	typedef ImageLeafExpr<unsigned char>::Row Row;
+
+	IP_TARGET_SSE2
+	static __m128i bytes(const Row & r, int x) { return _mm_loadu_si128((const __m128i *)(r.p + x)); }
+	IP_TARGET_SSE2
+	static void words(const Row & r, int x, __m128i & lo, __m128i & hi)
+	{
+		const __m128i v = bytes(r, x);
+		lo = _mm_unpacklo_epi8(v, _mm_setzero_si128());
+		hi = _mm_unpackhi_epi8(v, _mm_setzero_si128());
+	}
+	static bool range(const Row &, int & lo, int & hi)
+	{
+		lo = 0;
+		hi = 255;
+		return true;
+	}
+};
+
+template <typename Op, typename A, typename B>
+struct ExprLanes<BinaryImageExpr<Op, A, B> >
+{
+	enum
+	{
+		BYTES = ExprLaneOp<Op>::BYTES && ExprLanes<A>::BYTES && ExprLanes<B>::BYTES,
+		WORDS = ExprLaneOp<Op>::WORDS && ExprLanes<A>::WORDS && ExprLanes<B>::WORDS
+	};
+	typedef typename BinaryImageExpr<Op, A, B>::Row Row;
+
+	IP_TARGET_SSE2
+	static __m128i bytes(const Row & r, int x)
+	{
+		return ExprLaneOp<Op>::bytes(r.op, ExprLanes<A>::bytes(r.a, x), ExprLanes<B>::bytes(r.b, x));
+	}
+	IP_TARGET_SSE2
+	static void words(const Row & r, int x, __m128i & lo, __m128i & hi)
+	{
+		__m128i aLo, aHi, bLo, bHi;
+		ExprLanes<A>::words(r.a, x, aLo, aHi);
+		ExprLanes<B>::words(r.b, x, bLo, bHi);
+		lo = ExprLaneOp<Op>::words(r.op, aLo, bLo);
+		hi = ExprLaneOp<Op>::words(r.op, aHi, bHi);
+	}
+	static bool range(const Row & r, int & lo, int & hi)
+	{
+		int aLo, aHi, bLo, bHi;
+		return ExprLanes<A>::range(r.a, aLo, aHi) && ExprLanes<B>::range(r.b, bLo, bHi)
+			&& ExprLaneOp<Op>::range(r.op, aLo, aHi, bLo, bHi, lo, hi);
+	}
+};
+
+template <typename Op, typename A>
+struct ExprLanes<UnaryImageExpr<Op, A> >
+{
+	enum { BYTES = 0, WORDS = ExprLaneOp<Op>::WORDS && ExprLanes<A>::WORDS };
+	typedef typename UnaryImageExpr<Op, A>::Row Row;
+
+	IP_TARGET_SSE2
+	static void words(const Row & r, int x, __m128i & lo, __m128i & hi)
+	{
+		__m128i aLo, aHi;
+		ExprLanes<A>::words(r.a, x, aLo, aHi);
+		lo = ExprLaneOp<Op>::words(r.op, aLo);
+		hi = ExprLaneOp<Op>::words(r.op, aHi);
+	}
+	static bool range(const Row & r, int & lo, int & hi)
+	{
+		int aLo, aHi;
+		return ExprLanes<A>::range(r.a, aLo, aHi) && ExprLaneOp<Op>::range(r.op, aLo, aHi, lo, hi);
+	}
+};
+
+// one row in 8 bit (bytes) or 16 bit lanes. The row is copied first: pDst may
+// alias the parameters of the operations, which would otherwise be reloaded
+// after every store
+template <typename E, bool bytes>
+struct ExprLaneRow
+{
+	IP_TARGET_SSE2
+	static void run(unsigned char * pDst, const typename E::Row & row, int cols)
+	{
+		const typename E::Row src = row;
+		int x = 0;
+		for (; x + 16 <= cols; x += 16)
+			_mm_storeu_si128((__m128i *)(pDst + x), ExprLanes<E>::bytes(src, x));
+		for (; x < cols; x++)
+			pDst[x] = (unsigned char)src[x];
+	}
+};
+
+// packus saturates to 0..255 like ExprStore
+template <typename E>
+struct ExprLaneRow<E, false>
+{
+	IP_TARGET_SSE2
+	static void run(unsigned char * pDst, const typename E::Row & row, int cols)
+	{
+		const typename E::Row src = row;
+		int x = 0;
+		for (; x + 16 <= cols; x += 16)
+		{
+			__m128i lo, hi;
+			ExprLanes<E>::words(src, x, lo, hi);
+			_mm_storeu_si128((__m128i *)(pDst + x), _mm_packus_epi16(lo, hi));
+		}
+		for (; x < cols; x++)
+			pDst[x] = ExprStore<unsigned char, false>::store(src[x]);
+	}
+};
+
+template <typename E>
+struct ExprRowKernel<unsigned char, E, typename std::enable_if<ExprLanes<E>::WORDS != 0>::type>
+{
+	static bool available(const typename E::Row & src)
+	{
+		int lo, hi;
+		return simdLevel() >= SIMD_SSE2 && (ExprLanes<E>::BYTES || ExprLanes<E>::range(src, lo, hi));
+	}
+	static void run(unsigned char * pDst, const typename E::Row & src, int cols)
+	{
+		ExprLaneRow<E, ExprLanes<E>::BYTES != 0>::run(pDst, src, cols);
+	}
+};
+#endif
+
+// pixels evaluate() computes into a local block before they are copied out
+static const int EXPR_BLOCK = 256;
+
+// pBlock[i] = expr pixel x + i for i < n
+template <typename T, typename E, bool inRange>
+inline void evaluateBlock(T * pBlock, const typename E::Row & src, int x, int n)
+{
+	for (int i = 0; i < n; i++)
+		pBlock[i] = ExprStore<T, inRange>::store(src[x + i]);
+}
+
+/*
+one row through a block on the stack: the block cannot alias the operands (dst
+may be one of them), and full blocks have a constant length, so the loop
+vectorizes without run time overlap checks or a scalar remainder
+*/
+template <typename T, typename E, bool inRange>
+void evaluateRowBlocks(T * pDst, const typename E::Row & src, int cols)
+{
+	T block[EXPR_BLOCK];
+	int x = 0;
+	for (; x + EXPR_BLOCK <= cols; x += EXPR_BLOCK)
+	{
+		evaluateBlock<T, E, inRange>(block, src, x, EXPR_BLOCK);
+		memcpy(pDst + x, block, sizeof(block));
+	}
+	evaluateBlock<T, E, inRange>(block, src, x, cols - x);
+	memcpy(pDst + x, block, (cols - x) * sizeof(T));
+}
+
+// evaluates rows [begin, end) of expr into dst
+template <typename T, typename E>
+void evaluateRows(const ImageViewT<T> & dst, const E & expr, int begin, int end)
+{
+	if (begin >= end)
+		return;
+
+	const int cols = dst.cols();
+	const bool rowKernel = ExprRowKernel<T, E>::available(expr.row(begin));
+	const bool inRange = expr.inRange();
+	for (int y = begin; y < end; y++)
+	{
+		const typename E::Row src = expr.row(y);
+		T * pDst = dst.rowPtr(y);
+		if (rowKernel)
+			ExprRowKernel<T, E>::run(pDst, src, cols);
+		else if (inRange)
+			evaluateRowBlocks<T, E, true>(pDst, src, cols);
+		else
+			evaluateRowBlocks<T, E, false>(pDst, src, cols);
+	}
+}
+
+/*
+dst = expr in one pass over the pixels, in bands on pool. dst covers at most
+expr.rows() x expr.cols() pixels. dst may be one of the operands: every output
+pixel only reads the operand pixels at its own position.
+*/
+template <typename T, typename E>
+void evaluate(const ImageViewT<T> & dst, const ImageExpr<E> & expr, ThreadPool * pPool = NULL)
+{
+	const E & e = expr.derived();
+	const int rows = dst.rows() < e.rows() ? dst.rows() : e.rows();
+	const int cols = dst.cols() < e.cols() ? dst.cols() : e.cols();
+	const ImageViewT<T> out(dst.data(), rows, cols, dst.stride());
+
+	parallelFor(pPool, 0, rows, [&](int begin, int end) { evaluateRows(out, e, begin, end); }, MIN_BAND_ROWS);
+}
+
+template <typename T>
+template <typename E>
+ImageT<T>::ImageT(const ImageExpr<E> & expr)
+	: m_N(0), m_M(0), m_Q(0), m_stride(0), m_pixelVal(NULL), m_pArena(NULL)
+{
+	const E & e = expr.derived();
+	allocate(e.rows(), e.cols());
+	m_Q = e.grayLevels();
+	evaluateRows(view(), e, 0, m_N);
+}
+
+template <typename T>
+template <typename E>
+ImageT<T> & ImageT<T>::operator=(const ImageExpr<E> & expr)
+{
+	const E & e = expr.derived();
+	if (e.rows() != m_N || e.cols() != m_M)
+		return *this = ImageT(expr);
+
+	// in place: the expression may read this image
+	m_Q = e.grayLevels();
+	evaluateRows(view(), e, 0, m_N);
+	return *this;
+}
+
+#endif
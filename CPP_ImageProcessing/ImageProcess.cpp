@@ -7,92 +7,185 @@ Image Processing in C++ Using MS Visual Studio 2013
 */
 
 #include <stdlib.h>
+#include <string.h>
 #include <iostream>
 #include "ImageProcess.h"
+#include "AlignedMemory.h"
+#include "FrameArena.h"
+#include "Profiler.h"
+#include "Warp.h"
 #include <cmath>
+#include <utility>
 using namespace std;
 
-Image::Image()
+template <typename T>
+ImageT<T>::ImageT()
 /* Creates an Image 0x0 */
 {
 	m_N = 0;
 	m_M = 0;
 	m_Q = 0;
+	m_stride = 0;
 
 	m_pixelVal = NULL;
+	m_pArena = NULL;
 }
 
-Image::Image(int numRows, int numCols, int grayLevels)
-/* Creates an Image of numRows x numCols and creates the arrays for it*/
+template <typename T>
+ImageT<T>::ImageT(int numRows, int numCols, int grayLevels, FrameArena * pArena)
+/* Creates an Image of numRows x numCols and creates the arrays for it, in
+pArena if given*/
 {
-
-	m_N = numRows;
-	m_M = numCols;
+	m_pixelVal = NULL;
+	m_pArena = pArena;
 	m_Q = grayLevels;
 
-	m_pixelVal = new int *[m_N];
-	for (int i = 0; i < m_N; i++)
-	{
-		m_pixelVal[i] = new int[m_M];
-		for (int j = 0; j < m_M; j++)
-			m_pixelVal[i][j] = 0;
-	}
+	allocate(numRows, numCols);
 }
 
-Image::~Image()
+template <typename T>
+ImageT<T>::~ImageT()
 /*destroy image*/
 {
-	m_N = 0;
-	m_M = 0;
-	m_Q = 0;
+	release();
+}
 
-	for (int i = 0; i < m_N; i++)
-		delete m_pixelVal[m_N];
+template <typename T>
+ImageT<T>::ImageT(const ImageT& oldImage)
+/*copies oldImage into new Image object*/
+{
+	m_pixelVal = NULL;
+	m_pArena = NULL;
+	m_Q = oldImage.m_Q;
 
-	delete m_pixelVal;
+	allocate(oldImage.m_N, oldImage.m_M);
+	if (m_pixelVal)
+		memcpy(m_pixelVal, oldImage.m_pixelVal, (size_t)m_N * m_stride * sizeof(T));
 }
 
-Image::Image(const Image& oldImage)
-/*copies oldImage into new Image object*/
+template <typename T>
+ImageT<T>::ImageT(ImageT&& oldImage)
+/*takes over the pixels of oldImage, oldImage is left 0x0*/
 {
 	m_N = oldImage.m_N;
 	m_M = oldImage.m_M;
 	m_Q = oldImage.m_Q;
+	m_stride = oldImage.m_stride;
+	m_pixelVal = oldImage.m_pixelVal;
+	m_pArena = oldImage.m_pArena;
+
+	oldImage.m_pixelVal = NULL;
+	oldImage.release();
+}
 
-	m_pixelVal = new int*[m_N];
+template <typename T>
+ImageT<T>::ImageT(const ImageViewT<const T>& view, int grayLevels)
+/*copies the pixels seen through view into a new Image object*/
+{
+	m_pixelVal = NULL;
+	m_pArena = NULL;
+	m_Q = grayLevels;
+
+	allocate(view.rows(), view.cols());
 	for (int i = 0; i < m_N; i++)
-	{
-		m_pixelVal[i] = new int[m_M];
-		for (int j = 0; j < m_M; j++)
-			m_pixelVal[i][j] = oldImage.m_pixelVal[i][j];
-	}
+		memcpy(rowPtr(i), view.rowPtr(i), m_M * sizeof(T));
 }
 
-void Image::operator=(const Image& oldImage)
+template <typename T>
+ImageT<T>& ImageT<T>::operator=(const ImageT& oldImage)
 /*copies oldImage into whatever you = it to*/
 {
+	if (this == &oldImage)
+		return *this;
+
+	if (m_N != oldImage.m_N || m_M != oldImage.m_M)
+		allocate(oldImage.m_N, oldImage.m_M);
+	m_Q = oldImage.m_Q;
+
+	if (m_pixelVal)
+		memcpy(m_pixelVal, oldImage.m_pixelVal, (size_t)m_N * m_stride * sizeof(T));
+
+	return *this;
+}
+
+template <typename T>
+ImageT<T>& ImageT<T>::operator=(ImageT&& oldImage)
+/*frees the own pixels and takes over the pixels of oldImage*/
+{
+	if (this == &oldImage)
+		return *this;
+
+	release();
+
 	m_N = oldImage.m_N;
 	m_M = oldImage.m_M;
 	m_Q = oldImage.m_Q;
+	m_stride = oldImage.m_stride;
+	m_pixelVal = oldImage.m_pixelVal;
+	m_pArena = oldImage.m_pArena;
 
-	m_pixelVal = new int*[m_N];
-	for (int i = 0; i < m_N; i++)
-	{
-		m_pixelVal[i] = new int[m_M];
-		for (int j = 0; j < m_M; j++)
-			m_pixelVal[i][j] = oldImage.m_pixelVal[i][j];
-	}
+	oldImage.m_pixelVal = NULL;
+	oldImage.release();
+
+	return *this;
 }
 
-void Image::setImageInfo(int numRows, int numCols, int maxVal)
-/*sets the number of rows, columns and graylevels*/
+template <typename T>
+void ImageT<T>::allocate(int numRows, int numCols)
+/*(re)creates the pixel buffer as one aligned block (in m_pArena if set), every
+row padded to a multiple of IMAGE_ALIGNMENT bytes, all pixels set to 0*/
 {
+	release();
+
 	m_N = numRows;
 	m_M = numCols;
+	m_stride = (int)(alignedPitch(m_M * sizeof(T)) / sizeof(T));
+
+	const size_t bytes = (size_t)m_N * m_stride * sizeof(T);
+	if (bytes > 0)
+	{
+		m_pixelVal = m_pArena ? (T *)m_pArena->allocate(bytes) : (T *)alignedMalloc(bytes);
+		memset(m_pixelVal, 0, bytes);
+	}
+}
+
+template <typename T>
+void ImageT<T>::release()
+/*frees the pixel buffer, arena pixels go with the arena's reset()*/
+{
+	if (m_pixelVal && !m_pArena)
+		alignedFree(m_pixelVal);
+
+	m_pixelVal = NULL;
+	m_N = 0;
+	m_M = 0;
+	m_stride = 0;
+}
+
+template <typename T>
+void ImageT<T>::replaceWith(ImageT& oldImage, ImageT& tempImage)
+/*stores the result of an operation in oldImage. Pixels from another arena are
+copied, so oldImage never points into an arena it was not created with; a heap
+oldImage reallocates then if the size changes*/
+{
+	if (tempImage.m_pArena && tempImage.m_pArena != oldImage.m_pArena)
+		oldImage = tempImage;
+	else
+		oldImage = std::move(tempImage);
+}
+
+template <typename T>
+void ImageT<T>::setImageInfo(int numRows, int numCols, int maxVal)
+/*sets the number of rows, columns and graylevels, reallocates the pixels if
+the size changes*/
+{
+	if (numRows != m_N || numCols != m_M)
+		allocate(numRows, numCols);
 	m_Q = maxVal;
 }
 
-void Image::getImageInfo(int &numRows, int &numCols, int &maxVal)
+template <typename T>
+void ImageT<T>::getImageInfo(int &numRows, int &numCols, int &maxVal)
 /*returns the number of rows, columns and gray levels*/
 {
 	numRows = m_N;
@@ -100,20 +193,23 @@ void Image::getImageInfo(int &numRows, int &numCols, int &maxVal)
 	maxVal = m_Q;
 }
 
-int Image::getPixelVal(int row, int col)
+template <typename T>
+T ImageT<T>::getPixelVal(int row, int col)
 /*returns the gray value of a specific pixel*/
 {
-	return m_pixelVal[row][col];
+	return rowPtr(row)[col];
 }
 
 
-void Image::setPixelVal(int row, int col, int value)
+template <typename T>
+void ImageT<T>::setPixelVal(int row, int col, T value)
 /*sets the gray value of a specific pixel*/
 {
-	m_pixelVal[row][col] = value;
+	rowPtr(row)[col] = value;
 }
 
-bool Image::inBounds(int row, int col)
+template <typename T>
+bool ImageT<T>::inBounds(int row, int col)
 /*checks to see if a pixel is within the image, returns true or false*/
 {
 	if (row >= m_N || row < 0 || col >= m_M || col < 0)
@@ -122,239 +218,196 @@ bool Image::inBounds(int row, int col)
 	return true;
 }
 
-void Image::getSubImage(int upperLeftRow, int upperLeftCol, int lowerRightRow,
-	int lowerRightCol, Image& oldImage)
+template <typename T>
+void ImageT<T>::getSubImage(int upperLeftRow, int upperLeftCol, int lowerRightRow,
+	int lowerRightCol, ImageT& oldImage, FrameArena * pArena)
 	/*Pulls a sub image out of oldImage based on users values, and then stores it
 	in oldImage*/
 {
-	int width, height;
-
-	width = lowerRightCol - upperLeftCol;
-	height = lowerRightRow - upperLeftRow;
-
-	Image tempImage(height, width, m_Q);
+	IP_PROFILE_SCOPE_IO("Image getSubImage", (long long)(lowerRightRow - upperLeftRow) * (lowerRightCol - upperLeftCol),
+		(long long)(lowerRightRow - upperLeftRow) * (lowerRightCol - upperLeftCol) * sizeof(T),
+		(long long)(lowerRightRow - upperLeftRow) * (lowerRightCol - upperLeftCol) * sizeof(T));
+	const ImageViewT<T> sub = oldImage.view().subView(upperLeftRow, upperLeftCol,
+		lowerRightRow, lowerRightCol);
+	ImageT tempImage(sub.rows(), sub.cols(), m_Q, pArena);
+	for (int i = 0; i < sub.rows(); i++)
+		memcpy(tempImage.rowPtr(i), sub.rowPtr(i), sub.cols() * sizeof(T));
+
+	replaceWith(oldImage, tempImage);
+}
 
-	for (int i = upperLeftRow; i < lowerRightRow; i++)
-	{
-		for (int j = upperLeftCol; j < lowerRightCol; j++)
-			tempImage.m_pixelVal[i - upperLeftRow][j - upperLeftCol] = oldImage.m_pixelVal[i][j];
-	}
+template <typename T>
+ImageViewT<T> ImageT<T>::getSubImage(int upperLeftRow, int upperLeftCol, int lowerRightRow,
+	int lowerRightCol)
+	/*returns a view on the sub image, no pixels are copied*/
+{
+	return view().subView(upperLeftRow, upperLeftCol, lowerRightRow, lowerRightCol);
+}
 
-	oldImage = tempImage;
+template <typename T>
+ImageViewT<const T> ImageT<T>::getSubImage(int upperLeftRow, int upperLeftCol, int lowerRightRow,
+	int lowerRightCol) const
+	/*returns a read-only view on the sub image, no pixels are copied*/
+{
+	return view().subView(upperLeftRow, upperLeftCol, lowerRightRow, lowerRightCol);
 }
 
-int Image::meanGray()
+template <typename T>
+int ImageT<T>::meanGray()
 /*returns the mean gray levels of the Image*/
 {
-	int totalGray = 0;
+	IP_PROFILE_SCOPE_IO("Image meanGray", (long long)m_N * m_M, (long long)m_N * m_M * sizeof(T), 0);
+	typename PixelTraits<T>::SumType totalGray = 0;
 
 	for (int i = 0; i < m_N; i++)
 	{
+		const T * pRow = rowPtr(i);
 		for (int j = 0; j < m_M; j++)
-			totalGray += m_pixelVal[i][j];
+			totalGray += pRow[j];
 	}
 
-	int cells = m_M * m_N;
+	const long long cells = (long long)m_M * m_N;
+	if (cells == 0)
+		return 0;
 
-	return (totalGray / cells);
+	return (int)(totalGray / cells);
 }
 
-void Image::enlargeImage(int value, Image& oldImage)
+template <typename T>
+void ImageT<T>::enlargeImage(int value, ImageT& oldImage, FrameArena * pArena)
 /*enlarges Image and stores it in tempImage, resizes oldImage and stores the
 larger image in oldImage*/
 {
+	IP_PROFILE_SCOPE_IO("Image enlargeImage", (long long)oldImage.m_N * oldImage.m_M * value * value,
+		(long long)oldImage.m_N * oldImage.m_M * sizeof(T), (long long)oldImage.m_N * oldImage.m_M * value * value * sizeof(T));
 	int rows, cols, gray;
-	int pixel;
-	int enlargeRow, enlargeCol;
 
 	rows = oldImage.m_N * value;
 	cols = oldImage.m_M * value;
 	gray = oldImage.m_Q;
 
-	Image tempImage(rows, cols, gray);
+	ImageT tempImage(rows, cols, gray, pArena);
 
 	for (int i = 0; i < oldImage.m_N; i++)
 	{
+		// build the first enlarged row, then replicate it value-1 times
+		const T * pSrc = oldImage.rowPtr(i);
+		T * pDst = tempImage.rowPtr(i * value);
 		for (int j = 0; j < oldImage.m_M; j++)
 		{
-			pixel = oldImage.m_pixelVal[i][j];
-			enlargeRow = i * value;
-			enlargeCol = j * value;
-			for (int c = enlargeRow; c < (enlargeRow + value); c++)
-			{
-				for (int d = enlargeCol; d < (enlargeCol + value); d++)
-				{
-					tempImage.m_pixelVal[c][d] = pixel;
-				}
-			}
+			const T pixel = pSrc[j];
+			for (int d = 0; d < value; d++)
+				pDst[j * value + d] = pixel;
 		}
+		for (int c = 1; c < value; c++)
+			memcpy(tempImage.rowPtr(i * value + c), pDst, cols * sizeof(T));
 	}
 
-	oldImage = tempImage;
+	replaceWith(oldImage, tempImage);
 }
 
-void Image::shrinkImage(int value, Image& oldImage)
+template <typename T>
+void ImageT<T>::shrinkImage(int value, ImageT& oldImage, FrameArena * pArena)
 /*Shrinks image as storing it in tempImage, resizes oldImage, and stores it in
 oldImage*/
 {
+	IP_PROFILE_SCOPE_IO("Image shrinkImage", (long long)(oldImage.m_N / value) * (oldImage.m_M / value),
+		(long long)(oldImage.m_N / value) * (oldImage.m_M / value) * sizeof(T),
+		(long long)(oldImage.m_N / value) * (oldImage.m_M / value) * sizeof(T));
 	int rows, cols, gray;
 
 	rows = oldImage.m_N / value;
 	cols = oldImage.m_M / value;
 	gray = oldImage.m_Q;
 
-	Image tempImage(rows, cols, gray);
+	ImageT tempImage(rows, cols, gray, pArena);
 
 	for (int i = 0; i < rows; i++)
 	{
+		const T * pSrc = oldImage.rowPtr(i * value);
+		T * pDst = tempImage.rowPtr(i);
 		for (int j = 0; j < cols; j++)
-			tempImage.m_pixelVal[i][j] = oldImage.m_pixelVal[i * value][j * value];
+			pDst[j] = pSrc[j * value];
 	}
-	oldImage = tempImage;
+	replaceWith(oldImage, tempImage);
 }
 
-void Image::reflectImage(bool flag, Image& oldImage)
+template <typename T>
+void ImageT<T>::reflectImage(bool flag, ImageT& oldImage, FrameArena * pArena)
 /*Reflects the Image based on users input*/
 {
+	IP_PROFILE_SCOPE_IO("Image reflectImage", (long long)oldImage.m_N * oldImage.m_M,
+		(long long)oldImage.m_N * oldImage.m_M * sizeof(T), (long long)oldImage.m_N * oldImage.m_M * sizeof(T));
 	int rows = oldImage.m_N;
 	int cols = oldImage.m_M;
-	Image tempImage(oldImage);
+	ImageT tempImage(rows, cols, oldImage.m_Q, pArena);
 	if (flag == true) //horizontal reflection
 	{
 		for (int i = 0; i < rows; i++)
-		{
-			for (int j = 0; j < cols; j++)
-				tempImage.m_pixelVal[rows - (i + 1)][j] = oldImage.m_pixelVal[i][j];
-		}
+			memcpy(tempImage.rowPtr(rows - (i + 1)), oldImage.rowPtr(i), cols * sizeof(T));
 	}
 	else //vertical reflection
 	{
 		for (int i = 0; i < rows; i++)
 		{
+			const T * pSrc = oldImage.rowPtr(i);
+			T * pDst = tempImage.rowPtr(i);
 			for (int j = 0; j < cols; j++)
-				tempImage.m_pixelVal[i][cols - (j + 1)] = oldImage.m_pixelVal[i][j];
+				pDst[cols - (j + 1)] = pSrc[j];
 		}
 	}
 
-	oldImage = tempImage;
+	replaceWith(oldImage, tempImage);
 }
 
-void Image::translateImage(int value, Image& oldImage)
-/*translates image down and right based on user value*/
+template <typename T>
+void ImageT<T>::translateImage(int value, ImageT& oldImage, FrameArena * pArena)
+/*translates image down and right based on user value. Pixels shifted in are 0,
+a shift of at least the image size leaves an all 0 image. Negative values are
+ignored*/
 {
+	if (value < 0)
+		return;
+
+	IP_PROFILE_SCOPE_IO("Image translateImage", (long long)oldImage.m_N * oldImage.m_M,
+		(long long)oldImage.m_N * oldImage.m_M * sizeof(T), (long long)oldImage.m_N * oldImage.m_M * sizeof(T));
 	int rows = oldImage.m_N;
 	int cols = oldImage.m_M;
-	int gray = oldImage.m_Q;
-	Image tempImage(m_N, m_M, m_Q);
+	ImageT tempImage(rows, cols, oldImage.m_Q, pArena);
 
-	for (int i = 0; i < (rows - value); i++)
+	if (value < rows && value < cols)
 	{
-		for (int j = 0; j < (cols - value); j++)
-			tempImage.m_pixelVal[i + value][j + value] = oldImage.m_pixelVal[i][j];
+		for (int i = 0; i < (rows - value); i++)
+			memcpy(tempImage.rowPtr(i + value) + value, oldImage.rowPtr(i), (cols - value) * sizeof(T));
 	}
 
-	oldImage = tempImage;
+	replaceWith(oldImage, tempImage);
 }
 
-void Image::rotateImage(int theta, Image& oldImage)
-/*based on users input and rotates it around the center of the image.*/
+template <typename T>
+void ImageT<T>::rotateImage(int theta, ImageT& oldImage, InterpolationMode mode,
+	ThreadPool * pPool, FrameArena * pArena)
+/*based on users input and rotates it around the center of the image. Every
+pixel of the result is sampled from the source (inverse mapping), so the
+rotated image has no holes*/
 {
-	int r0, c0;
-	int r1, c1;
-	int rows, cols;
-	rows = oldImage.m_N;
-	cols = oldImage.m_M;
-	Image tempImage(rows, cols, oldImage.m_Q);
-
-	float rads = (theta * 3.14159265) / 180.0;
-
-	r0 = rows / 2;
-	c0 = cols / 2;
-
-	for (int r = 0; r < rows; r++)
-	{
-		for (int c = 0; c < cols; c++)
-		{
-			r1 = (int)(r0 + ((r - r0) * cos(rads)) - ((c - c0) * sin(rads)));
-			c1 = (int)(c0 + ((r - r0) * sin(rads)) + ((c - c0) * cos(rads)));
-
-			if (inBounds(r1, c1))
-			{
-				tempImage.m_pixelVal[r1][c1] = oldImage.m_pixelVal[r][c];
-			}
-		}
-	}
-
-	for (int i = 0; i < rows; i++)
-	{
-		for (int j = 0; j < cols; j++)
-		{
-			if (tempImage.m_pixelVal[i][j] == 0)
-				tempImage.m_pixelVal[i][j] = tempImage.m_pixelVal[i][j + 1];
-		}
-	}
-	oldImage = tempImage;
+	IP_PROFILE_SCOPE_IO("Image rotateImage", (long long)oldImage.m_N * oldImage.m_M,
+		(long long)oldImage.m_N * oldImage.m_M * sizeof(T), (long long)oldImage.m_N * oldImage.m_M * sizeof(T));
+	ImageT tempImage(oldImage.m_N, oldImage.m_M, oldImage.m_Q, pArena);
+	::rotateImage(tempImage.view(), static_cast<const ImageT&>(oldImage).view(), theta, mode, pPool);
+	replaceWith(oldImage, tempImage);
 }
 
-Image Image::operator+(const Image &oldImage)
-/*adds images together, half one image, half the other*/
-{
-	Image tempImage(oldImage);
-
-	int rows, cols;
-	rows = oldImage.m_N;
-	cols = oldImage.m_M;
-
-	for (int i = 0; i < rows; i++)
-	{
-		for (int j = 0; j < cols; j++)
-			tempImage.m_pixelVal[i][j] = (m_pixelVal[i][j] + oldImage.m_pixelVal[i][j]) / 2;
-	}
-
-	return tempImage;
-}
-
-Image Image::operator-(const Image& oldImage)
-/*subtracts images from each other*/
-{
-	Image tempImage(oldImage);
-
-	int rows, cols;
-	rows = oldImage.m_N;
-	cols = oldImage.m_M;
-	int tempGray = 0;
-
-	for (int i = 0; i < rows; i++)
-	{
-		for (int j = 0; j < cols; j++)
-		{
-
-			tempGray = abs(m_pixelVal[i][j] - oldImage.m_pixelVal[i][j]);
-			if (tempGray < 35)// accounts for sensor flux
-				tempGray = 0;
-			tempImage.m_pixelVal[i][j] = tempGray;
-		}
-
-	}
-
-	return tempImage;
-}
-
-void Image::negateImage(Image& oldImage)
+template <typename T>
+void ImageT<T>::negateImage(ImageT& oldImage)
 /*negates image*/
 {
-	int rows, cols, gray;
-	rows = m_N;
-	cols = m_M;
-	gray = m_Q;
-
-	Image tempImage(m_N, m_M, m_Q);
-
-	for (int i = 0; i < rows; i++)
-	{
-		for (int j = 0; j < cols; j++)
-			tempImage.m_pixelVal[i][j] = -(m_pixelVal[i][j]) + 255;
-	}
-
-	oldImage = tempImage;
+	IP_PROFILE_SCOPE_IO("Image negateImage", (long long)m_N * m_M, (long long)m_N * m_M * sizeof(T),
+		(long long)m_N * m_M * sizeof(T));
+	oldImage = negated(*this, m_Q);
 }
+
+// pixel types the library is built for
+template class ImageT<unsigned char>;
+template class ImageT<unsigned short>;
+template class ImageT<float>;
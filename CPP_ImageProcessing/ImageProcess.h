@@ -1,39 +1,154 @@
 #ifndef IMAGE_H
 #define IMAGE_H
 
-class Image
+#include <stddef.h>
+#include <type_traits>
+
+/*
+Accumulator type used when pixels are summed or combined, so that 8 and 16 bit
+images do their arithmetic in int and float images stay in float. SumType
+holds the sum over a whole image without overflowing.
+*/
+template <typename T> struct PixelTraits { typedef int AccumType; typedef long long SumType; };
+template <> struct PixelTraits<float> { typedef float AccumType; typedef double SumType; };
+
+// how resampling operations (Warp.h) compute a pixel between source pixels
+enum InterpolationMode
+{
+	INTERPOLATION_NEAREST = 0,
+	INTERPOLATION_BILINEAR,
+	INTERPOLATION_BICUBIC	// Catmull-Rom, 4x4 source pixels
+};
+
+/*
+Non-owning view onto rows x cols pixels of an image or raw buffer, rows are
+stride elements apart. Copying a view never copies pixels, the viewed buffer
+has to outlive the view.
+*/
+template <typename T>
+class ImageViewT
+{
+public:
+	ImageViewT() : m_data(NULL), m_rows(0), m_cols(0), m_stride(0) {}
+	ImageViewT(T * data, int numRows, int numCols, int stride)
+		: m_data(data), m_rows(numRows), m_cols(numCols), m_stride(stride) {}
+	// a view on T converts to a read-only view on const T (for a non-const T
+	// this is the copy constructor)
+	ImageViewT(const ImageViewT<typename std::remove_const<T>::type>& other)
+		: m_data(other.data()), m_rows(other.rows()), m_cols(other.cols()), m_stride(other.stride()) {}
+
+	int rows() const { return m_rows; }
+	int cols() const { return m_cols; }
+	int stride() const { return m_stride; }
+	bool empty() const { return m_data == NULL || m_rows <= 0 || m_cols <= 0; }
+	T * data() const { return m_data; }
+	T * rowPtr(int row) const { return m_data + (ptrdiff_t)row * m_stride; }
+	T & at(int row, int col) const { return rowPtr(row)[col]; }
+
+	// rectangle [upperLeftRow, lowerRightRow) x [upperLeftCol, lowerRightCol) in O(1)
+	ImageViewT subView(int upperLeftRow, int upperLeftCol, int lowerRightRow, int lowerRightCol) const
+	{
+		return ImageViewT(rowPtr(upperLeftRow) + upperLeftCol, lowerRightRow - upperLeftRow,
+			lowerRightCol - upperLeftCol, m_stride);
+	}
+private:
+	T * m_data;
+	int m_rows;
+	int m_cols;
+	int m_stride;
+};
+
+template <typename Derived> struct ImageExpr;
+class FrameArena;
+class ThreadPool;
+
+/*
+Image with pixel type T (unsigned char, unsigned short or float).
+The pixels live in one contiguous, 64 byte aligned buffer. Every row starts on
+a 64 byte boundary, rows are m_stride elements apart. An image created with a
+FrameArena takes its pixels from the arena and must not be used after the
+arena's reset(); copies of it are on the heap again.
+*/
+template <typename T>
+class ImageT
 {
 public:
-	Image();
-	Image(int numRows, int numCols, int grayLevels);
-	~Image();
-	Image(const Image& oldImage);
-	void operator=(const Image&);
+	typedef T PixelType;
+
+	ImageT();
+	ImageT(int numRows, int numCols, int grayLevels, FrameArena * pArena = NULL);
+	~ImageT();
+	ImageT(const ImageT& oldImage);
+	ImageT(ImageT&& oldImage);
+	explicit ImageT(const ImageViewT<const T>& view, int grayLevels);
+	ImageT& operator=(const ImageT&);
+	ImageT& operator=(ImageT&&);
+	// evaluates an element-wise expression (ImageExpr.h) in one pass
+	template <typename E> ImageT(const ImageExpr<E>& expr);
+	template <typename E> ImageT& operator=(const ImageExpr<E>& expr);
 	void setImageInfo(int numRows, int numCols, int maxVal);
 	void getImageInfo(int &numRows, int &numCols, int &maxVal);
-	int getPixelVal(int row, int col);
-	void setPixelVal(int row, int col, int value);
+	T getPixelVal(int row, int col);
+	void setPixelVal(int row, int col, T value);
 	bool inBounds(int row, int col);
+	// the operations below build the result in a temporary image, from pArena
+	// if given. The result is copied back unless oldImage is from pArena too, a
+	// heap oldImage keeps its buffer if the size does not change
 	void getSubImage(int upperLeftRow, int upperLeftCol,
-		int lowerRightRow, int lowerRightCol, Image& oldImage);
+		int lowerRightRow, int lowerRightCol, ImageT& oldImage, FrameArena * pArena = NULL);
+	ImageViewT<T> getSubImage(int upperLeftRow, int upperLeftCol,
+		int lowerRightRow, int lowerRightCol);
+	ImageViewT<const T> getSubImage(int upperLeftRow, int upperLeftCol,
+		int lowerRightRow, int lowerRightCol) const;
 	int meanGray();
-	void enlargeImage(int value, Image& oldImage);
-	void shrinkImage(int value, Image& oldImage);
-	void reflectImage(bool flag, Image& oldImage);
-	void translateImage(int value, Image& oldImage);
+	void enlargeImage(int value, ImageT& oldImage, FrameArena * pArena = NULL);
+	void shrinkImage(int value, ImageT& oldImage, FrameArena * pArena = NULL);
+	void reflectImage(bool flag, ImageT& oldImage, FrameArena * pArena = NULL);
+	void translateImage(int value, ImageT& oldImage, FrameArena * pArena = NULL);
 	/*
 	r' = r + t
 	c' = c + t
 	*/
-	void rotateImage(int theta, Image& oldImage);
-	Image operator+(const Image &oldImage);
-	Image operator-(const Image& oldImage);
-	void negateImage(Image& oldImage);
+	// rotates oldImage by theta degrees around its center (see rotateImage()
+	// in Warp.h), corners without source pixels become 0. Rows are sampled in
+	// bands on pPool (NULL: calling thread only)
+	void rotateImage(int theta, ImageT& oldImage, InterpolationMode mode = INTERPOLATION_BILINEAR,
+		ThreadPool * pPool = NULL, FrameArena * pArena = NULL);
+	// image + image and image - image are expressions, see ImageExpr.h
+	// oldImage = grayLevels() - pixel
+	void negateImage(ImageT& oldImage);
+
+	// raw access for kernels
+	int rows() const { return m_N; }
+	int cols() const { return m_M; }
+	int grayLevels() const { return m_Q; }
+	int stride() const { return m_stride; } // elements between two rows
+	T * data() { return m_pixelVal; }
+	const T * data() const { return m_pixelVal; }
+	T * rowPtr(int row) { return m_pixelVal + (size_t)row * m_stride; }
+	const T * rowPtr(int row) const { return m_pixelVal + (size_t)row * m_stride; }
+	ImageViewT<T> view() { return ImageViewT<T>(m_pixelVal, m_N, m_M, m_stride); }
+	ImageViewT<const T> view() const { return ImageViewT<const T>(m_pixelVal, m_N, m_M, m_stride); }
 private:
+	void allocate(int numRows, int numCols);
+	void release();
+	// moves a heap temporary or one of oldImage's arena into oldImage, copies
+	// one of another arena
+	static void replaceWith(ImageT& oldImage, ImageT& tempImage);
+
 	int m_N; // number of rows
 	int m_M; // number of columns
 	int m_Q; // number of gray levels
-	int **m_pixelVal;
+	int m_stride; // number of elements between two rows (row pitch / sizeof(T))
+	T *m_pixelVal;
+	FrameArena *m_pArena; // owner of m_pixelVal, NULL: the heap
 };
 
+typedef ImageT<unsigned char> Image;
+typedef ImageT<unsigned short> Image16u;
+typedef ImageT<float> Image32f;
+
+// the expression operators and the definitions of the template members above
+#include "ImageExpr.h"
+
 #endif
@@ -0,0 +1,220 @@
+/*
+
+Gaussian pyramid with a fused blur and decimation kernel
+
+*/
+
+#include <algorithm>
+#include "ImagePyramid.h"
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
+
+#if defined(IP_X86)
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+// pSum[i] = r0[i] + 4 * r1[i] + 6 * r2[i] + 4 * r3[i] + r4[i] for i < n (at most 16 * 255)
+typedef void (*BinomialColumnFunc)(unsigned short * pSum, const unsigned char * const pRows[5], int n);
+
+static void binomialColumn_Scalar(unsigned short * pSum, const unsigned char * const pRows[5], int n)
+{
+	const unsigned char * r0 = pRows[0];
+	const unsigned char * r1 = pRows[1];
+	const unsigned char * r2 = pRows[2];
+	const unsigned char * r3 = pRows[3];
+	const unsigned char * r4 = pRows[4];
+
+	for (int x = 0; x < n; x++)
+		pSum[x] = (unsigned short)(r0[x] + 4 * (r1[x] + r3[x]) + 6 * r2[x] + r4[x]);
+}
+
+#if defined(IP_X86)
+IP_TARGET_SSE2
+static void binomialColumn_SSE2(unsigned short * pSum, const unsigned char * const pRows[5], int n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i six = _mm_set1_epi16(6);
+	int x = 0;
+
+	for (; x + 16 <= n; x += 16)
+	{
+		const __m128i r0 = _mm_loadu_si128((const __m128i *)(pRows[0] + x));
+		const __m128i r1 = _mm_loadu_si128((const __m128i *)(pRows[1] + x));
+		const __m128i r2 = _mm_loadu_si128((const __m128i *)(pRows[2] + x));
+		const __m128i r3 = _mm_loadu_si128((const __m128i *)(pRows[3] + x));
+		const __m128i r4 = _mm_loadu_si128((const __m128i *)(pRows[4] + x));
+
+		__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(r0, zero), _mm_unpacklo_epi8(r4, zero));
+		__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(r0, zero), _mm_unpackhi_epi8(r4, zero));
+		lo = _mm_add_epi16(lo, _mm_slli_epi16(_mm_add_epi16(_mm_unpacklo_epi8(r1, zero), _mm_unpacklo_epi8(r3, zero)), 2));
+		hi = _mm_add_epi16(hi, _mm_slli_epi16(_mm_add_epi16(_mm_unpackhi_epi8(r1, zero), _mm_unpackhi_epi8(r3, zero)), 2));
+		lo = _mm_add_epi16(lo, _mm_mullo_epi16(_mm_unpacklo_epi8(r2, zero), six));
+		hi = _mm_add_epi16(hi, _mm_mullo_epi16(_mm_unpackhi_epi8(r2, zero), six));
+
+		_mm_storeu_si128((__m128i *)(pSum + x), lo);
+		_mm_storeu_si128((__m128i *)(pSum + x + 8), hi);
+	}
+
+	const unsigned char * const pTail[5] = { pRows[0] + x, pRows[1] + x, pRows[2] + x, pRows[3] + x, pRows[4] + x };
+	binomialColumn_Scalar(pSum + x, pTail, n - x);
+}
+
+IP_TARGET_AVX2
+static void binomialColumn_AVX2(unsigned short * pSum, const unsigned char * const pRows[5], int n)
+{
+	const __m256i six = _mm256_set1_epi16(6);
+	int x = 0;
+
+	// 16 pixels per iteration, widened directly to 16 bit lanes
+	for (; x + 16 <= n; x += 16)
+	{
+		const __m256i r0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(pRows[0] + x)));
+		const __m256i r1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(pRows[1] + x)));
+		const __m256i r2 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(pRows[2] + x)));
+		const __m256i r3 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(pRows[3] + x)));
+		const __m256i r4 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(pRows[4] + x)));
+
+		__m256i sum = _mm256_add_epi16(r0, r4);
+		sum = _mm256_add_epi16(sum, _mm256_slli_epi16(_mm256_add_epi16(r1, r3), 2));
+		sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(r2, six));
+		_mm256_storeu_si256((__m256i *)(pSum + x), sum);
+	}
+
+	const unsigned char * const pTail[5] = { pRows[0] + x, pRows[1] + x, pRows[2] + x, pRows[3] + x, pRows[4] + x };
+	binomialColumn_SSE2(pSum + x, pTail, n - x);
+}
+#endif
+
+static BinomialColumnFunc selectBinomialColumn()
+/*returns the fastest column kernel the CPU supports, AVX-512 gains nothing
+over AVX2 on the 16 bit sums*/
+{
+#if defined(IP_X86)
+	switch (simdLevel())
+	{
+	case SIMD_AVX512:
+	case SIMD_AVX2:		return binomialColumn_AVX2;
+	case SIMD_SSE2:		return binomialColumn_SSE2;
+	default:			break;
+	}
+#endif
+	return binomialColumn_Scalar;
+}
+
+static inline unsigned char binomialRow(const unsigned short * pSum, int c0, int c1, int c2, int c3, int c4)
+{
+	const unsigned int sum = pSum[c0] + 4 * (pSum[c1] + pSum[c3]) + 6 * pSum[c2] + pSum[c4];
+	return (unsigned char)((sum + 128) >> 8);
+}
+
+void downsampleHalf(const ImageViewT<unsigned char> & dst, const ImageViewT<const unsigned char> & src,
+	ThreadPool * pPool, FrameArena * pArena)
+/*per output row: the vertical sums of the five source rows around row 2y for
+all source columns, then the horizontal sums at the even columns only*/
+{
+	if (dst.empty() || src.empty())
+		return;
+
+	const BinomialColumnFunc binomialColumn = selectBinomialColumn();
+	const int srcRows = src.rows();
+	const int srcCols = src.cols();
+	const int dstCols = dst.cols();
+
+	// output columns whose five source columns are all inside the image
+	const int innerBegin = std::min(dstCols, 1);
+	const int innerEnd = std::max(innerBegin, std::min(dstCols, (srcCols - 1) / 2));
+
+	parallelFor(pPool, 0, dst.rows(), [&](int y0, int y1)
+	{
+		ScratchBuffer<unsigned short> colSum(pArena, srcCols);
+		unsigned short * pSum = colSum.get();
+
+		for (int y = y0; y < y1; y++)
+		{
+			const unsigned char * pRows[5];
+			for (int k = 0; k < 5; k++)
+				pRows[k] = src.rowPtr(std::min(srcRows - 1, std::max(0, 2 * y + k - 2)));
+			binomialColumn(pSum, pRows, srcCols);
+
+			unsigned char * pDst = dst.rowPtr(y);
+			for (int x = 0; x < innerBegin; x++)
+			{
+				const int c = 2 * x;
+				pDst[x] = binomialRow(pSum, std::max(0, c - 2), std::max(0, c - 1), std::min(srcCols - 1, c),
+					std::min(srcCols - 1, c + 1), std::min(srcCols - 1, c + 2));
+			}
+			for (int x = innerBegin; x < innerEnd; x++)
+			{
+				const int c = 2 * x;
+				pDst[x] = binomialRow(pSum, c - 2, c - 1, c, c + 1, c + 2);
+			}
+			for (int x = innerEnd; x < dstCols; x++)
+			{
+				const int c = 2 * x;
+				pDst[x] = binomialRow(pSum, std::max(0, c - 2), std::max(0, c - 1), std::min(srcCols - 1, c),
+					std::min(srcCols - 1, c + 1), std::min(srcCols - 1, c + 2));
+			}
+		}
+	}, MIN_BAND_ROWS);
+}
+
+ImagePyramid::ImagePyramid()
+	: m_pPool(NULL), m_numLevels(0)
+{
+}
+
+ImagePyramid::ImagePyramid(const ImageViewT<const unsigned char> & base, ThreadPool * pPool)
+	: m_pPool(NULL), m_numLevels(0)
+{
+	setBase(base, pPool);
+}
+
+void ImagePyramid::setBase(const ImageViewT<const unsigned char> & base, ThreadPool * pPool)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_base = base;
+	m_pPool = pPool;
+	m_levels.clear();
+
+	m_numLevels = 0;
+	if (base.empty())
+		return;
+
+	m_numLevels = 1;
+	for (int rows = base.rows(), cols = base.cols(); rows > 1 && cols > 1; m_numLevels++)
+	{
+		rows = (rows + 1) / 2;
+		cols = (cols + 1) / 2;
+	}
+}
+
+void ImagePyramid::invalidate()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_levels.clear();
+}
+
+int ImagePyramid::numCachedLevels() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_numLevels > 0 ? 1 + (int)m_levels.size() : 0;
+}
+
+ImageViewT<const unsigned char> ImagePyramid::level(int index)
+{
+	if (index <= 0 || index >= m_numLevels)
+		return index == 0 ? m_base : ImageViewT<const unsigned char>();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	while ((int)m_levels.size() < index)
+	{
+		const ImageViewT<const unsigned char> prev = m_levels.empty() ? m_base : m_levels.back()->view();
+		std::unique_ptr<Image> next(new Image((prev.rows() + 1) / 2, (prev.cols() + 1) / 2, 255));
+		downsampleHalf(next->view(), prev, m_pPool, &m_scratch);
+		m_scratch.reset();
+		m_levels.push_back(std::move(next));
+	}
+	return m_levels[index - 1]->view();
+}
@@ -0,0 +1,66 @@
+#ifndef __IMAGE_PYRAMID_H__
+#define __IMAGE_PYRAMID_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 ImagePyramid.h
+///
+/// Gaussian pyramid of an 8 bit gray image. Every level is the previous one
+/// low-passed with the 5x5 binomial kernel ([1 4 6 4 1]/16 in x and y) and
+/// decimated by 2, both in a single pass that only computes the kept pixels.
+/// Levels are built on first use and kept until the base image changes.
+///
+//=================================================================================
+//=================================================================================
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "ImageProcess.h"
+#include "FrameArena.h"
+
+class ThreadPool;
+
+// dst(y, x) = 5x5 binomial of src around (2y, 2x), borders replicated. dst may
+// have at most (src.rows() + 1) / 2 rows and (src.cols() + 1) / 2 columns. The
+// column sums of the bands come from pArena if given
+void downsampleHalf(const ImageViewT<unsigned char> & dst, const ImageViewT<const unsigned char> & src,
+	ThreadPool * pPool = NULL, FrameArena * pArena = NULL);
+
+/*
+Level 0 is the base image itself (not copied, it must outlive the pyramid),
+level k + 1 has (rows + 1) / 2 x (cols + 1) / 2 pixels of level k. The levels
+end with the first one of a single row or column. level() may be called from
+several threads at once; the views stay valid until setBase() or invalidate().
+*/
+class ImagePyramid
+{
+public:
+	ImagePyramid();
+	explicit ImagePyramid(const ImageViewT<const unsigned char> & base, ThreadPool * pPool = NULL);
+
+	// new base image, drops all cached levels. pPool (may be NULL) builds them
+	void setBase(const ImageViewT<const unsigned char> & base, ThreadPool * pPool = NULL);
+	// drops the cached levels after the pixels of the base image changed
+	void invalidate();
+
+	// number of levels including the base
+	int numLevels() const { return m_numLevels; }
+	// level 0 .. numLevels() - 1, built with all levels before it on first use
+	ImageViewT<const unsigned char> level(int index);
+	// number of levels built so far, including the base
+	int numCachedLevels() const;
+
+private:
+	ImagePyramid(const ImagePyramid &);
+	ImagePyramid & operator=(const ImagePyramid &);
+
+	ImageViewT<const unsigned char> m_base;
+	ThreadPool * m_pPool;
+	int m_numLevels;
+	std::vector<std::unique_ptr<Image> > m_levels;	// levels 1, 2, ...
+	FrameArena m_scratch;							// column sums while a level is built
+	mutable std::mutex m_mutex;
+};
+
+#endif
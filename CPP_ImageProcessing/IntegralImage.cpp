@@ -0,0 +1,206 @@
+/*
+
+Parallel summed-area tables
+
+*/
+
+#include <string.h>
+#include <algorithm>
+#include "IntegralImage.h"
+#include "ThreadPool.h"
+
+IntegralImage::IntegralImage()
+	: m_rows(0), m_cols(0), m_stride(1)
+{
+}
+
+template <typename T>
+void IntegralImage::computeT(const ImageViewT<const T> & img, ThreadPool * pPool, bool withSquares)
+/*three steps: every band builds the table of its own rows, the last rows of
+the bands are summed up serially into one carry row per band, and every band
+adds its carry row to all of its rows*/
+{
+	m_rows = img.rows();
+	m_cols = img.cols();
+	m_stride = m_cols + 1;
+
+	const size_t tableSize = (size_t)(m_rows + 1) * m_stride;
+	m_sum.resize(tableSize);
+	std::fill(m_sum.begin(), m_sum.begin() + m_stride, 0ULL);
+	if (withSquares)
+	{
+		m_sqSum.resize(tableSize);
+		std::fill(m_sqSum.begin(), m_sqSum.begin() + m_stride, 0ULL);
+	}
+	else
+		m_sqSum.clear();
+
+	if (m_rows <= 0 || m_cols <= 0)
+		return;
+
+	// fixed bands, the carries depend on where they start
+	int numBands = 1;
+	if (pPool)
+		numBands = std::max(1, std::min(pPool->numThreads(), m_rows / MIN_BAND_ROWS));
+	std::vector<int> bandStart(numBands + 1);
+	for (int b = 0; b <= numBands; b++)
+		bandStart[b] = (int)((long long)m_rows * b / numBands);
+
+	unsigned long long * pSum = &m_sum[0];
+	unsigned long long * pSqSum = withSquares ? &m_sqSum[0] : NULL;
+	const int cols = m_cols;
+	const int stride = m_stride;
+
+	parallelFor(pPool, 0, numBands, [&](int b0, int b1)
+	{
+		for (int b = b0; b < b1; b++)
+		{
+			for (int y = bandStart[b]; y < bandStart[b + 1]; y++)
+			{
+				const T * pSrc = img.rowPtr(y);
+				unsigned long long * pOut = pSum + (size_t)(y + 1) * stride;
+				const bool first = (y == bandStart[b]);
+
+				unsigned long long rowSum = 0;
+				pOut[0] = 0;
+				for (int x = 0; x < cols; x++)
+				{
+					rowSum += pSrc[x];
+					pOut[x + 1] = first ? rowSum : rowSum + pOut[x + 1 - stride];
+				}
+
+				if (pSqSum)
+				{
+					unsigned long long * pSqOut = pSqSum + (size_t)(y + 1) * stride;
+					unsigned long long rowSqSum = 0;
+					pSqOut[0] = 0;
+					for (int x = 0; x < cols; x++)
+					{
+						rowSqSum += (unsigned long long)pSrc[x] * pSrc[x];
+						pSqOut[x + 1] = first ? rowSqSum : rowSqSum + pSqOut[x + 1 - stride];
+					}
+				}
+			}
+		}
+	}, 1);
+
+	if (numBands == 1)
+		return;
+
+	// carry of band b: sum of the last rows of all bands above it
+	std::vector<unsigned long long> carry((size_t)numBands * stride, 0ULL);
+	std::vector<unsigned long long> sqCarry(pSqSum ? (size_t)numBands * stride : 0, 0ULL);
+	for (int b = 1; b < numBands; b++)
+	{
+		const size_t lastRow = (size_t)bandStart[b] * stride;
+		for (int x = 0; x < stride; x++)
+			carry[b * stride + x] = carry[(b - 1) * stride + x] + pSum[lastRow + x];
+		if (pSqSum)
+		{
+			for (int x = 0; x < stride; x++)
+				sqCarry[b * stride + x] = sqCarry[(b - 1) * stride + x] + pSqSum[lastRow + x];
+		}
+	}
+
+	parallelFor(pPool, 1, numBands, [&](int b0, int b1)
+	{
+		for (int b = b0; b < b1; b++)
+		{
+			const unsigned long long * pCarry = &carry[b * stride];
+			for (int y = bandStart[b]; y < bandStart[b + 1]; y++)
+			{
+				unsigned long long * pOut = pSum + (size_t)(y + 1) * stride;
+				for (int x = 1; x < stride; x++)
+					pOut[x] += pCarry[x];
+			}
+
+			if (pSqSum)
+			{
+				const unsigned long long * pSqCarry = &sqCarry[b * stride];
+				for (int y = bandStart[b]; y < bandStart[b + 1]; y++)
+				{
+					unsigned long long * pSqOut = pSqSum + (size_t)(y + 1) * stride;
+					for (int x = 1; x < stride; x++)
+						pSqOut[x] += pSqCarry[x];
+				}
+			}
+		}
+	}, 1);
+}
+
+void IntegralImage::compute(const ImageViewT<const unsigned char> & img, ThreadPool * pPool, bool withSquares)
+{
+	computeT(img, pPool, withSquares);
+}
+
+void IntegralImage::compute(const ImageViewT<const unsigned short> & img, ThreadPool * pPool, bool withSquares)
+{
+	computeT(img, pPool, withSquares);
+}
+
+double IntegralImage::mean(int upperLeftRow, int upperLeftCol, int lowerRightRow, int lowerRightCol) const
+{
+	const double numPixels = (double)(lowerRightRow - upperLeftRow) * (lowerRightCol - upperLeftCol);
+	if (numPixels <= 0)
+		return 0;
+
+	return (double)sum(upperLeftRow, upperLeftCol, lowerRightRow, lowerRightCol) / numPixels;
+}
+
+double IntegralImage::variance(int upperLeftRow, int upperLeftCol, int lowerRightRow, int lowerRightCol) const
+{
+	const double numPixels = (double)(lowerRightRow - upperLeftRow) * (lowerRightCol - upperLeftCol);
+	if (numPixels <= 0 || !hasSquares())
+		return 0;
+
+	const double mean = (double)sum(upperLeftRow, upperLeftCol, lowerRightRow, lowerRightCol) / numPixels;
+	const double meanSq = (double)sumSquares(upperLeftRow, upperLeftCol, lowerRightRow, lowerRightCol) / numPixels;
+	return std::max(0., meanSq - mean * mean);
+}
+
+template <typename T>
+void IntegralImage::boxFilterT(const ImageViewT<T> & dst, int radius, ThreadPool * pPool) const
+{
+	if (m_rows <= 0 || m_cols <= 0)
+		return;
+	radius = std::max(0, radius);
+
+	// window columns of every pixel, cut at the border
+	std::vector<int> colBegin(m_cols), colEnd(m_cols);
+	for (int x = 0; x < m_cols; x++)
+	{
+		colBegin[x] = std::max(0, x - radius);
+		colEnd[x] = std::min(m_cols, x + radius + 1);
+	}
+
+	parallelFor(pPool, 0, m_rows, [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; y++)
+		{
+			const int rowBegin = std::max(0, y - radius);
+			const int rowEnd = std::min(m_rows, y + radius + 1);
+			const unsigned long long * pTop = &m_sum[(size_t)rowBegin * m_stride];
+			const unsigned long long * pBottom = &m_sum[(size_t)rowEnd * m_stride];
+			T * pDst = dst.rowPtr(y);
+
+			for (int x = 0; x < m_cols; x++)
+			{
+				const int c0 = colBegin[x];
+				const int c1 = colEnd[x];
+				const unsigned long long windowSum = pBottom[c1] - pBottom[c0] - pTop[c1] + pTop[c0];
+				const unsigned long long numPixels = (unsigned long long)(rowEnd - rowBegin) * (c1 - c0);
+				pDst[x] = (T)((windowSum + numPixels / 2) / numPixels);
+			}
+		}
+	}, MIN_BAND_ROWS);
+}
+
+void IntegralImage::boxFilter(const ImageViewT<unsigned char> & dst, int radius, ThreadPool * pPool) const
+{
+	boxFilterT(dst, radius, pPool);
+}
+
+void IntegralImage::boxFilter(const ImageViewT<unsigned short> & dst, int radius, ThreadPool * pPool) const
+{
+	boxFilterT(dst, radius, pPool);
+}
@@ -0,0 +1,82 @@
+#ifndef __INTEGRAL_IMAGE_H__
+#define __INTEGRAL_IMAGE_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 IntegralImage.h
+///
+/// Summed-area tables of 8 and 16 bit images. After one pass over the image the
+/// sum, mean and variance of any rectangle take four table lookups, independent
+/// of its size. Sums and squared sums are 64 bit, enough for 16 bit images of
+/// more than 2^30 pixels.
+///
+//=================================================================================
+//=================================================================================
+
+#include <vector>
+#include "ImageProcess.h"
+
+class ThreadPool;
+
+/*
+Table of (rows + 1) x (cols + 1) prefix sums: entry (r, c) is the sum of all
+pixels above and left of it, row 0 and column 0 are 0. Rectangles are given as
+[upperLeftRow, lowerRightRow) x [upperLeftCol, lowerRightCol) like
+ImageViewT::subView.
+*/
+class IntegralImage
+{
+public:
+	IntegralImage();
+
+	// builds the tables for img, the squared sums only if withSquares is set
+	// (needed by variance())
+	void compute(const ImageViewT<const unsigned char> & img, ThreadPool * pPool = NULL, bool withSquares = true);
+	void compute(const ImageViewT<const unsigned short> & img, ThreadPool * pPool = NULL, bool withSquares = true);
+
+	int rows() const { return m_rows; }
+	int cols() const { return m_cols; }
+	bool hasSquares() const { return !m_sqSum.empty(); }
+
+	unsigned long long sum(int upperLeftRow, int upperLeftCol, int lowerRightRow, int lowerRightCol) const
+	{
+		return lookup(m_sum, upperLeftRow, upperLeftCol, lowerRightRow, lowerRightCol);
+	}
+	unsigned long long sumSquares(int upperLeftRow, int upperLeftCol, int lowerRightRow, int lowerRightCol) const
+	{
+		return lookup(m_sqSum, upperLeftRow, upperLeftCol, lowerRightRow, lowerRightCol);
+	}
+
+	// mean of the rectangle, 0 for an empty one
+	double mean(int upperLeftRow, int upperLeftCol, int lowerRightRow, int lowerRightCol) const;
+	// population variance of the rectangle, needs the squared sums
+	double variance(int upperLeftRow, int upperLeftCol, int lowerRightRow, int lowerRightCol) const;
+
+	// dst = rounded mean of the (2 * radius + 1)^2 window around every pixel.
+	// Windows are cut at the image border and average the pixels inside.
+	// dst has the size of the image
+	void boxFilter(const ImageViewT<unsigned char> & dst, int radius, ThreadPool * pPool = NULL) const;
+	void boxFilter(const ImageViewT<unsigned short> & dst, int radius, ThreadPool * pPool = NULL) const;
+
+private:
+	unsigned long long lookup(const std::vector<unsigned long long> & table, int upperLeftRow,
+		int upperLeftCol, int lowerRightRow, int lowerRightCol) const
+	{
+		const unsigned long long * pTop = &table[(size_t)upperLeftRow * m_stride];
+		const unsigned long long * pBottom = &table[(size_t)lowerRightRow * m_stride];
+		return pBottom[lowerRightCol] - pBottom[upperLeftCol] - pTop[lowerRightCol] + pTop[upperLeftCol];
+	}
+
+	template <typename T>
+	void computeT(const ImageViewT<const T> & img, ThreadPool * pPool, bool withSquares);
+	template <typename T>
+	void boxFilterT(const ImageViewT<T> & dst, int radius, ThreadPool * pPool) const;
+
+	int m_rows;
+	int m_cols;
+	int m_stride;	// cols + 1
+	std::vector<unsigned long long> m_sum;
+	std::vector<unsigned long long> m_sqSum;
+};
+
+#endif
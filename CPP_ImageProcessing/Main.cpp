@@ -4,82 +4,199 @@
 #include <cstdlib>
 
 #include "ImageProcess.h"
+#include "GaussFilter.h"
+#include "RecursiveGauss.h"
+#include "ImagePyramid.h"
+#include "BitMask.h"
+#include "ConnectedComponents.h"
+#include "Morphology.h"
+#include "GrayPipeline.h"
+#include "ColorPipeline.h"
+#include "ThreadPool.h"
+#include "BatchProcessor.h"
+#include "FrameArena.h"
+#include "Profiler.h"
 
 #include "PGM_IO.h"
 #include "PPM_IO.h"
+#include "MappedPNM_IO.h"
 using namespace std;
 
 int readImageHeader(char[], int&, int&, int&, bool&);
 int readImage(char[], Image&);
 int writeImage(char[], Image&);
 
-static void filterGauss3x1(unsigned char * pImgDst, const unsigned char * pImgSrc,
-	const int width, const int height)
+static void printComponents( const char * name, const ConnectedComponents & components, const long long minArea )
 {
-
-	for (int y = 0; y < height; y++)
+	printf( "%s: %d components\n", name, components.numComponents() );
+	for( size_t i = 0; i < components.components().size(); i++ )
 	{
-		unsigned char * pDst = pImgDst + y* width + 1;
-		const unsigned char *pSrc = pImgSrc + y* width;
-
-		for (int x = 1; x < width - 1; x++)
-		{
-			const unsigned int sum = (int)pSrc[0] + 2 * (int)pSrc[1] + (int)pSrc[2];
-			*pDst = sum / 4;
-			pDst++;
-			pSrc++;
-		}
+		const ComponentStats & c = components.components()[i];
+		if( c.area >= minArea )
+			printf( "  %d: %lld pixels, box (%d, %d) - (%d, %d), centroid (%.1f, %.1f)\n", c.label, c.area,
+				c.left, c.top, c.right, c.bottom, c.centroidX, c.centroidY );
 	}
 }
 
-
-static void filterGauss1x3(unsigned char * pImgDst, const unsigned char * pImgSrc,
-	const int width, const int height)
+static void writeProfile( const char * traceFileName )
 {
+	if( ! traceFileName )
+		return;
 
-	for (int y = 1; y < height - 1; y++)
-	{
-		unsigned char * pDst = pImgDst + y* width;
-		const unsigned char *pSrc = pImgSrc + y* width;
+	Profiler::instance().printSummary();
+	if( ! Profiler::instance().writeChromeTrace( traceFileName ) )
+		printf( "Writing %s failed!\n", traceFileName );
+}
 
-		for (int x = 0; x < width; x++)
+int main(int argc, char* argv[])
+{
+	//////////////////////////////////////////////////////////////////////////
+	// Command line: -threads N (default: one thread per core)
+	//               -fused (run the gray pipeline in two streaming passes)
+	//               -sigma S (recursive Gaussian of any sigma instead of
+	//                  the 3x3 Gaussian, not with -fused)
+	//               -antialias (low-pass before the 1/2 scaling instead of
+	//                  picking every second pixel, not with -fused)
+	//               -gradient sobel|scharr (energy operator instead of
+	//                  central differences, not with -fused)
+	//               -pbm (also write the masks with 1 bit per pixel,
+	//                  energyThresh.pbm and hueSegmentation.pbm)
+	//               -open N (opening of both masks with an N x N square,
+	//                  removes specks before they are written)
+	//               -components N (label the blobs of both masks and list
+	//                  the ones of at least N pixels)
+	//               -stream in.pgm out.pgm (Gaussian, energy and threshold
+	//                  of a file of any size, -strip N rows at a time)
+	//               -batch dir|@list.txt|files... -out dir [-workers N]
+	//                  (gray pipeline on every PGM, hue segmentation on
+	//                  every PPM)
+	//               -profile trace.json (print the time per stage and
+	//                  thread, write a Chrome trace; needs a build with
+	//                  IP_ENABLE_PROFILING)
+	//////////////////////////////////////////////////////////////////////////
+	int numThreads = 0;
+	bool fused = false;
+	float sigma = 0;
+	bool antialias = false;
+	GradientOperator gradientOp = GRADIENT_CENTRAL;
+	bool pbm = false;
+	int openSize = 0;
+	long long minComponentArea = -1;
+	const char * streamIn = 0;
+	const char * streamOut = 0;
+	int stripRows = 256;
+	bool batch = false;
+	std::vector<std::string> batchFiles;
+	BatchOptions batchOptions;
+	const char * traceFileName = 0;
+	for( int i = 1; i < argc; i++ )
+	{
+		if( 0 == strcmp( argv[i], "-threads" ) && i + 1 < argc )
+			numThreads = atoi( argv[++i] );
+		else if( 0 == strcmp( argv[i], "-fused" ) )
+			fused = true;
+		else if( 0 == strcmp( argv[i], "-antialias" ) )
+			antialias = true;
+		else if( 0 == strcmp( argv[i], "-sigma" ) && i + 1 < argc )
+			sigma = (float)atof( argv[++i] );
+		else if( 0 == strcmp( argv[i], "-pbm" ) )
+			pbm = true;
+		else if( 0 == strcmp( argv[i], "-open" ) && i + 1 < argc )
+			openSize = atoi( argv[++i] );
+		else if( 0 == strcmp( argv[i], "-components" ) && i + 1 < argc )
+			minComponentArea = atoll( argv[++i] );
+		else if( 0 == strcmp( argv[i], "-gradient" ) && i + 1 < argc )
 		{
-			const unsigned int sum = (int)pSrc[-width] + 2 * (int)pSrc[0] + (int)pSrc[width];
-			*pDst = sum / 4;
-			pDst++;
-			pSrc++;
+			++i;
+			if( 0 == strcmp( argv[i], "sobel" ) )
+				gradientOp = GRADIENT_SOBEL;
+			else if( 0 == strcmp( argv[i], "scharr" ) )
+				gradientOp = GRADIENT_SCHARR;
 		}
+		else if( 0 == strcmp( argv[i], "-stream" ) && i + 2 < argc )
+		{
+			streamIn = argv[++i];
+			streamOut = argv[++i];
+		}
+		else if( 0 == strcmp( argv[i], "-strip" ) && i + 1 < argc )
+			stripRows = atoi( argv[++i] );
+		else if( 0 == strcmp( argv[i], "-batch" ) )
+		{
+			batch = true;
+			while( i + 1 < argc && argv[i + 1][0] != '-' )
+			{
+				if( ! listImageFiles( argv[++i], batchFiles ) )
+					printf( "Skipping %s\n", argv[i] );
+			}
+		}
+		else if( 0 == strcmp( argv[i], "-out" ) && i + 1 < argc )
+			batchOptions.outDir = argv[++i];
+		else if( 0 == strcmp( argv[i], "-workers" ) && i + 1 < argc )
+			batchOptions.numWorkers = atoi( argv[++i] );
+		else if( 0 == strcmp( argv[i], "-profile" ) && i + 1 < argc )
+			traceFileName = argv[++i];
 	}
-}
-
-static void filterGaussian3x3(unsigned char * pImg, const int width, const int height)
-{
-	unsigned char * pFltY = new unsigned char[width*height];
 
-	filterGauss1x3(pFltY, pImg, width, height);
+	if( traceFileName && ! profilingCompiledIn() )
+	{
+		printf( "-profile: built without IP_ENABLE_PROFILING, nothing is recorded\n" );
+		traceFileName = 0;
+	}
+	Profiler::instance().setEnabled( traceFileName != 0 );
+	IP_PROFILE_THREAD_NAME( "main" );
 
-	// copy border
-	memcpy(pFltY, pImg, width);
-	memcpy(pFltY + width*(height - 1), pImg + width*(height - 1), width);
+	if( batch )
+	{
+		BatchStats stats;
+		const bool ok = runBatch( batchFiles, batchOptions, stats );
+		printf( "%d images in %.3f s: %.1f images/s, %d failed\n", stats.numImages, stats.seconds,
+			stats.seconds > 0 ? stats.numImages / stats.seconds : 0.0, stats.numFailed );
+		writeProfile( traceFileName );
+		return ok ? 0 : -1;
+	}
 
-	filterGauss3x1(pImg, pFltY, width, height);
+	ThreadPool pool( numThreads );
+	ConnectedComponents components;
+	// buffers of the current frame, handed back at once by reset()
+	FrameArena frameArena;
 
-	delete pFltY;
-}
+	if( streamIn )
+	{
+		const bool ok = runGrayStagesStreamed( streamIn, streamOut,
+			STREAM_GAUSSIAN | STREAM_ENERGY | STREAM_THRESHOLD, stripRows, 30, &pool );
+		if( ! ok )
+			printf( "Streaming %s failed!\n", streamIn );
+		writeProfile( traceFileName );
+		return ok ? 0 : -1;
+	}
 
-int main(int argc, char* argv[])
-{
 	//////////////////////////////////////////////////////////////////////////
 	// Read gray-value image
 	//////////////////////////////////////////////////////////////////////////
-	unsigned char * pImage = 0;
+	MappedPNM grayFile;
+	unsigned char * pImageBuf = 0;
+	const unsigned char * pImage = 0;
 	int width, height;
+	bool readOk;
 
-	bool readOk = readPGM( "eyes_dark.pgm", &pImage, width, height );
+	if( grayFile.open( "eyes_dark.pgm" ) && grayFile.isGray8() )
+	{
+		// binary 8 bit image: work directly on the mapped file
+		pImage = grayFile.data();
+		width = grayFile.width();
+		height = grayFile.height();
+		readOk = true;
+	}
+	else
+	{
+		readOk = readPGM( "eyes_dark.pgm", &pImageBuf, width, height );
+		pImage = pImageBuf;
+	}
 
 	if( ! readOk )
 	{
 		printf( "Reading image failed!\n");
+		writeProfile( traceFileName );
 		printf( "Press any key to exit.\n" );
 		getchar();
 		return -1;
@@ -91,105 +208,120 @@ int main(int argc, char* argv[])
 	const int widthScl = width / 2;
 	const int heightScl = height / 2;
 
-	unsigned char * pScaledImage = new unsigned char[ widthScl * heightScl ];
+	unsigned char * pScaledImage = frameArena.allocateArray<unsigned char>( widthScl * heightScl );
+	unsigned char * pFiltered = frameArena.allocateArray<unsigned char>( widthScl * heightScl );
+	unsigned char * energy = frameArena.allocateArray<unsigned char>( widthScl * heightScl );
 
-	for( int y = 0; y < heightScl; y++ )
+	if( fused )
 	{
-		for( int x = 0; x < widthScl; x++ )
+		// all stages in two passes, the intermediate images are only kept
+		// to write them out
+		unsigned char * pStretched = frameArena.allocateArray<unsigned char>( widthScl * heightScl );
+		unsigned char * pEnergyThresh = frameArena.allocateArray<unsigned char>( widthScl * heightScl );
+
+		GrayPipelineBuffers buffers;
+		buffers.pHalf = pScaledImage;
+		buffers.pFiltered = pFiltered;
+		buffers.pStretched = pStretched;
+		buffers.pEnergy = energy;
+		buffers.pEnergyThresh = pEnergyThresh;
+
+		runGrayPipelineFused( pImage, width, height, 0.05f, 30, buffers, &pool, &frameArena );
+
+		if( openSize > 1 )
 		{
-			pScaledImage[ x + y*widthScl ] = pImage[ 2*x + 2*y*width ];
+			const ImageViewT<unsigned char> threshView( pEnergyThresh, heightScl, widthScl, widthScl );
+			morphology( threshView, threshView, MORPH_OPEN, openSize, openSize, &pool, &frameArena );
 		}
-	}
 
-	writePGM( "half.pgm", pScaledImage, widthScl, heightScl );
+		writePGM( "half.pgm", pScaledImage, widthScl, heightScl );
+		writePGM( "halfFiltered.pgm", pFiltered, widthScl, heightScl );
+		writePGM( "histogram.pgm", pStretched, widthScl, heightScl );
+		writePGM( "energy.pgm", energy, widthScl, heightScl );
+		writePGM( "energyThresh.pgm", pEnergyThresh, widthScl, heightScl );
 
+		if( pbm )
+		{
+			BitMask energyMask;
+			thresholdToMask( energyMask, ImageViewT<const unsigned char>( pEnergyThresh, heightScl, widthScl, widthScl ), 0, &pool );
+			writePBM( "energyThresh.pbm", energyMask );
+		}
 
-	//////////////////////////////////////////////////////////////////////////
-	// Filter image with 3x3 Gaussian kernel
-	//////////////////////////////////////////////////////////////////////////
-	filterGaussian3x3( pScaledImage, widthScl, heightScl );
+		if( minComponentArea >= 0 )
+		{
+			components.label( ImageViewT<const unsigned char>( pEnergyThresh, heightScl, widthScl, widthScl ), &pool );
+			printComponents( "energyThresh", components, minComponentArea );
+		}
+	}
+	else
+	{
+		if( antialias )
+			downsampleHalf( ImageViewT<unsigned char>( pScaledImage, heightScl, widthScl, widthScl ),
+				ImageViewT<const unsigned char>( pImage, height, width, width ), &pool, &frameArena );
+		else
+			scaleHalf( pScaledImage, pImage, width, height, &pool );
 
-	writePGM( "halfFiltered.pgm", pScaledImage, widthScl, heightScl );
+		writePGM( "half.pgm", pScaledImage, widthScl, heightScl );
 
 
-	//////////////////////////////////////////////////////////////////////////
-	// Compute histogram / cut upper and lower 5% of gray-values
-	//////////////////////////////////////////////////////////////////////////
-	unsigned int histogram[256];
-	memset( histogram, 0, 256*sizeof(unsigned int) );
+		//////////////////////////////////////////////////////////////////////////
+		// Filter image with 3x3 Gaussian kernel (or one of any sigma)
+		//////////////////////////////////////////////////////////////////////////
+		if( sigma > 0 )
+			filterGaussianRecursive( pFiltered, pScaledImage, widthScl, heightScl, sigma, &pool, &frameArena );
+		else
+			filterGaussian3x3( pFiltered, pScaledImage, widthScl, heightScl, &pool, &frameArena );
 
-	// calculate histogram
-	for( int i = 0; i < widthScl*heightScl; i++ )
-		++histogram[ pScaledImage[i] ];
+		writePGM( "halfFiltered.pgm", pFiltered, widthScl, heightScl );
 
-	// determine lower and upper bound for histogram stretch
-	const float			cutOffPercentage = 0.05;
-	unsigned char		lowerBound, upperBound;
-	unsigned int		histAccu = 0;
-	const unsigned int	lowerPercentile = cutOffPercentage * widthScl*heightScl;
-	const unsigned int	upperPercentile = (1-cutOffPercentage) * widthScl*heightScl;
 
-	for( int h = 0; h < 256 ; h++ )
-	{
-		histAccu += histogram[h];
-		if( histAccu <= lowerPercentile )
-		{
-			lowerBound = h;
-			continue;
-		}
-		if( histAccu >= upperPercentile )
-		{
-			upperBound = h;
-			break;
-		}
-	}
+		//////////////////////////////////////////////////////////////////////////
+		// Compute histogram / cut upper and lower 5% of gray-values
+		//////////////////////////////////////////////////////////////////////////
+		stretchHistogram( pFiltered, widthScl, heightScl, 0.05f, &pool );
 
-	// assign new gray-values from linear mapping between lower and upper bound
-	const float histScale = 255. / (upperBound - lowerBound);
-	for( int i = 0; i < widthScl*heightScl; i++ )
-	{
-		const int newVal = histScale * ( (int)pScaledImage[i] - lowerBound );
-		pScaledImage[i] = std::min<int>( 255, std::max<int>( 0, newVal ) );
-	}
+		writePGM( "histogram.pgm", pFiltered, widthScl, heightScl );
 
-	writePGM( "histogram.pgm", pScaledImage, widthScl, heightScl );
 
+		//////////////////////////////////////////////////////////////////////////
+		// Compute image energy from gradients
+		//////////////////////////////////////////////////////////////////////////
+		computeEnergy( energy, pFiltered, widthScl, heightScl, &pool, gradientOp );
 
-	//////////////////////////////////////////////////////////////////////////
-	// Compute image energy from gradients
-	//////////////////////////////////////////////////////////////////////////
-	unsigned char * energy = new unsigned char[ widthScl * heightScl ];
-	memset( energy, 0, widthScl*heightScl );
+		writePGM( "energy.pgm", energy, widthScl, heightScl );
 
-	for (int y = 1; y < heightScl-1; ++y)
-	{
-		const int rowOffset = y * widthScl;
-		for (int x = 1; x < widthScl-1; ++x)
+
+		//////////////////////////////////////////////////////////////////////////
+		// Segment high energy areas by Thresholding
+		//////////////////////////////////////////////////////////////////////////
+		thresholdImage( energy, widthScl, heightScl, 30, &pool );
+
+		if( openSize > 1 )
 		{
-			const int gradX = pScaledImage[rowOffset+x+1] - pScaledImage[rowOffset+x-1];
-			const int gradY = pScaledImage[rowOffset+x+widthScl] - pScaledImage[rowOffset+x-widthScl];
-			energy[rowOffset+x] = sqrt( (float)(gradX * gradX + gradY * gradY) ) / sqrt(2.f);
+			const ImageViewT<unsigned char> threshView( energy, heightScl, widthScl, widthScl );
+			morphology( threshView, threshView, MORPH_OPEN, openSize, openSize, &pool, &frameArena );
 		}
-	}
 
-	writePGM( "energy.pgm", energy, widthScl, heightScl );
+		writePGM( "energyThresh.pgm", energy, widthScl, heightScl );
 
+		if( pbm )
+		{
+			BitMask energyMask;
+			thresholdToMask( energyMask, ImageViewT<const unsigned char>( energy, heightScl, widthScl, widthScl ), 0, &pool );
+			writePBM( "energyThresh.pbm", energyMask );
+		}
 
-	//////////////////////////////////////////////////////////////////////////
-	// Segment high energy areas by Thresholding
-	//////////////////////////////////////////////////////////////////////////
-	for( int i = 0; i < widthScl*heightScl; i++ )
-	{
-		if( energy[i] > 30 )
-			energy[i] = 255;
-		else
-			energy[i] = 0;
+		if( minComponentArea >= 0 )
+		{
+			components.label( ImageViewT<const unsigned char>( energy, heightScl, widthScl, widthScl ), &pool );
+			printComponents( "energyThresh", components, minComponentArea );
+		}
 	}
-	writePGM( "energyThresh.pgm", energy, widthScl, heightScl );
 
-	delete energy;
-	delete pScaledImage;
-	free( pImage );
+	IP_PROFILE_COUNTER( "frame arena bytes", frameArena.used() );
+	frameArena.reset();
+	free( pImageBuf );
+	grayFile.close();
 
 
 #if 1 // color
@@ -197,12 +329,29 @@ int main(int argc, char* argv[])
 	// Read color (RGB) image
 	//////////////////////////////////////////////////////////////////////////
 	rtcvRgbaValue * pRgbImage = 0;
-	//readOk = readPPM( "../eyes_color.ppm", &pRgbImage, width, height );
-	readOk = readPPM( "../HSV_cone.ppm", &pRgbImage, width, height ); // proof of concept ;)
+	const char * colorFileName = "../HSV_cone.ppm"; // proof of concept ;)
+	//const char * colorFileName = "../eyes_color.ppm";
+
+	MappedPNM colorFile;
+	if( colorFile.open( colorFileName ) && colorFile.isRgb8() )
+	{
+		// convert straight from the mapped payload, no temporary copy
+		width = colorFile.width();
+		height = colorFile.height();
+		pRgbImage = (rtcvRgbaValue*)malloc( width*height*sizeof(rtcvRgbaValue) );
+		convertRgbToRgba( pRgbImage, colorFile.data(), width*height );
+		colorFile.close();
+		readOk = true;
+	}
+	else
+	{
+		readOk = readPPM( colorFileName, &pRgbImage, width, height );
+	}
 
 	if( ! readOk )
 	{
 		printf( "Reading color image failed!\n");
+		writeProfile( traceFileName );
 		printf( "Press any key to exit.\n" );
 		getchar();
 		return -1;
@@ -210,46 +359,47 @@ int main(int argc, char* argv[])
 
 
 	//////////////////////////////////////////////////////////////////////////
-	// Determine the dominant color from a Hue-histogram
+	// Determine the dominant color from a Hue-histogram, HSV is computed once
+	// and kept for the segmentation
 	//////////////////////////////////////////////////////////////////////////
-
-	// Compute hue-histogram with 8 bins
-	unsigned int hueHist[8] = {0,0,0,0,0,0,0,0};
-	for( int i = 0; i < width*height; i++ )
-		++hueHist[ pRgbImage[i].getHue() >> 5 ];
-
-	// Find maximum in histogram
-	int maxHist = 0;
-	int maxHue = -1;
-	for( int h = 0; h < 8; h++ )
-	{
-		if( hueHist[h] > maxHist )
-		{
-			maxHist = hueHist[h];
-			maxHue = h;
-		}
-	}
+	ColorSegmenter segmenter;
+	segmenter.analyze( ColorView::fromRgba( pRgbImage, height, width ), &pool );
 
 	//////////////////////////////////////////////////////////////////////////
 	// Segment dominant color (and neighbors) in HSV color space
 	//////////////////////////////////////////////////////////////////////////
-	unsigned char * hueSeg = new unsigned char[ width*height ];
-	for( int i = 0; i < width*height; i++ )
+	unsigned char * hueSeg = frameArena.allocateArray<unsigned char>( width*height );
+
+	segmenter.segmentDominant( ImageViewT<unsigned char>( hueSeg, height, width, width ), &pool );
+
+	if( openSize > 1 )
 	{
-		const unsigned char hue = pRgbImage[i].getHue() >> 5; // in bins
-		const unsigned char sat = pRgbImage[i].getSat();
-		const unsigned char val = pRgbImage[i].getV();
-		if( hue == maxHue && sat > 100 && val > 100 )
-			hueSeg[i] = 255;
-		else
-			hueSeg[i] = 0;
+		const ImageViewT<unsigned char> hueView( hueSeg, height, width, width );
+		morphology( hueView, hueView, MORPH_OPEN, openSize, openSize, &pool, &frameArena );
 	}
 
 	writePGM( "../hueSegmentation.pgm", hueSeg, width, height );
 
-	delete hueSeg;
+	if( pbm )
+	{
+		BitMask hueMask;
+		segmenter.segmentDominant( hueMask, &pool, &frameArena );
+		if( openSize > 1 )
+			morphology( hueMask, hueMask, MORPH_OPEN, openSize, openSize, &pool, &frameArena );
+		writePBM( "../hueSegmentation.pbm", hueMask );
+	}
+
+	if( minComponentArea >= 0 )
+	{
+		components.label( ImageViewT<const unsigned char>( hueSeg, height, width, width ), &pool );
+		printComponents( "hueSegmentation", components, minComponentArea );
+	}
+
+	IP_PROFILE_COUNTER( "frame arena bytes", frameArena.used() );
+	frameArena.reset();
 	free( pRgbImage );
 #endif
+	writeProfile( traceFileName );
 	printf( "Finished! Press any key.\n" );
 	getchar();
 
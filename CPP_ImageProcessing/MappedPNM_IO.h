@@ -0,0 +1,235 @@
+#ifndef __MAPPED_PNM_IO_H__
+#define __MAPPED_PNM_IO_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 MappedPNM_IO.h
+///
+/// Zero-copy access to binary PGM (P5) and PPM (P6) files. The file is mapped
+/// read-only into memory, the header is parsed in place and data() points
+/// straight at the pixel payload, nothing is copied or allocated on the heap.
+/// P5 rows are sx bytes, P6 rows are sx*3 bytes (R,G,B); with a maxVal above 255
+/// every sample takes two bytes, big-endian.
+///
+//=================================================================================
+//=================================================================================
+
+#include <stddef.h>
+#include <string.h>
+#include "Profiler.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+class MappedPNM
+{
+public:
+	MappedPNM() { reset(); }
+	~MappedPNM() { close(); }
+
+	// maps fileName and parses its header, false if it is no P5/P6 file or truncated.
+	// Profiled with the mapped size as bytes read, the pages are read on first use
+	bool open(const char * fileName)
+	{
+		IP_PROFILE_SCOPE("MappedPNM open");
+		close();
+
+		if (!mapFile(fileName))
+			return false;
+		IP_PROFILE_ADD(0, m_mappingSize, 0);
+
+		if (!parseHeader())
+		{
+			close();
+			return false;
+		}
+
+		adviseSequential();
+		return true;
+	}
+
+	void close()
+	{
+#if defined(_WIN32)
+		if (m_pMapping)
+			UnmapViewOfFile(m_pMapping);
+		if (m_hMap)
+			CloseHandle(m_hMap);
+		if (m_hFile != INVALID_HANDLE_VALUE)
+			CloseHandle(m_hFile);
+#else
+		if (m_pMapping)
+			munmap(m_pMapping, m_mappingSize);
+#endif
+		reset();
+	}
+
+	bool isOpen() const { return m_pData != 0; }
+	int width() const { return m_sx; }
+	int height() const { return m_sy; }
+	int maxVal() const { return m_maxVal; }
+	int channels() const { return m_channels; }				// 1: P5, 3: P6
+	int bytesPerSample() const { return m_maxVal > 255 ? 2 : 1; }
+	size_t rowBytes() const { return (size_t)m_sx * m_channels * bytesPerSample(); }
+
+	// true for the files the 8 bit pipelines take directly: one byte per sample
+	// and maxval 255, every other maxval is rescaled by readPGM() / readPPM()
+	bool isGray8() const { return isOpen() && m_channels == 1 && m_maxVal == 255; }
+	bool isRgb8() const { return isOpen() && m_channels == 3 && m_maxVal == 255; }
+
+	// first byte of the payload, rows follow without padding
+	const unsigned char * data() const { return m_pData; }
+	const unsigned char * rowPtr(int row) const { return m_pData + row * rowBytes(); }
+
+private:
+	MappedPNM(const MappedPNM&);
+	MappedPNM& operator=(const MappedPNM&);
+
+	void reset()
+	{
+		m_pMapping = 0;
+		m_mappingSize = 0;
+		m_pData = 0;
+		m_sx = m_sy = m_maxVal = m_channels = 0;
+#if defined(_WIN32)
+		m_hFile = INVALID_HANDLE_VALUE;
+		m_hMap = 0;
+#endif
+	}
+
+	bool mapFile(const char * fileName)
+	{
+#if defined(_WIN32)
+		m_hFile = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (m_hFile == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_hFile, &size) || size.QuadPart == 0)
+			return false;
+		m_mappingSize = (size_t)size.QuadPart;
+
+		m_hMap = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!m_hMap)
+			return false;
+
+		m_pMapping = MapViewOfFile(m_hMap, FILE_MAP_READ, 0, 0, 0);
+		return m_pMapping != 0;
+#else
+		const int fd = ::open(fileName, O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0)
+		{
+			::close(fd);
+			return false;
+		}
+		m_mappingSize = (size_t)st.st_size;
+
+		void * pMapping = mmap(0, m_mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd); // the mapping keeps the file referenced
+		if (pMapping == MAP_FAILED)
+			return false;
+
+		m_pMapping = pMapping;
+		return true;
+#endif
+	}
+
+	void adviseSequential()
+	{
+#if !defined(_WIN32)
+		madvise(m_pMapping, m_mappingSize, MADV_SEQUENTIAL);
+		madvise(m_pMapping, m_mappingSize, MADV_WILLNEED);
+#endif
+	}
+
+	// skips whitespace and '#' comment lines, then reads a decimal number
+	static bool parseNumber(const unsigned char *& p, const unsigned char * pEnd, int & value)
+	{
+		for (;;)
+		{
+			while (p < pEnd && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+				++p;
+			if (p < pEnd && *p == '#')
+			{
+				while (p < pEnd && *p != '\n')
+					++p;
+				continue;
+			}
+			break;
+		}
+
+		if (p >= pEnd || *p < '0' || *p > '9')
+			return false;
+
+		long long v = 0;
+		while (p < pEnd && *p >= '0' && *p <= '9')
+		{
+			v = v * 10 + (*p++ - '0');
+			if (v > 0x7fffffff)
+				return false;
+		}
+		value = (int)v;
+		return true;
+	}
+
+	bool parseHeader()
+	{
+		const unsigned char * p = (const unsigned char *)m_pMapping;
+		const unsigned char * pEnd = p + m_mappingSize;
+
+		if (m_mappingSize < 2 || p[0] != 'P' || (p[1] != '5' && p[1] != '6'))
+			return false;
+		const int channels = (p[1] == '5') ? 1 : 3;
+		p += 2;
+
+		int sx, sy, maxVal;
+		if (!parseNumber(p, pEnd, sx) || !parseNumber(p, pEnd, sy) || !parseNumber(p, pEnd, maxVal))
+			return false;
+		if (sx <= 0 || sy <= 0 || maxVal <= 0 || maxVal > 65535)
+			return false;
+
+		// exactly one whitespace character separates header and payload
+		if (p >= pEnd)
+			return false;
+		++p;
+
+		const size_t payload = (size_t)sx * sy * channels * (maxVal > 255 ? 2 : 1);
+		if ((size_t)(pEnd - p) < payload)
+			return false;
+
+		m_sx = sx;
+		m_sy = sy;
+		m_maxVal = maxVal;
+		m_channels = channels;
+		m_pData = p;
+		return true;
+	}
+
+	void * m_pMapping;
+	size_t m_mappingSize;
+	const unsigned char * m_pData;
+	int m_sx;
+	int m_sy;
+	int m_maxVal;
+	int m_channels;
+#if defined(_WIN32)
+	HANDLE m_hFile;
+	HANDLE m_hMap;
+#endif
+};
+
+#endif
@@ -0,0 +1,564 @@
+/*
+
+Rectangular erosion and dilation with van Herk / Gil-Werman
+
+*/
+
+#include <string.h>
+#include <algorithm>
+#include "Morphology.h"
+#include "AlignedMemory.h"
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
+#include "FrameArena.h"
+#include "Profiler.h"
+
+#if defined(IP_X86)
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+typedef BitMask::Word Word;
+
+// byte row windows up to this width take log2(width) shifted SIMD passes, wider
+// ones van Herk / Gil-Werman (scalar, but a constant number of operations)
+static const int MAX_DOUBLING_WIDTH = 128;
+
+/*
+van Herk / Gil-Werman for a window of k elements: the input is cut into blocks
+of k, g holds the running extremum from the start of each block, h the one to
+the end of each block. A window starting at s covers the end of one block and
+the start of the next one, so its extremum is ext(h[s], g[s + k - 1]): three
+operations per element for any k.
+*/
+
+//////////////////////////////////////////////////////////////////////////
+// row kernels, dst[i] = min or max of a[i] and b[i]
+//////////////////////////////////////////////////////////////////////////
+
+typedef void (*ExtremeRowFunc)(unsigned char * pDst, const unsigned char * pA,
+	const unsigned char * pB, int n);
+
+template <bool IS_MAX>
+static void extremeRow_Scalar(unsigned char * pDst, const unsigned char * pA,
+	const unsigned char * pB, int n)
+{
+	for (int x = 0; x < n; x++)
+		pDst[x] = IS_MAX ? std::max(pA[x], pB[x]) : std::min(pA[x], pB[x]);
+}
+
+#if defined(IP_X86)
+template <bool IS_MAX>
+IP_TARGET_SSE2
+static void extremeRow_SSE2(unsigned char * pDst, const unsigned char * pA,
+	const unsigned char * pB, int n)
+{
+	int x = 0;
+
+	for (; x + 16 <= n; x += 16)
+	{
+		const __m128i a = _mm_loadu_si128((const __m128i *)(pA + x));
+		const __m128i b = _mm_loadu_si128((const __m128i *)(pB + x));
+		_mm_storeu_si128((__m128i *)(pDst + x), IS_MAX ? _mm_max_epu8(a, b) : _mm_min_epu8(a, b));
+	}
+
+	extremeRow_Scalar<IS_MAX>(pDst + x, pA + x, pB + x, n - x);
+}
+
+template <bool IS_MAX>
+IP_TARGET_AVX2
+static void extremeRow_AVX2(unsigned char * pDst, const unsigned char * pA,
+	const unsigned char * pB, int n)
+{
+	int x = 0;
+
+	for (; x + 32 <= n; x += 32)
+	{
+		const __m256i a = _mm256_loadu_si256((const __m256i *)(pA + x));
+		const __m256i b = _mm256_loadu_si256((const __m256i *)(pB + x));
+		_mm256_storeu_si256((__m256i *)(pDst + x), IS_MAX ? _mm256_max_epu8(a, b) : _mm256_min_epu8(a, b));
+	}
+
+	// the SSE2 tail is legacy encoded
+	_mm256_zeroupper();
+	extremeRow_SSE2<IS_MAX>(pDst + x, pA + x, pB + x, n - x);
+}
+
+#if defined(IP_HAVE_AVX512)
+template <bool IS_MAX>
+IP_TARGET_AVX512
+static void extremeRow_AVX512(unsigned char * pDst, const unsigned char * pA,
+	const unsigned char * pB, int n)
+{
+	int x = 0;
+
+	for (; x + 64 <= n; x += 64)
+	{
+		const __m512i a = _mm512_loadu_si512((const void *)(pA + x));
+		const __m512i b = _mm512_loadu_si512((const void *)(pB + x));
+		_mm512_storeu_si512((void *)(pDst + x), IS_MAX ? _mm512_max_epu8(a, b) : _mm512_min_epu8(a, b));
+	}
+
+	extremeRow_AVX2<IS_MAX>(pDst + x, pA + x, pB + x, n - x);
+}
+#endif
+#endif
+
+template <bool IS_MAX>
+static ExtremeRowFunc selectExtremeRow()
+/*returns the fastest row kernel the CPU supports*/
+{
+#if defined(IP_X86)
+	switch (simdLevel())
+	{
+#if defined(IP_HAVE_AVX512)
+	case SIMD_AVX512:	return extremeRow_AVX512<IS_MAX>;
+#endif
+	case SIMD_AVX2:		return extremeRow_AVX2<IS_MAX>;
+	case SIMD_SSE2:		return extremeRow_SSE2<IS_MAX>;
+	default:			break;
+	}
+#endif
+	return extremeRow_Scalar<IS_MAX>;
+}
+
+// the same for bit rows, 64 pixels per operation
+static void andWords(Word * pDst, const Word * pA, const Word * pB, int n)
+{
+	for (int i = 0; i < n; i++)
+		pDst[i] = pA[i] & pB[i];
+}
+
+static void orWords(Word * pDst, const Word * pA, const Word * pB, int n)
+{
+	for (int i = 0; i < n; i++)
+		pDst[i] = pA[i] | pB[i];
+}
+
+//////////////////////////////////////////////////////////////////////////
+// row pass, one source row at a time
+//////////////////////////////////////////////////////////////////////////
+
+/*
+Window of k pixels along the row of 8 bit pixels: dst(x) = ext of
+src(x - before .. x - before + k - 1). The row is copied into a line padded
+with identity, which the shifted passes or van Herk / Gil-Werman reduce.
+*/
+template <bool IS_MAX>
+class ByteRowFilter
+{
+public:
+	ByteRowFilter(const ImageViewT<const unsigned char> & src, const int k, const int before,
+		FrameArena * pArena)
+		: m_src(src), m_k(k), m_before(before), m_length((src.cols() + k - 1 + k - 1) / k * k),
+		m_pitch(alignedPitch(m_length)), m_line(pArena, k > 1 ? 3 * m_pitch : 0),
+		m_pLine(m_line.get()), m_extremeRow(selectExtremeRow<IS_MAX>())
+	{
+	}
+
+	// filtered row y in pScratch (cols pixels), or the source row itself for k = 1
+	const unsigned char * operator()(unsigned char * pScratch, const int y)
+	{
+		const int cols = m_src.cols();
+		if (m_k == 1)
+			return m_src.rowPtr(y);
+
+		// the passes overwrite the padding, it is restored for every row
+		const unsigned char identity = IS_MAX ? 0 : 255;
+		memset(m_pLine, identity, m_before);
+		memcpy(m_pLine + m_before, m_src.rowPtr(y), cols);
+		memset(m_pLine + m_before + cols, identity, m_length - m_before - cols);
+
+		if (m_k <= MAX_DOUBLING_WIDTH)
+		{
+			// line(x) = ext of line(x .. x + length - 1), the length grows by d per pass
+			const int lineLength = cols + m_k - 1;
+			int length = 1;
+			for (;;)
+			{
+				const int d = std::min(length, m_k - length);
+				length += d;
+				if (length == m_k)
+				{
+					m_extremeRow(pScratch, m_pLine, m_pLine + d, cols);
+					break;
+				}
+				m_extremeRow(m_pLine, m_pLine, m_pLine + d, lineLength - d);
+			}
+			return pScratch;
+		}
+
+		unsigned char * pG = m_pLine + m_pitch;
+		unsigned char * pH = pG + m_pitch;
+		for (int b = 0; b < m_length; b += m_k)
+		{
+			unsigned char g = m_pLine[b];
+			unsigned char h = m_pLine[b + m_k - 1];
+			pG[b] = g;
+			pH[b + m_k - 1] = h;
+			for (int j = 1; j < m_k; j++)
+			{
+				g = IS_MAX ? std::max(g, m_pLine[b + j]) : std::min(g, m_pLine[b + j]);
+				h = IS_MAX ? std::max(h, m_pLine[b + m_k - 1 - j]) : std::min(h, m_pLine[b + m_k - 1 - j]);
+				pG[b + j] = g;
+				pH[b + m_k - 1 - j] = h;
+			}
+		}
+		m_extremeRow(pScratch, pH, pG + m_k - 1, cols);
+		return pScratch;
+	}
+
+private:
+	ByteRowFilter(const ByteRowFilter &);
+	ByteRowFilter & operator=(const ByteRowFilter &);
+
+	ImageViewT<const unsigned char> m_src;
+	int m_k;
+	int m_before;
+	int m_length;			// padded line, whole blocks of k
+	size_t m_pitch;
+	ScratchBuffer<unsigned char> m_line;
+	unsigned char * m_pLine;	// padded line, g and h
+	ExtremeRowFunc m_extremeRow;
+};
+
+template <bool IS_OR>
+static void combineShiftedDown(Word * p, const int words, const int d)
+/*p[x] = ext(p[x], p[x + d]) for all bits, bits past the row are identity.
+Ascending, every word is combined before a lower one reads it*/
+{
+	const Word fill = IS_OR ? 0 : ~(Word)0;
+	const int q = d >> 6;
+	const int r = d & 63;
+	// words whose source words are both inside the row
+	const int inside = std::max(words - q - 1, 0);
+	int i = 0;
+
+	if (r == 0)
+	{
+		for (; i < words - q; i++)
+			p[i] = IS_OR ? p[i] | p[i + q] : p[i] & p[i + q];
+	}
+	else
+	{
+		for (; i < inside; i++)
+		{
+			const Word shifted = (p[i + q] >> r) | (p[i + q + 1] << (64 - r));
+			p[i] = IS_OR ? p[i] | shifted : p[i] & shifted;
+		}
+	}
+	for (; i < words; i++)
+	{
+		const Word a = i + q < words ? p[i + q] : fill;
+		const Word shifted = r ? (a >> r) | (fill << (64 - r)) : a;
+		p[i] = IS_OR ? p[i] | shifted : p[i] & shifted;
+	}
+}
+
+template <bool IS_OR>
+static void combineShiftedUp(Word * p, const int words, const int d)
+/*p[x] = ext(p[x], p[x - d]), bits before the row are identity. Descending*/
+{
+	const Word fill = IS_OR ? 0 : ~(Word)0;
+	const int q = d >> 6;
+	const int r = d & 63;
+	int i = words - 1;
+
+	if (r == 0)
+	{
+		for (; i >= q; i--)
+			p[i] = IS_OR ? p[i] | p[i - q] : p[i] & p[i - q];
+	}
+	else
+	{
+		for (; i >= q + 1; i--)
+		{
+			const Word shifted = (p[i - q] << r) | (p[i - q - 1] >> (64 - r));
+			p[i] = IS_OR ? p[i] | shifted : p[i] & shifted;
+		}
+	}
+	for (; i >= 0; i--)
+	{
+		const Word a = i - q >= 0 ? p[i - q] : fill;
+		const Word shifted = r ? (a << r) | (fill >> (64 - r)) : a;
+		p[i] = IS_OR ? p[i] | shifted : p[i] & shifted;
+	}
+}
+
+/*
+The same for bits, as the ext of a forward window x .. x + after and a backward
+window x - before .. x. Each shifted combine doubles a window's length.
+*/
+template <bool IS_OR>
+class BitRowFilter
+{
+public:
+	BitRowFilter(const BitMask & src, const int k, const int before, FrameArena * pArena)
+		: m_src(src), m_k(k), m_before(before), m_words(src.wordsPerRow()), m_backward(pArena, m_words),
+		m_pBackward(m_backward.get())
+	{
+		m_lastMask = (src.cols() & 63) ? ((Word)1 << (src.cols() & 63)) - 1 : ~(Word)0;
+	}
+
+	const Word * operator()(Word * pScratch, const int y)
+	{
+		if (m_k == 1)
+			return m_src.rowPtr(y);
+
+		const Word fill = IS_OR ? 0 : ~(Word)0;
+		const int after = m_k - 1 - m_before;
+		Word * pForward = pScratch;
+		memcpy(pForward, m_src.rowPtr(y), m_words * sizeof(Word));
+		pForward[m_words - 1] |= fill & ~m_lastMask;
+		memcpy(m_pBackward, pForward, m_words * sizeof(Word));
+
+		for (int length = 1; length < after + 1; )
+		{
+			const int d = std::min(length, after + 1 - length);
+			combineShiftedDown<IS_OR>(pForward, m_words, d);
+			length += d;
+		}
+		for (int length = 1; length < m_before + 1; )
+		{
+			const int d = std::min(length, m_before + 1 - length);
+			combineShiftedUp<IS_OR>(m_pBackward, m_words, d);
+			length += d;
+		}
+
+		if (IS_OR)
+			orWords(pScratch, pForward, m_pBackward, m_words);
+		else
+			andWords(pScratch, pForward, m_pBackward, m_words);
+		pScratch[m_words - 1] &= m_lastMask;
+		return pScratch;
+	}
+
+private:
+	BitRowFilter(const BitRowFilter &);
+	BitRowFilter & operator=(const BitRowFilter &);
+
+	const BitMask & m_src;
+	int m_k;
+	int m_before;
+	int m_words;
+	ScratchBuffer<Word> m_backward;
+	Word * m_pBackward;
+	Word m_lastMask;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// column pass
+//////////////////////////////////////////////////////////////////////////
+
+template <typename T, typename RowFilter>
+static void extremeBand(const ImageViewT<T> & dst, const int y0, const int y1, const int srcRows,
+	const int k, const int before, const T identity,
+	void (*extremeRow)(T * pDst, const T * pA, const T * pB, int n), RowFilter & filterRow,
+	FrameArena * pArena)
+/*dst(y) = ext of the row filtered source rows y - before .. y - before + k - 1
+for the rows y0 .. y1 - 1, rows outside the image are identity. Blocks of k
+output rows: h is built from the bottom of the block's first window upwards into
+k row buffers, g runs down the next block in one row buffer and is combined with
+h right away. The row filtered source rows go through a ring of 2k rows, each
+one is filtered once. The buffers come from pArena if given*/
+{
+	const int cols = dst.cols();
+	const size_t pitch = alignedPitch(cols * sizeof(T)) / sizeof(T);
+
+	if (k == 1)
+	{
+		for (int y = y0; y < y1; y++)
+		{
+			const T * pRow = filterRow(dst.rowPtr(y), y);
+			if (pRow != dst.rowPtr(y))
+				memcpy(dst.rowPtr(y), pRow, cols * sizeof(T));
+		}
+		return;
+	}
+
+	ScratchBuffer<T> buf(pArena, (3 * k + 2) * pitch);
+	T * pBuf = buf.get();
+	T * pIdentity = pBuf + k * pitch;
+	T * pRunning = pIdentity + pitch;
+	T * pRing = pRunning + pitch;
+	std::fill(pIdentity, pIdentity + cols, identity);
+
+	// rows first - 2k .. next - 1 are in the ring
+	const int first = y0 - before;
+	int next = first;
+	ScratchBuffer<const T *> ring(pArena, 2 * k);
+	auto srcRow = [&](int y) -> const T *
+	{
+		if (y < 0 || y >= srcRows)
+			return pIdentity;
+		for (; next <= y; next++)
+		{
+			const int slot = (next - first) % (2 * k);
+			if (next >= 0 && next < srcRows)
+				ring[slot] = filterRow(pRing + slot * pitch, next);
+		}
+		return ring[(y - first) % (2 * k)];
+	};
+
+	ScratchBuffer<const T *> h(pArena, k);
+	for (int block = y0; block < y1; block += k)
+	{
+		const int s = block - before;
+		const int count = std::min(k, y1 - block);
+
+		h[k - 1] = srcRow(s + k - 1);
+		for (int j = k - 2; j >= 0; j--)
+		{
+			T * pH = pBuf + j * pitch;
+			extremeRow(pH, srcRow(s + j), h[j + 1], cols);
+			h[j] = pH;
+		}
+
+		memcpy(dst.rowPtr(block), h[0], cols * sizeof(T));
+		const T * pG = NULL;
+		for (int j = 1; j < count; j++)
+		{
+			if (j == 1)
+				pG = srcRow(s + k);
+			else
+			{
+				extremeRow(pRunning, pG, srcRow(s + k + j - 1), cols);
+				pG = pRunning;
+			}
+			extremeRow(dst.rowPtr(block + j), h[j], pG, cols);
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// erosion, dilation, opening and closing
+//////////////////////////////////////////////////////////////////////////
+
+template <bool IS_MAX>
+static void extremeFilter(const ImageViewT<unsigned char> & dst, const ImageViewT<const unsigned char> & src,
+	const int kernelWidth, const int kernelHeight, ThreadPool * pPool, FrameArena * pArena)
+/*both passes per band, src and dst must not overlap. Dilation uses the
+reflected rectangle*/
+{
+	const int beforeX = IS_MAX ? kernelWidth / 2 : (kernelWidth - 1) / 2;
+	const int beforeY = IS_MAX ? kernelHeight / 2 : (kernelHeight - 1) / 2;
+	const ExtremeRowFunc extremeRow = selectExtremeRow<IS_MAX>();
+
+	parallelFor(pPool, 0, dst.rows(), [&](int y0, int y1)
+	{
+		ByteRowFilter<IS_MAX> filterRow(src, kernelWidth, beforeX, pArena);
+		extremeBand<unsigned char>(dst, y0, y1, src.rows(), kernelHeight, beforeY,
+			IS_MAX ? 0 : 255, extremeRow, filterRow, pArena);
+	}, MIN_BAND_ROWS);
+}
+
+template <bool IS_OR>
+static void extremeFilter(BitMask & dst, const BitMask & src, const int kernelWidth,
+	const int kernelHeight, ThreadPool * pPool, FrameArena * pArena)
+{
+	const int beforeX = IS_OR ? kernelWidth / 2 : (kernelWidth - 1) / 2;
+	const int beforeY = IS_OR ? kernelHeight / 2 : (kernelHeight - 1) / 2;
+	const ImageViewT<Word> dstWords(dst.rowPtr(0), dst.rows(), dst.wordsPerRow(), dst.stride());
+
+	parallelFor(pPool, 0, dst.rows(), [&](int y0, int y1)
+	{
+		BitRowFilter<IS_OR> filterRow(src, kernelWidth, beforeX, pArena);
+		extremeBand<Word>(dstWords, y0, y1, src.rows(), kernelHeight, beforeY,
+			IS_OR ? 0 : ~(Word)0, IS_OR ? orWords : andWords, filterRow, pArena);
+	}, MIN_BAND_ROWS);
+}
+
+void morphology(const ImageViewT<unsigned char> & dst, const ImageViewT<const unsigned char> & src,
+	MorphologyOp op, const int kernelWidth, const int kernelHeight, ThreadPool * pPool, FrameArena * pArena)
+/*the bands read rows of the neighbouring bands, in place needs a copy of src.
+Opening and closing go through a temporary image. Neither is initialized, the
+filters write every pixel*/
+{
+	IP_PROFILE_SCOPE_IO("morphology", (long long)src.rows() * src.cols(), (long long)src.rows() * src.cols(),
+		(long long)dst.rows() * dst.cols());
+	if (dst.empty() || src.empty())
+		return;
+
+	const int kw = std::max(kernelWidth, 1);
+	const int kh = std::max(kernelHeight, 1);
+
+	const bool twoPasses = op == MORPH_OPEN || op == MORPH_CLOSE;
+	const bool inPlace = dst.data() == src.data();
+	const int pitch = (int)alignedPitch(src.cols());
+	ScratchBuffer<unsigned char> tmpBuf(pArena, twoPasses || inPlace ? (size_t)src.rows() * pitch : 0);
+	const ImageViewT<unsigned char> tmp(tmpBuf.get(), src.rows(), src.cols(), pitch);
+
+	if (twoPasses)
+	{
+		if (op == MORPH_OPEN)
+		{
+			extremeFilter<false>(tmp, src, kw, kh, pPool, pArena);
+			extremeFilter<true>(dst, tmp, kw, kh, pPool, pArena);
+		}
+		else
+		{
+			extremeFilter<true>(tmp, src, kw, kh, pPool, pArena);
+			extremeFilter<false>(dst, tmp, kw, kh, pPool, pArena);
+		}
+		return;
+	}
+
+	ImageViewT<const unsigned char> source = src;
+	if (inPlace)
+	{
+		for (int y = 0; y < src.rows(); y++)
+			memcpy(tmp.rowPtr(y), src.rowPtr(y), src.cols());
+		source = tmp;
+	}
+
+	if (op == MORPH_DILATE)
+		extremeFilter<true>(dst, source, kw, kh, pPool, pArena);
+	else
+		extremeFilter<false>(dst, source, kw, kh, pPool, pArena);
+}
+
+void morphology(BitMask & dst, const BitMask & src, MorphologyOp op,
+	const int kernelWidth, const int kernelHeight, ThreadPool * pPool, FrameArena * pArena)
+{
+	IP_PROFILE_SCOPE_IO("morphology bits", (long long)src.rows() * src.cols(), (long long)src.rows() * src.stride() * 8,
+		(long long)src.rows() * src.stride() * 8);
+	if (&dst == &src)
+	{
+		const BitMask copy(src);
+		morphology(dst, copy, op, kernelWidth, kernelHeight, pPool, pArena);
+		return;
+	}
+
+	dst.setSize(src.rows(), src.cols());
+	if (src.empty())
+		return;
+
+	const int kw = std::max(kernelWidth, 1);
+	const int kh = std::max(kernelHeight, 1);
+
+	switch (op)
+	{
+	case MORPH_ERODE:
+		extremeFilter<false>(dst, src, kw, kh, pPool, pArena);
+		break;
+	case MORPH_DILATE:
+		extremeFilter<true>(dst, src, kw, kh, pPool, pArena);
+		break;
+	case MORPH_OPEN:
+	case MORPH_CLOSE:
+		{
+			BitMask tmp(src.rows(), src.cols());
+			if (op == MORPH_OPEN)
+			{
+				extremeFilter<false>(tmp, src, kw, kh, pPool, pArena);
+				extremeFilter<true>(dst, tmp, kw, kh, pPool, pArena);
+			}
+			else
+			{
+				extremeFilter<true>(tmp, src, kw, kh, pPool, pArena);
+				extremeFilter<false>(dst, tmp, kw, kh, pPool, pArena);
+			}
+		}
+		break;
+	}
+}
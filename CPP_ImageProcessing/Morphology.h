@@ -0,0 +1,54 @@
+#ifndef __MORPHOLOGY_H__
+#define __MORPHOLOGY_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 Morphology.h
+///
+/// Erosion, dilation, opening and closing with rectangular structuring elements
+/// on 8 bit images (minimum / maximum, also for gray values) and on bit masks
+/// (AND / OR). The rectangle is separated into a row and a column pass, both
+/// with a cost per pixel that does not depend on the rectangle size.
+///
+//=================================================================================
+//=================================================================================
+
+#include "ImageProcess.h"
+#include "BitMask.h"
+
+class ThreadPool;
+class FrameArena;
+
+enum MorphologyOp
+{
+	MORPH_ERODE = 0,	// minimum (AND) over the rectangle
+	MORPH_DILATE,		// maximum (OR) over the rectangle
+	MORPH_OPEN,			// erode, then dilate: removes specks the rectangle does not fit in
+	MORPH_CLOSE			// dilate, then erode: fills holes and gaps the rectangle does not fit in
+};
+
+/*
+dst = op(src) with a kernelWidth x kernelHeight rectangle around every pixel.
+Odd sizes are centered; for even sizes erosion reaches one pixel further right
+and down, dilation one pixel further left and up (the reflected rectangle), so
+opening and closing stay idempotent. Pixels outside the image do not take part.
+The column pass uses van Herk / Gil-Werman on whole rows (SIMD minimum / maximum
+across the columns). The row pass takes log2(kernelWidth) shifted SIMD passes
+up to 128 pixels wide, van Herk / Gil-Werman within the row beyond that.
+dst and src have the same size and may be the same image. The line buffers of
+the bands and the temporary image of opening, closing and in place filtering
+come from pArena if given.
+*/
+void morphology(const ImageViewT<unsigned char> & dst, const ImageViewT<const unsigned char> & src,
+	MorphologyOp op, const int kernelWidth, const int kernelHeight, ThreadPool * pPool = NULL,
+	FrameArena * pArena = NULL);
+
+// the same on bits. The column pass is van Herk / Gil-Werman on whole words of
+// 64 columns, the row pass ORs / ANDs bit-shifted copies of the row with doubling
+// distances (log2(kernelWidth) word operations per 64 pixels). dst takes the
+// size of src and may be src. Only the line buffers come from pArena, the
+// temporary mask of opening, closing and in place filtering is a BitMask on the heap
+void morphology(BitMask & dst, const BitMask & src, MorphologyOp op,
+	const int kernelWidth, const int kernelHeight, ThreadPool * pPool = NULL, FrameArena * pArena = NULL);
+
+#endif
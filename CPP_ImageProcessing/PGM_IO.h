@@ -22,20 +22,14 @@
 #include <stdlib.h>
 #include <cstdlib>
 
-static bool readPGM( const char * fileName, unsigned char ** ppData, int & sx, int & sy )
-{
-	if( ppData == 0 )
-		return false;
-
-	FILE * fp = fopen(fileName, "rb");
-	
-	if ( 0 == fp )
-		return false;
+#include "PNM_Common.h"
+#include "ImageProcess.h"
+#include "Profiler.h"
 
-	int nGrayValues;
-	
-	char format[16];
-	fscanf(fp, "%s\n", &format);
+// reads the header of a PGM file, for P2 files fp is left at the first pixel
+static inline bool readPGMHeader( FILE * fp, char format[16], int & sx, int & sy, int & nGrayValues )
+{
+	fscanf(fp, "%15s\n", format);
 	
 	// Kommentar-Zeilen berlesen
 	char tmpCharBuf[256];
@@ -61,53 +55,145 @@ static bool readPGM( const char * fileName, unsigned char ** ppData, int & sx, i
 	const int nParamRead1 = fscanf( fp, "%d %d\n", &sx, &sy );
 	const int nParamRead2 = fscanf( fp, "%d\n", &nGrayValues );
 
-	if ( (nParamRead1 != 2) || (nParamRead2 != 1) )
+	return (nParamRead1 == 2) && (nParamRead2 == 1) && (sx > 0) && (sy > 0) &&
+		(nGrayValues > 0) && (nGrayValues <= 65535);
+}
+
+// reads an 8 bit gray image. P2 and P5 files with any maxval are accepted,
+// samples are scaled to 0..255 unless maxval is 255
+static inline bool readPGM( const char * fileName, unsigned char ** ppData, int & sx, int & sy )
+{
+	IP_PROFILE_SCOPE( "readPGM" );
+	if( ppData == 0 )
+		return false;
+
+	FILE * fp = fopen(fileName, "rb");
+	
+	if ( 0 == fp )
+		return false;
+
+	char format[16];
+	int nGrayValues;
+
+	if ( !readPGMHeader( fp, format, sx, sy, nGrayValues ) )
 	{
 		fclose(fp);
 		return false;
-	} else {
-		if ( (0 == strncmp("P2", format, 2)) && (4096 == nGrayValues) )
-		{
-			const double fact = 255./4095.;
-			*ppData = (unsigned char*)realloc(*ppData, sx*sy*sizeof(unsigned char) );
-			int idx = 0;
-			for (int y = 0; y < sy; ++y)
-			{
-				for (int x = 0; x < sx; ++x)
-				{
-					int val;
-					fscanf (fp, "%d", &val);
-					(*ppData)[idx++] = (unsigned char)floor( 0.5 + (double)val * fact );
-				}
-			}
-		}
-		else if ( (0 == strncmp("P5", format, 2)) && ( (255 == nGrayValues) || (256 == nGrayValues) ) )
+	}
+
+	const int maxSample = pnmMaxSample( format, nGrayValues );
+	const size_t numPixels = (size_t)sx * sy;
+	bool ok = false;
+
+	if ( (0 == strncmp("P5", format, 2)) && (maxSample == 255) )
+	{
+		*ppData = (unsigned char*)realloc(*ppData, numPixels*sizeof(unsigned char) );
+		fseek(fp, -(long)(numPixels*sizeof(unsigned char)), SEEK_END);
+		
+		const int readcount = (int)( fread(*ppData, sx*sizeof(unsigned char), sy, fp) );
+		ok = (sy == readcount);
+	}
+	else if ( (0 == strncmp("P2", format, 2)) || (0 == strncmp("P5", format, 2)) )
+	{
+		unsigned char * pLut = (unsigned char*)malloc( maxSample + 1 );
+		buildScaleTo8BitLut( pLut, maxSample );
+		*ppData = (unsigned char*)realloc(*ppData, numPixels*sizeof(unsigned char) );
+
+		if ( 0 == strncmp("P2", format, 2) )
 		{
-			*ppData = (unsigned char*)realloc(*ppData, sx*sy*sizeof(unsigned char) );
-			fseek(fp, -sx*sy*sizeof(unsigned char), SEEK_END);
-			
-			const int readcount = (int)( fread(*ppData, sx*sizeof(unsigned char), sy, fp) );
-			if (sy != readcount)
+			PNMTextParser parser( fp );
+			ok = true;
+			for( size_t i = 0; ok && i < numPixels; i++ )
 			{
-				fclose(fp);
-				return false;
+				unsigned int val;
+				ok = parser.nextValue( val ) && ( (int)val <= maxSample );
+				if( ok )
+					(*ppData)[i] = pLut[val];
 			}
 		}
 		else
 		{
-			fclose(fp);
-			return false;
+			unsigned short * pSamples = (unsigned short*)malloc( numPixels*sizeof(unsigned short) );
+			ok = readPNMBinarySamples( fp, pSamples, numPixels, maxSample );
+			for( size_t i = 0; ok && i < numPixels; i++ )
+				(*ppData)[i] = pLut[pSamples[i]];
+			free( pSamples );
 		}
+
+		free( pLut );
 	}
 	
 	fclose(fp);
 
+	if( ok )
+		IP_PROFILE_ADD( numPixels, numPixels, 0 );
+	return ok;
+};
+
+// reads a gray image without reducing it to 8 bit, e.g. 12 bit sensor data.
+// P2 and P5 files with any maxval, maxVal receives the largest possible sample
+static inline bool readPGM16( const char * fileName, unsigned short ** ppData, int & sx, int & sy, int & maxVal )
+{
+	if( ppData == 0 )
+		return false;
+
+	FILE * fp = fopen(fileName, "rb");
+	
+	if ( 0 == fp )
+		return false;
+
+	char format[16];
+	int nGrayValues;
+	bool ok = false;
+
+	if ( readPGMHeader( fp, format, sx, sy, nGrayValues ) )
+	{
+		maxVal = pnmMaxSample( format, nGrayValues );
+		const size_t numPixels = (size_t)sx * sy;
+
+		if ( 0 == strncmp("P2", format, 2) )
+		{
+			*ppData = (unsigned short*)realloc(*ppData, numPixels*sizeof(unsigned short) );
+			PNMTextParser parser( fp );
+			ok = parser.readValues( *ppData, numPixels, maxVal );
+		}
+		else if ( 0 == strncmp("P5", format, 2) )
+		{
+			*ppData = (unsigned short*)realloc(*ppData, numPixels*sizeof(unsigned short) );
+			ok = readPNMBinarySamples( fp, *ppData, numPixels, maxVal );
+		}
+	}
+
+	fclose(fp);
+
+	return ok;
+};
+
+// reads a gray image of any bit depth into a 16 bit image, the gray levels
+// of the image are set to the largest possible sample
+static inline bool readPGM( const char * fileName, Image16u & image )
+{
+	unsigned short * pData = 0;
+	int sx, sy, maxVal;
+
+	if( !readPGM16( fileName, &pData, sx, sy, maxVal ) )
+	{
+		free( pData );
+		return false;
+	}
+
+	image.setImageInfo( sy, sx, maxVal );
+	for( int y = 0; y < sy; y++ )
+		memcpy( image.rowPtr(y), pData + (size_t)y*sx, sx*sizeof(unsigned short) );
+
+	free( pData );
 	return true;
 };
 
 
-static bool writePGM(const char * fileName, const unsigned char * pData, const unsigned int sx, const unsigned int sy)
+static inline bool writePGM(const char * fileName, const unsigned char * pData, const unsigned int sx, const unsigned int sy)
 {
+	IP_PROFILE_SCOPE_IO( "writePGM", sx*sy, 0, sx*sy );
 	FILE* fp = fopen(fileName, "wb");
 	if( !fp )
 		return false;
@@ -125,4 +211,42 @@ static bool writePGM(const char * fileName, const unsigned char * pData, const u
 };
 
 
+// writes a 16 bit gray image as P5 with maxVal, two bytes per sample
+// (big-endian) if maxVal is above 255
+static inline bool writePGM16(const char * fileName, const unsigned short * pData, const unsigned int sx, const unsigned int sy, const int maxVal)
+{
+	const size_t numPixels = (size_t)sx * sy;
+	const size_t bytesPerSample = (maxVal > 255) ? 2 : 1;
+	unsigned char * pRaw = (unsigned char*)malloc( numPixels * bytesPerSample );
+	if( !pRaw )
+		return false;
+
+	for( size_t i = 0; i < numPixels; i++ )
+	{
+		if( bytesPerSample == 2 )
+		{
+			pRaw[2*i] = (unsigned char)( pData[i] >> 8 );
+			pRaw[2*i+1] = (unsigned char)( pData[i] & 0xff );
+		}
+		else
+			pRaw[i] = (unsigned char)pData[i];
+	}
+
+	FILE* fp = fopen(fileName, "wb");
+	if( !fp )
+	{
+		free( pRaw );
+		return false;
+	}
+
+	fprintf(fp,"P5\n%d %d\n%d\n", sx, sy, maxVal);
+
+	const bool ok = ( 1 == fwrite(pRaw, numPixels * bytesPerSample, 1, fp) );
+
+	fclose(fp);
+	free( pRaw );
+	return ok;
+};
+
+
 #endif
\ No newline at end of file
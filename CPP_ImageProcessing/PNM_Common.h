@@ -0,0 +1,169 @@
+#ifndef __PNM_COMMON_H__
+#define __PNM_COMMON_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 PNM_Common.h
+///
+/// Helpers shared by PGM_IO.h and PPM_IO.h: a buffered parser for the pixel
+/// values of ASCII PGM (P2) and PPM (P3) files, which reads the file in 64 KB
+/// blocks and converts digits by hand instead of one fscanf("%d") call per
+/// sample, and the handling of binary samples with a maxval above 255.
+///
+//=================================================================================
+//=================================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+class PNMTextParser
+{
+public:
+	// parses fp from its current position on
+	explicit PNMTextParser(FILE * fp) : m_fp(fp), m_buf(1 << 16), m_pos(0), m_len(0) {}
+
+	// next unsigned decimal number, skips whitespace and '#' comments.
+	// false at the end of the file, on other characters or values above 65535
+	bool nextValue(unsigned int & value)
+	{
+		// skip separators
+		for (;;)
+		{
+			if (m_pos == m_len && !refill())
+				return false;
+
+			const unsigned char c = m_buf[m_pos];
+			if (c == ' ' || c == '\n' || c == '\r' || c == '\t')
+				++m_pos;
+			else if (c == '#')
+				skipComment();
+			else
+				break;
+		}
+
+		unsigned int v = m_buf[m_pos] - '0';
+		if (v > 9)
+			return false;
+		++m_pos;
+
+		for (;;)
+		{
+			// digits inside the buffer
+			while (m_pos < m_len)
+			{
+				const unsigned int digit = m_buf[m_pos] - '0';
+				if (digit > 9)
+				{
+					value = v;
+					return v <= 65535;
+				}
+				v = v * 10 + digit;
+				if (v > 65535)
+					return false;
+				++m_pos;
+			}
+
+			// number continues in the next block
+			if (!refill())
+			{
+				value = v;
+				return v <= 65535;
+			}
+		}
+	}
+
+	// reads count values into pDst, false if the file ends early or a value is above maxVal
+	template <typename T>
+	bool readValues(T * pDst, size_t count, unsigned int maxVal)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			unsigned int v;
+			if (!nextValue(v) || v > maxVal)
+				return false;
+			pDst[i] = (T)v;
+		}
+		return true;
+	}
+
+private:
+	PNMTextParser(const PNMTextParser&);
+	PNMTextParser& operator=(const PNMTextParser&);
+
+	bool refill()
+	{
+		m_pos = 0;
+		m_len = fread(&m_buf[0], 1, m_buf.size(), m_fp);
+		return m_len > 0;
+	}
+
+	void skipComment()
+	{
+		for (;;)
+		{
+			while (m_pos < m_len)
+			{
+				if (m_buf[m_pos++] == '\n')
+					return;
+			}
+			if (!refill())
+				return;
+		}
+	}
+
+	FILE * m_fp;
+	std::vector<unsigned char> m_buf;
+	size_t m_pos;
+	size_t m_len;
+};
+
+// largest sample value of a file. Old P5 files give 256 gray levels instead of
+// the maximum value 255 (one byte per sample); every other maxval is taken as is
+static inline int pnmMaxSample( const char * format, int maxVal )
+{
+	return ( (0 == strncmp("P5", format, 2)) && (256 == maxVal) ) ? 255 : maxVal;
+}
+
+// reads numSamples binary samples from the end of the file, two bytes per
+// sample (big-endian) if maxSample is above 255. Fails for samples above
+// maxSample, so callers may index tables of maxSample + 1 entries with them
+static inline bool readPNMBinarySamples( FILE * fp, unsigned short * pDst, const size_t numSamples, const int maxSample )
+{
+	const size_t bytesPerSample = (maxSample > 255) ? 2 : 1;
+	unsigned char * pRaw = (unsigned char*)malloc( numSamples * bytesPerSample );
+	if( !pRaw )
+		return false;
+
+	fseek(fp, -(long)(numSamples * bytesPerSample), SEEK_END);
+	bool ok = (1 == fread(pRaw, numSamples * bytesPerSample, 1, fp));
+
+	if( ok && bytesPerSample == 2 )
+	{
+		for( size_t i = 0; i < numSamples; i++ )
+			pDst[i] = (unsigned short)( (pRaw[2*i] << 8) | pRaw[2*i+1] );
+	}
+	else if( ok )
+	{
+		for( size_t i = 0; i < numSamples; i++ )
+			pDst[i] = pRaw[i];
+	}
+
+	for( size_t i = 0; ok && i < numSamples; i++ )
+		ok = ( pDst[i] <= maxSample );
+
+	free( pRaw );
+	return ok;
+}
+
+// maps 0..maxSample to 0..255, rounded to nearest
+static inline void buildScaleTo8BitLut( unsigned char * pLut, const int maxSample )
+{
+	const double fact = 255./maxSample;
+	for( int v = 0; v <= maxSample; v++ )
+		pLut[v] = (unsigned char)floor( 0.5 + (double)v * fact );
+}
+
+#endif
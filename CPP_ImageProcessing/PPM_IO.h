@@ -16,6 +16,9 @@
 #include "math.h"
 #include "string.h"
 
+#include "PNM_Common.h"
+#include "Profiler.h"
+
 union rtcvRgbaValue
 {
 	int m_Val;
@@ -103,7 +106,20 @@ union rtcvRgbaValue
 };
 
 
-static void writePPM(const char * fileName, const rtcvRgbaValue * pImg, const int sx, const int sy, bool switchRB = false)
+// interleaved R,G,B bytes (P6 payload) to rtcvRgbaValue with alpha 255
+static inline void convertRgbToRgba(rtcvRgbaValue * pDst, const unsigned char * pRgb, const int numPixels, bool switchRB = false)
+{
+	for( int i= 0; i < numPixels; ++i )
+	{
+		pDst[i].m_r = switchRB ? pRgb[3*i+2] : pRgb[3*i];
+		pDst[i].m_g = pRgb[3*i+1];
+		pDst[i].m_b = switchRB ? pRgb[3*i] : pRgb[3*i+2];
+		pDst[i].m_a = 255;
+	}
+}
+
+
+static inline void writePPM(const char * fileName, const rtcvRgbaValue * pImg, const int sx, const int sy, bool switchRB = false)
 {
 	unsigned char * pTmpBuffer = (unsigned char*)malloc(sx*sy*3*sizeof(unsigned char));
 	for(int y = 0; y < sy; ++y)
@@ -139,14 +155,10 @@ static void writePPM(const char * fileName, const rtcvRgbaValue * pImg, const in
 }
 
 
-static bool readPPM( const char * fileName, rtcvRgbaValue ** ppImg, int & sx, int & sy, bool switchRB = false )
+// reads the header of a PPM file, for P3 files fp is left at the first pixel
+static inline bool readPPMHeader( FILE * fp, char format[16], int & sx, int & sy, int & maxVal )
 {
-	FILE * fp = fopen(fileName, "rb");
-	if( !fp )
-		return false;
-
-	char format[16];
-	fscanf(fp, "%s\n", &format); 
+	fscanf(fp, "%15s\n", format); 
 	
 	char tmpCharBuf[256];
 	
@@ -168,46 +180,116 @@ static bool readPPM( const char * fileName, rtcvRgbaValue ** ppImg, int & sx, in
 		}
 	}
 
-	int maxVal;
-
 	const int nParamRead1 = fscanf( fp, "%d %d\n", &sx, &sy );
-	const int nParamRead2 = fscanf( fp, "%d\n", &maxVal );  // 255 TODO: checken!
+	const int nParamRead2 = fscanf( fp, "%d\n", &maxVal );
 
-		
-	if ( (nParamRead1 != 2) || (nParamRead2 != 1) )
+	return (nParamRead1 == 2) && (nParamRead2 == 1) && (sx > 0) && (sy > 0) &&
+		(maxVal > 0) && (maxVal <= 65535);
+}
+
+// reads the R,G,B samples of a P3 or P6 file, maxSample as from pnmMaxSample()
+static inline bool readPPMSamples( FILE * fp, const char * format, unsigned short * pDst, const size_t numSamples, const int maxSample )
+{
+	if ( 0 == strncmp("P3", format, 2) )
 	{
-		fclose(fp);
-		return false;
+		PNMTextParser parser( fp );
+		return parser.readValues( pDst, numSamples, maxSample );
 	}
+	if ( 0 == strncmp("P6", format, 2) )
+		return readPNMBinarySamples( fp, pDst, numSamples, maxSample );
+	return false;
+}
 
-	unsigned char * pTmpBuffer = (unsigned char*)malloc(sx*sy*3*sizeof(unsigned char));
+// reads an 8 bit color image. P3 and P6 files with any maxval are accepted,
+// samples are scaled to 0..255 unless maxval is 255
+static inline bool readPPM( const char * fileName, rtcvRgbaValue ** ppImg, int & sx, int & sy, bool switchRB = false )
+{
+	IP_PROFILE_SCOPE( "readPPM" );
+	FILE * fp = fopen(fileName, "rb");
+	if( !fp )
+		return false;
 
-	*ppImg = (rtcvRgbaValue*)realloc(*ppImg, sx*sy*sizeof(rtcvRgbaValue));
-	
-	fseek(fp, (sx*sy*3*sizeof(unsigned char)), SEEK_END);
+	char format[16];
+	int maxVal;
 
-	const int readcount = fread(pTmpBuffer, sx*sy*3*sizeof(unsigned char), 1, fp);
-	if (1 !=  readcount)
+	if ( !readPPMHeader( fp, format, sx, sy, maxVal ) )
 	{
-		free( pTmpBuffer );
 		fclose(fp);
 		return false;
 	}
 
-	const int szImg = sx * sy;
-	for( int i= 0; i < szImg; ++i )
+	const int maxSample = pnmMaxSample( format, maxVal );
+	const size_t numSamples = (size_t)sx * sy * 3;
+
+	unsigned char * pTmpBuffer = (unsigned char*)malloc(numSamples*sizeof(unsigned char));
+	bool ok;
+
+	if ( (0 == strncmp("P6", format, 2)) && (maxSample == 255) )
+	{
+		fseek(fp, -(long)(numSamples*sizeof(unsigned char)), SEEK_END);
+		ok = ( 1 == fread(pTmpBuffer, numSamples*sizeof(unsigned char), 1, fp) );
+	}
+	else
+	{
+		unsigned short * pSamples = (unsigned short*)malloc( numSamples*sizeof(unsigned short) );
+		ok = readPPMSamples( fp, format, pSamples, numSamples, maxSample );
+
+		if( ok && maxSample != 255 )
+		{
+			unsigned char * pLut = (unsigned char*)malloc( maxSample + 1 );
+			buildScaleTo8BitLut( pLut, maxSample );
+			for( size_t i = 0; i < numSamples; i++ )
+				pTmpBuffer[i] = pLut[pSamples[i]];
+			free( pLut );
+		}
+		else if( ok )
+		{
+			for( size_t i = 0; i < numSamples; i++ )
+				pTmpBuffer[i] = (unsigned char)pSamples[i];
+		}
+		free( pSamples );
+	}
+
+	if( ok )
 	{
-		(*ppImg)[i].m_r = switchRB ? pTmpBuffer[3*i+2] : pTmpBuffer[3*i];
-		(*ppImg)[i].m_g = pTmpBuffer[3*i+1];
-		(*ppImg)[i].m_b = switchRB ? pTmpBuffer[3*i] : pTmpBuffer[3*i+2];
-		(*ppImg)[i].m_a = 255;
+		*ppImg = (rtcvRgbaValue*)realloc(*ppImg, sx*sy*sizeof(rtcvRgbaValue));
+		convertRgbToRgba( *ppImg, pTmpBuffer, sx * sy, switchRB );
+		IP_PROFILE_ADD( sx * sy, numSamples, 0 );
 	}
 
 	free( pTmpBuffer );
 
 	fclose(fp);
 	
-	return true;
+	return ok;
+}
+
+// reads a color image without reducing it to 8 bit. *ppRgb receives
+// interleaved R,G,B samples, maxVal the largest possible sample
+static inline bool readPPM16( const char * fileName, unsigned short ** ppRgb, int & sx, int & sy, int & maxVal )
+{
+	if( ppRgb == 0 )
+		return false;
+
+	FILE * fp = fopen(fileName, "rb");
+	if( !fp )
+		return false;
+
+	char format[16];
+	bool ok = false;
+
+	if ( readPPMHeader( fp, format, sx, sy, maxVal ) )
+	{
+		maxVal = pnmMaxSample( format, maxVal );
+		const size_t numSamples = (size_t)sx * sy * 3;
+
+		*ppRgb = (unsigned short*)realloc(*ppRgb, numSamples*sizeof(unsigned short) );
+		ok = readPPMSamples( fp, format, *ppRgb, numSamples, maxVal );
+	}
+
+	fclose(fp);
+
+	return ok;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,285 @@
+/*
+
+Scoped timers, counters and their Chrome trace / summary output
+
+*/
+
+#include <algorithm>
+#include <map>
+#include "Profiler.h"
+#include "CpuFeatures.h"
+
+static IP_THREAD_LOCAL Profiler::ThreadLog * t_pLog = NULL;
+static IP_THREAD_LOCAL ProfileScope * t_pCurrentScope = NULL;
+
+// events a thread log reserves at once, so recording rarely reallocates
+static const size_t LOG_RESERVE = 4096;
+
+//////////////////////////////////////////////////////////////////////////
+// Profiler
+//////////////////////////////////////////////////////////////////////////
+
+Profiler & Profiler::instance()
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+Profiler::Profiler()
+	: m_enabled(false), m_epoch(std::chrono::steady_clock::now())
+{
+}
+
+long long Profiler::now() const
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+Profiler::ThreadLog & Profiler::threadLog()
+/*the log of the calling thread, created on its first event. Logs stay with the
+profiler when their thread ends*/
+{
+	if (t_pLog)
+		return *t_pLog;
+
+	std::unique_ptr<ThreadLog> pLog(new ThreadLog);
+	pLog->depth = 0;
+	pLog->events.reserve(LOG_RESERVE);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	pLog->id = (int)m_logs.size();
+	pLog->name = "thread " + std::to_string(pLog->id);
+	t_pLog = pLog.get();
+	m_logs.push_back(std::move(pLog));
+	return *t_pLog;
+}
+
+void Profiler::setThreadName(const char * name)
+{
+	ThreadLog & log = threadLog();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	log.name = name;
+}
+
+void Profiler::counter(const char * name, double value)
+{
+	ThreadLog & log = threadLog();
+	const ProfileEvent event = { name, now(), -1, 0, 0, 0, value, log.depth };
+	log.events.push_back(event);
+}
+
+void Profiler::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (size_t i = 0; i < m_logs.size(); i++)
+		m_logs[i]->events.clear();
+}
+
+static void writeJsonString(FILE * fp, const std::string & s)
+{
+	fputc('"', fp);
+	for (size_t i = 0; i < s.size(); i++)
+	{
+		const char c = s[i];
+		if (c == '"' || c == '\\')
+			fprintf(fp, "\\%c", c);
+		else if ((unsigned char)c < 0x20)
+			fprintf(fp, "\\u%04x", c);
+		else
+			fputc(c, fp);
+	}
+	fputc('"', fp);
+}
+
+bool Profiler::writeChromeTrace(const char * fileName) const
+/*complete events ("X") for the scopes, counter events ("C") for the counters and
+a thread_name entry per thread. Times are in microseconds*/
+{
+	FILE * fp = fopen(fileName, "w");
+	if (!fp)
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	for (size_t t = 0; t < m_logs.size(); t++)
+	{
+		const ThreadLog & log = *m_logs[t];
+
+		fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+			first ? "" : ",\n", log.id);
+		writeJsonString(fp, log.name);
+		fprintf(fp, "}}");
+		first = false;
+
+		for (size_t i = 0; i < log.events.size(); i++)
+		{
+			const ProfileEvent & e = log.events[i];
+			fprintf(fp, ",\n{\"name\":");
+			writeJsonString(fp, e.name);
+			if (e.duration < 0)
+			{
+				fprintf(fp, ",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"value\":%g}}",
+					e.start / 1000.0, log.id, e.value);
+			}
+			else
+			{
+				fprintf(fp, ",\"cat\":\"stage\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,"
+					"\"args\":{\"pixels\":%lld,\"bytesRead\":%lld,\"bytesWritten\":%lld}}",
+					e.start / 1000.0, e.duration / 1000.0, log.id, e.pixels, e.bytesRead, e.bytesWritten);
+			}
+		}
+	}
+	fprintf(fp, "\n]}\n");
+
+	const bool ok = !ferror(fp);
+	fclose(fp);
+	return ok;
+}
+
+void Profiler::printSummary(FILE * fp) const
+/*stage times are inclusive, a scope counts the scopes inside it as well. A
+thread is busy while one of its outermost scopes runs*/
+{
+	struct StageTotal
+	{
+		long long calls;
+		long long total;
+		long long max;
+		long long pixels;
+		long long bytesRead;
+		long long bytesWritten;
+	};
+	struct CounterTotal
+	{
+		long long samples;
+		double last;
+		double min;
+		double max;
+	};
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::map<std::string, StageTotal> stages;
+	std::map<std::string, CounterTotal> counters;
+	long long begin = -1;
+	long long end = 0;
+	for (size_t t = 0; t < m_logs.size(); t++)
+	{
+		const std::vector<ProfileEvent> & events = m_logs[t]->events;
+		for (size_t i = 0; i < events.size(); i++)
+		{
+			const ProfileEvent & e = events[i];
+			if (e.duration < 0)
+			{
+				CounterTotal & c = counters[e.name];
+				if (c.samples++ == 0)
+					c.min = c.max = e.value;
+				c.last = e.value;
+				c.min = std::min(c.min, e.value);
+				c.max = std::max(c.max, e.value);
+				continue;
+			}
+
+			StageTotal & s = stages[e.name];
+			s.calls++;
+			s.total += e.duration;
+			s.max = std::max(s.max, e.duration);
+			s.pixels += e.pixels;
+			s.bytesRead += e.bytesRead;
+			s.bytesWritten += e.bytesWritten;
+			begin = begin < 0 ? e.start : std::min(begin, e.start);
+			end = std::max(end, e.start + e.duration);
+		}
+	}
+
+	// slowest stages first
+	std::vector<std::pair<long long, std::string> > order;
+	for (std::map<std::string, StageTotal>::const_iterator it = stages.begin(); it != stages.end(); ++it)
+		order.push_back(std::make_pair(-it->second.total, it->first));
+	std::sort(order.begin(), order.end());
+
+	fprintf(fp, "%-32s %7s %10s %9s %9s %9s %9s %9s\n", "stage", "calls", "total ms", "mean ms",
+		"max ms", "Mpixel/s", "MB read", "MB write");
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const StageTotal & s = stages[order[i].second];
+		const double seconds = s.total * 1e-9;
+		fprintf(fp, "%-32s %7lld %10.3f %9.3f %9.3f %9.1f %9.1f %9.1f\n", order[i].second.c_str(), s.calls,
+			s.total * 1e-6, s.total * 1e-6 / s.calls, s.max * 1e-6,
+			seconds > 0 ? s.pixels / seconds * 1e-6 : 0.0, s.bytesRead * 1e-6, s.bytesWritten * 1e-6);
+	}
+
+	const double wall = end > begin ? (double)(end - begin) : 0.0;
+	fprintf(fp, "\n%-32s %7s %10s %9s\n", "thread", "events", "busy ms", "busy %");
+	for (size_t t = 0; t < m_logs.size(); t++)
+	{
+		const ThreadLog & log = *m_logs[t];
+		long long busy = 0;
+		for (size_t i = 0; i < log.events.size(); i++)
+		{
+			if (log.events[i].duration >= 0 && log.events[i].depth == 0)
+				busy += log.events[i].duration;
+		}
+		fprintf(fp, "%-32s %7d %10.3f %9.1f\n", log.name.c_str(), (int)log.events.size(), busy * 1e-6,
+			wall > 0 ? 100.0 * busy / wall : 0.0);
+	}
+
+	if (!counters.empty())
+	{
+		fprintf(fp, "\n%-32s %7s %12s %12s %12s\n", "counter", "samples", "last", "min", "max");
+		for (std::map<std::string, CounterTotal>::const_iterator it = counters.begin(); it != counters.end(); ++it)
+		{
+			fprintf(fp, "%-32s %7lld %12g %12g %12g\n", it->first.c_str(), it->second.samples,
+				it->second.last, it->second.min, it->second.max);
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ProfileScope
+//////////////////////////////////////////////////////////////////////////
+
+ProfileScope::ProfileScope(const char * name, long long pixels, long long bytesRead,
+	long long bytesWritten)
+	: m_pLog(NULL), m_pParent(NULL)
+{
+	Profiler & profiler = Profiler::instance();
+	if (!profiler.enabled())
+		return;
+
+	m_pLog = &profiler.threadLog();
+	m_pParent = t_pCurrentScope;
+	t_pCurrentScope = this;
+
+	m_event.name = name;
+	m_event.duration = 0;
+	m_event.pixels = pixels;
+	m_event.bytesRead = bytesRead;
+	m_event.bytesWritten = bytesWritten;
+	m_event.value = 0;
+	m_event.depth = m_pLog->depth++;
+	m_event.start = profiler.now();
+}
+
+ProfileScope::~ProfileScope()
+{
+	if (!m_pLog)
+		return;
+
+	m_event.duration = Profiler::instance().now() - m_event.start;
+	m_pLog->events.push_back(m_event);
+	m_pLog->depth--;
+	t_pCurrentScope = m_pParent;
+}
+
+void ProfileScope::addToCurrent(long long pixels, long long bytesRead, long long bytesWritten)
+{
+	ProfileScope * pScope = t_pCurrentScope;
+	if (!pScope)
+		return;
+
+	pScope->m_event.pixels += pixels;
+	pScope->m_event.bytesRead += bytesRead;
+	pScope->m_event.bytesWritten += bytesWritten;
+}
@@ -0,0 +1,146 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 Profiler.h
+///
+/// Scoped timers and counters for profiling production runs without an external
+/// profiler. Every thread appends its events to a log of its own, so recording
+/// takes no lock. The events are written as Chrome trace event JSON (load it in
+/// chrome://tracing or ui.perfetto.dev) and summed up in a table per stage and
+/// per thread.
+///
+/// The IP_PROFILE_* macros only record anything if IP_ENABLE_PROFILING is
+/// defined (cmake -DIP_ENABLE_PROFILING=ON), without it they compile to nothing
+/// and their arguments are not evaluated.
+///
+//=================================================================================
+//=================================================================================
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// one timed scope or counter sample
+struct ProfileEvent
+{
+	const char * name;		// string literal
+	long long start;		// ns since the profiler was created
+	long long duration;		// ns, -1 for a counter sample
+	long long pixels;		// pixels processed
+	long long bytesRead;
+	long long bytesWritten;
+	double value;			// counter value
+	int depth;				// scopes of the same thread around this one
+};
+
+/*
+Collects the events of all threads. Recording is off until setEnabled(true), so
+a build with profiling compiled in only pays for a flag test per scope. The
+logs are read by writeChromeTrace() and printSummary(), call them (and clear())
+while no thread is recording.
+*/
+class Profiler
+{
+public:
+	static Profiler & instance();
+
+	void setEnabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+	bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+	// name of the calling thread in the trace and the summary
+	void setThreadName(const char * name);
+	// adds a sample of the counter name (a string literal)
+	void counter(const char * name, double value);
+
+	// drops all events, keeps the threads
+	void clear();
+
+	bool writeChromeTrace(const char * fileName) const;
+	// time, pixels and bytes per stage (scopes of the same name), busy time per
+	// thread and the counters
+	void printSummary(FILE * fp = stdout) const;
+
+	// for ProfileScope
+	struct ThreadLog
+	{
+		std::string name;
+		int id;
+		int depth;					// scopes currently open
+		std::vector<ProfileEvent> events;
+	};
+	ThreadLog & threadLog();
+	long long now() const;
+
+private:
+	Profiler();
+	Profiler(const Profiler &);
+	Profiler & operator=(const Profiler &);
+
+	std::atomic<bool> m_enabled;
+	std::chrono::steady_clock::time_point m_epoch;
+	mutable std::mutex m_mutex;		// guards m_logs
+	std::vector<std::unique_ptr<ThreadLog> > m_logs;
+};
+
+/*
+Times the enclosing scope. Pixels and bytes can be given up front or added
+while the scope runs (IP_PROFILE_ADD goes to the innermost scope of the thread).
+*/
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char * name, long long pixels = 0, long long bytesRead = 0,
+		long long bytesWritten = 0);
+	~ProfileScope();
+
+	static void addToCurrent(long long pixels, long long bytesRead, long long bytesWritten);
+
+private:
+	ProfileScope(const ProfileScope &);
+	ProfileScope & operator=(const ProfileScope &);
+
+	Profiler::ThreadLog * m_pLog;	// NULL if recording was off at the start
+	ProfileScope * m_pParent;
+	ProfileEvent m_event;
+};
+
+// true if this build records the IP_PROFILE_* macros
+inline bool profilingCompiledIn()
+{
+#if defined(IP_ENABLE_PROFILING)
+	return true;
+#else
+	return false;
+#endif
+}
+
+#if defined(IP_ENABLE_PROFILING)
+#define IP_PROFILE_CONCAT2(a, b) a##b
+#define IP_PROFILE_CONCAT(a, b) IP_PROFILE_CONCAT2(a, b)
+// times the rest of the enclosing scope as name (a string literal)
+#define IP_PROFILE_SCOPE(name) \
+	ProfileScope IP_PROFILE_CONCAT(ipProfileScope, __LINE__)(name)
+// the same with the pixels and bytes the scope processes
+#define IP_PROFILE_SCOPE_IO(name, pixels, bytesRead, bytesWritten) \
+	ProfileScope IP_PROFILE_CONCAT(ipProfileScope, __LINE__)(name, (long long)(pixels), \
+		(long long)(bytesRead), (long long)(bytesWritten))
+#define IP_PROFILE_ADD(pixels, bytesRead, bytesWritten) \
+	ProfileScope::addToCurrent((long long)(pixels), (long long)(bytesRead), (long long)(bytesWritten))
+#define IP_PROFILE_COUNTER(name, value) \
+	do { if (Profiler::instance().enabled()) Profiler::instance().counter(name, (double)(value)); } while (0)
+#define IP_PROFILE_THREAD_NAME(name) Profiler::instance().setThreadName(name)
+#else
+#define IP_PROFILE_SCOPE(name) ((void)0)
+#define IP_PROFILE_SCOPE_IO(name, pixels, bytesRead, bytesWritten) ((void)0)
+#define IP_PROFILE_ADD(pixels, bytesRead, bytesWritten) ((void)0)
+#define IP_PROFILE_COUNTER(name, value) ((void)0)
+#define IP_PROFILE_THREAD_NAME(name) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,471 @@
+/*
+
+Recursive (Young-van Vliet) Gaussian of any sigma
+
+*/
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "RecursiveGauss.h"
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
+#include "FrameArena.h"
+#include "Profiler.h"
+
+#if defined(IP_X86)
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+// columns filtered together by one task. Wide blocks spread the cost of a row
+// step over many columns, narrow ones give every thread a block
+static const int MIN_COLUMN_BLOCK = 64;
+static const int MAX_COLUMN_BLOCK = 1024;
+// edge length of the square tiles of the transposes and of the blocks inside
+// a tile that one kernel call transposes
+static const int TRANSPOSE_TILE = 32;
+static const int TRANSPOSE_BLOCK = 8;
+
+// elements between two rows of a float plane of cols columns
+static inline int planeStride(int cols)
+{
+	return (int)(alignedPitch(cols * sizeof(float)) / sizeof(float));
+}
+
+RecursiveGaussCoeffs recursiveGaussCoeffs(const float sigma)
+/*Young, van Vliet, van Ginkel: Recursive Gabor filtering, IEEE Trans. Signal
+Processing 50 (2002), more accurate for small sigmas than the 1995 version.
+The end matrix is from Triggs, Sdika: Boundary conditions for Young-van Vliet
+recursive filtering, IEEE Trans. Signal Processing 54 (2006). Computed in
+double, B is tiny for large sigmas*/
+{
+	const double s = std::max(sigma, RECURSIVE_GAUSS_MIN_SIGMA);
+	const double q = (s < 3.556) ? -0.2568 + 0.5784 * s + 0.0561 * s * s : 2.5091 + 0.9804 * (s - 3.556);
+	const double m0 = 1.16680;
+	const double m1 = 1.10783;
+	const double m2 = 1.40586;
+	const double scale = (m0 + q) * (m1 * m1 + m2 * m2 + 2 * m1 * q + q * q);
+
+	const double a1 = q * (2 * m0 * m1 + m1 * m1 + m2 * m2 + (2 * m0 + 4 * m1) * q + 3 * q * q) / scale;
+	const double a2 = -q * q * (m0 + 2 * m1 + 3 * q) / scale;
+	const double a3 = q * q * q / scale;
+	const double B = m0 * (m1 * m1 + m2 * m2) / scale;
+
+	RecursiveGaussCoeffs c;
+	c.B = (float)B;
+	c.a1 = (float)a1;
+	c.a2 = (float)a2;
+	c.a3 = (float)a3;
+
+	const double m = B / ((1 + a1 - a2 + a3) * (1 - a1 - a2 - a3) * (1 + a2 + (a1 - a3) * a3));
+	c.M[0] = (float)(m * (1 - a2 - a1 * a3 - a3 * a3));
+	c.M[1] = (float)(m * (a1 + a3) * (a2 + a1 * a3));
+	c.M[2] = (float)(m * a3 * (a1 + a2 * a3));
+	c.M[3] = (float)(m * (a1 + a2 * a3));
+	c.M[4] = (float)(m * (1 - a2) * (a2 + a1 * a3));
+	c.M[5] = (float)(m * a3 * (1 - a2 - a1 * a3 - a3 * a3));
+	c.M[6] = (float)(m * (a1 * a1 + a2 + a1 * a3 - a2 * a2));
+	c.M[7] = (float)(m * (a1 * a2 + a3 - a2 * a3 + a2 * a2 * a3 - a1 * a3 * a3 - a3 * a3 * a3));
+	c.M[8] = (float)(m * a3 * (a1 + a2 * a3));
+	return c;
+}
+
+// pRow[i] = B * pRow[i] + a1 * p1[i] + a2 * p2[i] + a3 * p3[i] for i < n
+typedef void (*IirRowFunc)(float * pRow, const float * p1, const float * p2, const float * p3,
+	int n, const RecursiveGaussCoeffs & c);
+
+static void iirRow_Scalar(float * pRow, const float * p1, const float * p2, const float * p3,
+	int n, const RecursiveGaussCoeffs & c)
+{
+	for (int x = 0; x < n; x++)
+		pRow[x] = c.B * pRow[x] + c.a1 * p1[x] + c.a2 * p2[x] + c.a3 * p3[x];
+}
+
+#if defined(IP_X86)
+IP_TARGET_SSE2
+static void iirRow_SSE2(float * pRow, const float * p1, const float * p2, const float * p3,
+	int n, const RecursiveGaussCoeffs & c)
+{
+	const __m128 B = _mm_set1_ps(c.B);
+	const __m128 a1 = _mm_set1_ps(c.a1);
+	const __m128 a2 = _mm_set1_ps(c.a2);
+	const __m128 a3 = _mm_set1_ps(c.a3);
+	int x = 0;
+
+	for (; x + 4 <= n; x += 4)
+	{
+		__m128 v = _mm_mul_ps(B, _mm_loadu_ps(pRow + x));
+		v = _mm_add_ps(v, _mm_mul_ps(a1, _mm_loadu_ps(p1 + x)));
+		v = _mm_add_ps(v, _mm_mul_ps(a2, _mm_loadu_ps(p2 + x)));
+		v = _mm_add_ps(v, _mm_mul_ps(a3, _mm_loadu_ps(p3 + x)));
+		_mm_storeu_ps(pRow + x, v);
+	}
+
+	iirRow_Scalar(pRow + x, p1 + x, p2 + x, p3 + x, n - x, c);
+}
+
+IP_TARGET_AVX2
+static void iirRow_AVX2(float * pRow, const float * p1, const float * p2, const float * p3,
+	int n, const RecursiveGaussCoeffs & c)
+{
+	const __m256 B = _mm256_set1_ps(c.B);
+	const __m256 a1 = _mm256_set1_ps(c.a1);
+	const __m256 a2 = _mm256_set1_ps(c.a2);
+	const __m256 a3 = _mm256_set1_ps(c.a3);
+	int x = 0;
+
+	for (; x + 8 <= n; x += 8)
+	{
+		__m256 v = _mm256_mul_ps(B, _mm256_loadu_ps(pRow + x));
+		v = _mm256_add_ps(v, _mm256_mul_ps(a1, _mm256_loadu_ps(p1 + x)));
+		v = _mm256_add_ps(v, _mm256_mul_ps(a2, _mm256_loadu_ps(p2 + x)));
+		v = _mm256_add_ps(v, _mm256_mul_ps(a3, _mm256_loadu_ps(p3 + x)));
+		_mm256_storeu_ps(pRow + x, v);
+	}
+
+	iirRow_SSE2(pRow + x, p1 + x, p2 + x, p3 + x, n - x, c);
+}
+
+#if defined(IP_HAVE_AVX512)
+IP_TARGET_AVX512
+static void iirRow_AVX512(float * pRow, const float * p1, const float * p2, const float * p3,
+	int n, const RecursiveGaussCoeffs & c)
+{
+	const __m512 B = _mm512_set1_ps(c.B);
+	const __m512 a1 = _mm512_set1_ps(c.a1);
+	const __m512 a2 = _mm512_set1_ps(c.a2);
+	const __m512 a3 = _mm512_set1_ps(c.a3);
+	int x = 0;
+
+	for (; x + 16 <= n; x += 16)
+	{
+		__m512 v = _mm512_mul_ps(B, _mm512_loadu_ps(pRow + x));
+		v = _mm512_add_ps(v, _mm512_mul_ps(a1, _mm512_loadu_ps(p1 + x)));
+		v = _mm512_add_ps(v, _mm512_mul_ps(a2, _mm512_loadu_ps(p2 + x)));
+		v = _mm512_add_ps(v, _mm512_mul_ps(a3, _mm512_loadu_ps(p3 + x)));
+		_mm512_storeu_ps(pRow + x, v);
+	}
+
+	iirRow_AVX2(pRow + x, p1 + x, p2 + x, p3 + x, n - x, c);
+}
+#endif
+#endif
+
+static IirRowFunc selectIirRow()
+/*returns the fastest row kernel the CPU supports*/
+{
+#if defined(IP_X86)
+	switch (simdLevel())
+	{
+#if defined(IP_HAVE_AVX512)
+	case SIMD_AVX512:	return iirRow_AVX512;
+#endif
+	case SIMD_AVX2:		return iirRow_AVX2;
+	case SIMD_SSE2:		return iirRow_SSE2;
+	default:			break;
+	}
+#endif
+	return iirRow_Scalar;
+}
+
+static void filterColumns(const ImageViewT<float> & img, const RecursiveGaussCoeffs & c, ThreadPool * pPool)
+/*causal pass from the top row down, then anti-causal pass from the bottom row
+up, both in place. Each row step updates a whole block of columns with one
+kernel call. The signal continues with its end values beyond both ends: the
+causal pass starts in the steady state of the first value, the anti-causal
+pass from the exact response to the last value (Triggs-Sdika)*/
+{
+	const IirRowFunc iirRow = selectIirRow();
+	const int rows = img.rows();
+
+	int blockWidth = MAX_COLUMN_BLOCK;
+	if (pPool)
+	{
+		const int perThread = (img.cols() + pPool->numThreads() - 1) / pPool->numThreads();
+		blockWidth = (perThread + MIN_COLUMN_BLOCK - 1) / MIN_COLUMN_BLOCK * MIN_COLUMN_BLOCK;
+		blockWidth = std::min(MAX_COLUMN_BLOCK, std::max(MIN_COLUMN_BLOCK, blockWidth));
+	}
+	const int numBlocks = (img.cols() + blockWidth - 1) / blockWidth;
+
+	parallelFor(pPool, 0, numBlocks, [&](int blk0, int blk1)
+	{
+		float first[MAX_COLUMN_BLOCK];
+		float last[MAX_COLUMN_BLOCK];
+		float beyond1[MAX_COLUMN_BLOCK];
+		float beyond2[MAX_COLUMN_BLOCK];
+
+		for (int blk = blk0; blk < blk1; blk++)
+		{
+			const int col0 = blk * blockWidth;
+			const int n = std::min(blockWidth, img.cols() - col0);
+
+			memcpy(first, img.rowPtr(0) + col0, n * sizeof(float));
+			memcpy(last, img.rowPtr(rows - 1) + col0, n * sizeof(float));
+			const float * p1 = first;
+			const float * p2 = first;
+			const float * p3 = first;
+			for (int y = 0; y < rows; y++)
+			{
+				float * pRow = img.rowPtr(y) + col0;
+				iirRow(pRow, p1, p2, p3, n, c);
+				p3 = p2;
+				p2 = p1;
+				p1 = pRow;
+			}
+
+			// anti-causal output of the last row and the two rows beyond it,
+			// from the deviation of the causal output from its steady state
+			float * pLastRow = img.rowPtr(rows - 1) + col0;
+			for (int x = 0; x < n; x++)
+			{
+				const float d0 = p1[x] - last[x];
+				const float d1 = p2[x] - last[x];
+				const float d2 = p3[x] - last[x];
+				pLastRow[x] = last[x] + c.M[0] * d0 + c.M[1] * d1 + c.M[2] * d2;
+				beyond1[x] = last[x] + c.M[3] * d0 + c.M[4] * d1 + c.M[5] * d2;
+				beyond2[x] = last[x] + c.M[6] * d0 + c.M[7] * d1 + c.M[8] * d2;
+			}
+
+			p1 = pLastRow;
+			p2 = beyond1;
+			p3 = beyond2;
+			for (int y = rows - 2; y >= 0; y--)
+			{
+				float * pRow = img.rowPtr(y) + col0;
+				iirRow(pRow, p1, p2, p3, n, c);
+				p3 = p2;
+				p2 = p1;
+				p1 = pRow;
+			}
+		}
+	}, 1);
+}
+
+static inline void storePixel(unsigned char & dst, const float v)
+{
+	dst = (unsigned char)std::min(255.f, std::max(0.f, v + 0.5f));
+}
+
+// pDst(x, y) = pSrc(y, x) for a TRANSPOSE_BLOCK x TRANSPOSE_BLOCK block
+template <typename S>
+struct TransposeBlockFunc
+{
+	typedef void (*Type)(float * pDst, ptrdiff_t dstStride, const S * pSrc, ptrdiff_t srcStride);
+};
+
+template <typename S>
+static void transposeBlock_Scalar(float * pDst, ptrdiff_t dstStride, const S * pSrc, ptrdiff_t srcStride)
+{
+	for (int x = 0; x < TRANSPOSE_BLOCK; x++)
+	{
+		for (int y = 0; y < TRANSPOSE_BLOCK; y++)
+			pDst[x * dstStride + y] = (float)pSrc[y * srcStride + x];
+	}
+}
+
+#if defined(IP_X86)
+IP_TARGET_SSE2
+static inline void loadRow8_SSE2(const float * p, __m128 & lo, __m128 & hi)
+{
+	lo = _mm_loadu_ps(p);
+	hi = _mm_loadu_ps(p + 4);
+}
+
+IP_TARGET_SSE2
+static inline void loadRow8_SSE2(const unsigned char * p, __m128 & lo, __m128 & hi)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)p), zero);
+	lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero));
+	hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero));
+}
+
+template <typename S>
+IP_TARGET_SSE2
+static void transposeBlock_SSE2(float * pDst, ptrdiff_t dstStride, const S * pSrc, ptrdiff_t srcStride)
+/*four 4x4 transposes, the upper right quarter of the source becomes the lower
+left one of the destination*/
+{
+	__m128 lo[8];
+	__m128 hi[8];
+	for (int y = 0; y < 8; y++)
+		loadRow8_SSE2(pSrc + y * srcStride, lo[y], hi[y]);
+
+	_MM_TRANSPOSE4_PS(lo[0], lo[1], lo[2], lo[3]);
+	_MM_TRANSPOSE4_PS(lo[4], lo[5], lo[6], lo[7]);
+	_MM_TRANSPOSE4_PS(hi[0], hi[1], hi[2], hi[3]);
+	_MM_TRANSPOSE4_PS(hi[4], hi[5], hi[6], hi[7]);
+
+	for (int x = 0; x < 4; x++)
+	{
+		_mm_storeu_ps(pDst + x * dstStride, lo[x]);
+		_mm_storeu_ps(pDst + x * dstStride + 4, lo[x + 4]);
+		_mm_storeu_ps(pDst + (x + 4) * dstStride, hi[x]);
+		_mm_storeu_ps(pDst + (x + 4) * dstStride + 4, hi[x + 4]);
+	}
+}
+
+IP_TARGET_AVX2
+static inline __m256 loadRow8_AVX2(const float * p)
+{
+	return _mm256_loadu_ps(p);
+}
+
+IP_TARGET_AVX2
+static inline __m256 loadRow8_AVX2(const unsigned char * p)
+{
+	return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p)));
+}
+
+template <typename S>
+IP_TARGET_AVX2
+static void transposeBlock_AVX2(float * pDst, ptrdiff_t dstStride, const S * pSrc, ptrdiff_t srcStride)
+/*interleaves pairs of rows, then pairs of pairs within the 128 bit lanes and
+finally swaps the lanes*/
+{
+	__m256 r[8];
+	for (int y = 0; y < 8; y++)
+		r[y] = loadRow8_AVX2(pSrc + y * srcStride);
+
+	__m256 t[8];
+	for (int i = 0; i < 8; i += 2)
+	{
+		t[i] = _mm256_unpacklo_ps(r[i], r[i + 1]);
+		t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+	}
+
+	for (int i = 0; i < 8; i += 4)
+	{
+		r[i] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+		r[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+		r[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+		r[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+	}
+
+	for (int x = 0; x < 4; x++)
+	{
+		_mm256_storeu_ps(pDst + x * dstStride, _mm256_permute2f128_ps(r[x], r[x + 4], 0x20));
+		_mm256_storeu_ps(pDst + (x + 4) * dstStride, _mm256_permute2f128_ps(r[x], r[x + 4], 0x31));
+	}
+}
+#endif
+
+template <typename S>
+static typename TransposeBlockFunc<S>::Type selectTransposeBlock()
+/*returns the fastest block kernel the CPU supports*/
+{
+#if defined(IP_X86)
+	switch (simdLevel())
+	{
+	case SIMD_AVX512:
+	case SIMD_AVX2:		return transposeBlock_AVX2<S>;
+	case SIMD_SSE2:		return transposeBlock_SSE2<S>;
+	default:			break;
+	}
+#endif
+	return transposeBlock_Scalar<S>;
+}
+
+template <typename S>
+static void transpose(const ImageViewT<float> & dst, const ImageViewT<const S> & src, ThreadPool * pPool)
+/*dst(x, y) = src(y, x) in square tiles, so neither side is walked down a
+column through the whole image. Inside a tile full blocks go to the SIMD
+kernel, the blocks cut by the right and bottom edge are copied pixel by pixel*/
+{
+	const typename TransposeBlockFunc<S>::Type transposeBlock = selectTransposeBlock<S>();
+	const int numTileRows = (src.rows() + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE;
+
+	parallelFor(pPool, 0, numTileRows, [&](int t0, int t1)
+	{
+		for (int t = t0; t < t1; t++)
+		{
+			const int y0 = t * TRANSPOSE_TILE;
+			const int y1 = std::min(src.rows(), y0 + TRANSPOSE_TILE);
+			for (int x0 = 0; x0 < src.cols(); x0 += TRANSPOSE_TILE)
+			{
+				const int x1 = std::min(src.cols(), x0 + TRANSPOSE_TILE);
+				for (int by = y0; by < y1; by += TRANSPOSE_BLOCK)
+				{
+					for (int bx = x0; bx < x1; bx += TRANSPOSE_BLOCK)
+					{
+						if (by + TRANSPOSE_BLOCK <= y1 && bx + TRANSPOSE_BLOCK <= x1)
+						{
+							transposeBlock(dst.rowPtr(bx) + by, dst.stride(), src.rowPtr(by) + bx, src.stride());
+							continue;
+						}
+
+						const int ey = std::min(y1, by + TRANSPOSE_BLOCK);
+						const int ex = std::min(x1, bx + TRANSPOSE_BLOCK);
+						for (int x = bx; x < ex; x++)
+						{
+							float * pDst = dst.rowPtr(x);
+							for (int y = by; y < ey; y++)
+								pDst[y] = (float)src.rowPtr(y)[x];
+						}
+					}
+				}
+			}
+		}
+	}, 1);
+}
+
+// float plane of rows x cols with aligned rows, not initialized
+static ImageViewT<float> scratchPlane(ScratchBuffer<float> & buffer, int rows, int cols)
+{
+	return ImageViewT<float>(buffer.get(), rows, cols, planeStride(cols));
+}
+
+void filterGaussianRecursive(const ImageViewT<float> & img, const float sigma, ThreadPool * pPool,
+	FrameArena * pArena)
+{
+	if (img.empty() || sigma < RECURSIVE_GAUSS_MIN_SIGMA)
+		return;
+
+	const RecursiveGaussCoeffs c = recursiveGaussCoeffs(sigma);
+	filterColumns(img, c, pPool);
+
+	ScratchBuffer<float> plane(pArena, (size_t)img.cols() * planeStride(img.rows()));
+	const ImageViewT<float> transposed = scratchPlane(plane, img.cols(), img.rows());
+	transpose(transposed, ImageViewT<const float>(img), pPool);
+	filterColumns(transposed, c, pPool);
+	transpose(img, ImageViewT<const float>(transposed), pPool);
+}
+
+void filterGaussianRecursive(unsigned char * pImgDst, const unsigned char * pImgSrc,
+	const int width, const int height, const float sigma, ThreadPool * pPool, FrameArena * pArena)
+/*rows first: the conversion to float is part of the first transpose and the
+rounding to 8 bit needs no transpose at the end*/
+{
+	IP_PROFILE_SCOPE_IO("filterGaussianRecursive", width * height, width * height, width * height);
+	if (width <= 0 || height <= 0)
+		return;
+	if (sigma < RECURSIVE_GAUSS_MIN_SIGMA)
+	{
+		memmove(pImgDst, pImgSrc, (size_t)width * height);
+		return;
+	}
+
+	const RecursiveGaussCoeffs c = recursiveGaussCoeffs(sigma);
+
+	ScratchBuffer<float> transposedPlane(pArena, (size_t)width * planeStride(height));
+	const ImageViewT<float> transposed = scratchPlane(transposedPlane, width, height);
+	transpose(transposed, ImageViewT<const unsigned char>(pImgSrc, height, width, width), pPool);
+	filterColumns(transposed, c, pPool);
+
+	ScratchBuffer<float> workPlane(pArena, (size_t)height * planeStride(width));
+	const ImageViewT<float> work = scratchPlane(workPlane, height, width);
+	transpose(work, ImageViewT<const float>(transposed), pPool);
+	filterColumns(work, c, pPool);
+
+	parallelFor(pPool, 0, height, [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; y++)
+		{
+			const float * pRow = work.rowPtr(y);
+			unsigned char * pDst = pImgDst + (size_t)y * width;
+			for (int x = 0; x < width; x++)
+				storePixel(pDst[x], pRow[x]);
+		}
+	}, MIN_BAND_ROWS);
+}
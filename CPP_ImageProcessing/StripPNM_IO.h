@@ -0,0 +1,274 @@
+#ifndef __STRIP_PNM_IO_H__
+#define __STRIP_PNM_IO_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 StripPNM_IO.h
+///
+/// Reading and writing binary PGM (P5) and PPM (P6) files a strip of rows at a
+/// time, for images that do not fit into memory. StripIterator walks a file in
+/// strips and keeps halo rows above and below every strip for neighborhood
+/// filters. Rows are rowBytes() apart without padding; samples of files with a
+/// maxVal above 255 take two bytes, big-endian, as in the file.
+///
+//=================================================================================
+//=================================================================================
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+class PNMStripReader
+{
+public:
+	PNMStripReader() : m_fp(0), m_sx(0), m_sy(0), m_maxVal(0), m_channels(0), m_nextRow(0) {}
+	~PNMStripReader() { close(); }
+
+	// opens fileName and reads its header, false if it is no P5/P6 file
+	bool open(const char * fileName)
+	{
+		close();
+
+		m_fp = fopen(fileName, "rb");
+		if (!m_fp)
+			return false;
+		setvbuf(m_fp, 0, _IOFBF, 1 << 20);
+
+		const int c0 = fgetc(m_fp);
+		const int c1 = fgetc(m_fp);
+		if (c0 != 'P' || (c1 != '5' && c1 != '6'))
+		{
+			close();
+			return false;
+		}
+		m_channels = (c1 == '5') ? 1 : 3;
+
+		if (!readNumber(m_sx) || !readNumber(m_sy) || !readNumber(m_maxVal) ||
+			m_sx <= 0 || m_sy <= 0 || m_maxVal <= 0 || m_maxVal > 65535)
+		{
+			close();
+			return false;
+		}
+
+		// exactly one whitespace character separates header and payload
+		(void)fgetc(m_fp);
+		m_nextRow = 0;
+		return true;
+	}
+
+	void close()
+	{
+		if (m_fp)
+			fclose(m_fp);
+		m_fp = 0;
+	}
+
+	int width() const { return m_sx; }
+	int height() const { return m_sy; }
+	int maxVal() const { return m_maxVal; }
+	int channels() const { return m_channels; }
+	size_t rowBytes() const { return (size_t)m_sx * m_channels * (m_maxVal > 255 ? 2 : 1); }
+
+	// image row that the next readRows() starts with
+	int nextRow() const { return m_nextRow; }
+
+	// reads up to numRows rows into pDst, returns the number of rows read
+	int readRows(unsigned char * pDst, int numRows)
+	{
+		if (!m_fp)
+			return 0;
+		if (numRows > m_sy - m_nextRow)
+			numRows = m_sy - m_nextRow;
+		if (numRows <= 0)
+			return 0;
+
+		const int rowsRead = (int)fread(pDst, rowBytes(), numRows, m_fp);
+		m_nextRow += rowsRead;
+		return rowsRead;
+	}
+
+private:
+	PNMStripReader(const PNMStripReader&);
+	PNMStripReader& operator=(const PNMStripReader&);
+
+	// skips whitespace and '#' comment lines, then reads a decimal number
+	bool readNumber(int & value)
+	{
+		int c = fgetc(m_fp);
+		for (;;)
+		{
+			while (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+				c = fgetc(m_fp);
+			if (c != '#')
+				break;
+			while (c != '\n' && c != EOF)
+				c = fgetc(m_fp);
+		}
+
+		if (c < '0' || c > '9')
+			return false;
+
+		long long v = 0;
+		while (c >= '0' && c <= '9')
+		{
+			v = v * 10 + (c - '0');
+			if (v > 0x7fffffff)
+				return false;
+			c = fgetc(m_fp);
+		}
+		ungetc(c, m_fp);
+
+		value = (int)v;
+		return true;
+	}
+
+	FILE * m_fp;
+	int m_sx;
+	int m_sy;
+	int m_maxVal;
+	int m_channels;
+	int m_nextRow;
+};
+
+
+class PNMStripWriter
+{
+public:
+	PNMStripWriter() : m_fp(0), m_sy(0), m_rowBytes(0), m_rowsWritten(0) {}
+	~PNMStripWriter() { close(); }
+
+	// creates fileName and writes a P5 (channels 1) or P6 (channels 3) header
+	bool open(const char * fileName, int sx, int sy, int channels = 1, int maxVal = 255)
+	{
+		close();
+
+		m_fp = fopen(fileName, "wb");
+		if (!m_fp)
+			return false;
+		setvbuf(m_fp, 0, _IOFBF, 1 << 20);
+
+		fprintf(m_fp, "P%c\n%d %d\n%d\n", channels == 3 ? '6' : '5', sx, sy, maxVal);
+
+		m_sy = sy;
+		m_rowBytes = (size_t)sx * channels * (maxVal > 255 ? 2 : 1);
+		m_rowsWritten = 0;
+		return true;
+	}
+
+	// appends numRows rows, rows are rowBytes() apart in pSrc
+	bool writeRows(const unsigned char * pSrc, int numRows)
+	{
+		if (!m_fp || numRows > m_sy - m_rowsWritten)
+			return false;
+		if (numRows <= 0)
+			return true;
+
+		if ((size_t)numRows != fwrite(pSrc, m_rowBytes, numRows, m_fp))
+			return false;
+
+		m_rowsWritten += numRows;
+		return true;
+	}
+
+	// false if the file could not be written completely
+	bool close()
+	{
+		if (!m_fp)
+			return false;
+
+		const bool ok = (0 == fclose(m_fp)) && m_rowsWritten == m_sy;
+		m_fp = 0;
+		return ok;
+	}
+
+	size_t rowBytes() const { return m_rowBytes; }
+
+private:
+	PNMStripWriter(const PNMStripWriter&);
+	PNMStripWriter& operator=(const PNMStripWriter&);
+
+	FILE * m_fp;
+	int m_sy;
+	size_t m_rowBytes;
+	int m_rowsWritten;
+};
+
+
+// Walks a PNMStripReader in strips of stripRows rows. Every strip comes with up
+// to haloRows rows above and below it (fewer at the top and bottom of the image).
+// Only stripRows + 2*haloRows rows are held in memory.
+class StripIterator
+{
+public:
+	StripIterator(PNMStripReader & reader, int stripRows, int haloRows = 0)
+		: m_reader(reader), m_stripRows(stripRows > 0 ? stripRows : 1),
+		m_haloRows(haloRows > 0 ? haloRows : 0), m_bufFirstRow(0), m_bufNumRows(0),
+		m_firstRow(0), m_numRows(0)
+	{
+		m_buffer.resize((size_t)(m_stripRows + 2 * m_haloRows) * m_reader.rowBytes());
+	}
+
+	// loads the next strip and its halo rows, false after the last strip
+	bool next()
+	{
+		const int height = m_reader.height();
+		const int firstRow = m_firstRow + m_numRows;
+		if (firstRow >= height)
+			return false;
+
+		const int lastRow = std::min(height, firstRow + m_stripRows);
+		const int needFirst = std::max(0, firstRow - m_haloRows);
+		const int needEnd = std::min(height, lastRow + m_haloRows);
+		const size_t rowBytes = m_reader.rowBytes();
+
+		// keep the rows still needed as halo, drop the ones above
+		const int drop = std::min(m_bufNumRows, std::max(0, needFirst - m_bufFirstRow));
+		if (drop > 0)
+		{
+			memmove(&m_buffer[0], &m_buffer[drop * rowBytes], (m_bufNumRows - drop) * rowBytes);
+			m_bufFirstRow += drop;
+			m_bufNumRows -= drop;
+		}
+		if (m_bufNumRows == 0)
+			m_bufFirstRow = needFirst;
+
+		const int missing = needEnd - (m_bufFirstRow + m_bufNumRows);
+		if (missing > 0)
+		{
+			if (missing != m_reader.readRows(&m_buffer[m_bufNumRows * rowBytes], missing))
+				return false;
+			m_bufNumRows += missing;
+		}
+
+		m_firstRow = firstRow;
+		m_numRows = lastRow - firstRow;
+		return true;
+	}
+
+	int firstRow() const { return m_firstRow; }		// image row of the first strip row
+	int numRows() const { return m_numRows; }		// rows of the strip without halo
+	int haloAbove() const { return m_firstRow - m_bufFirstRow; }
+	int haloBelow() const { return m_bufFirstRow + m_bufNumRows - m_firstRow - m_numRows; }
+
+	// row i of the strip, -haloAbove() <= i < numRows() + haloBelow()
+	const unsigned char * rowPtr(int i) const
+	{
+		return &m_buffer[(size_t)(i + haloAbove()) * m_reader.rowBytes()];
+	}
+
+private:
+	StripIterator(const StripIterator&);
+	StripIterator& operator=(const StripIterator&);
+
+	PNMStripReader & m_reader;
+	const int m_stripRows;
+	const int m_haloRows;
+	std::vector<unsigned char> m_buffer;
+	int m_bufFirstRow;	// image row of the first buffered row
+	int m_bufNumRows;
+	int m_firstRow;
+	int m_numRows;
+};
+
+#endif
@@ -0,0 +1,125 @@
+/*
+
+Thread pool for band-parallel image kernels
+
+*/
+
+#include <string>
+#include "ThreadPool.h"
+#include "CpuFeatures.h"
+#include "Profiler.h"
+
+// pool whose band the calling thread is running, NULL outside of bands
+static IP_THREAD_LOCAL const ThreadPool * t_pRunningPool = NULL;
+
+ThreadPool::ThreadPool(int numThreads)
+	: m_pJob(NULL), m_begin(0), m_end(0), m_bandSize(0), m_numBands(0), m_generation(0),
+	m_activeWorkers(0), m_quit(false), m_nextBand(0)
+{
+	if (numThreads <= 0)
+		numThreads = (int)std::thread::hardware_concurrency();
+	if (numThreads <= 0)
+		numThreads = 1;
+
+	for (int i = 1; i < numThreads; i++)
+		m_workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i].join();
+}
+
+void ThreadPool::parallelFor(int begin, int end, const std::function<void(int, int)>& fn,
+	int minBandSize)
+/*splits [begin, end) into up to 4 bands per thread, so that uneven bands balance
+out. Called from a band of this pool, the job runs on the calling thread: the
+pool is busy with the outer job and waiting for it would never end*/
+{
+	if (begin >= end)
+		return;
+
+	const int count = end - begin;
+	if (minBandSize < 1)
+		minBandSize = 1;
+
+	int numBands = numThreads() * 4;
+	if (numBands > count / minBandSize)
+		numBands = count / minBandSize;
+	if (numBands <= 1 || m_workers.empty() || t_pRunningPool == this)
+	{
+		fn(begin, end);
+		return;
+	}
+
+	std::lock_guard<std::mutex> callLock(m_callMutex);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pJob = &fn;
+		m_begin = begin;
+		m_end = end;
+		m_bandSize = (count + numBands - 1) / numBands;
+		m_numBands = (count + m_bandSize - 1) / m_bandSize;
+		m_nextBand = 0;
+		m_activeWorkers = (int)m_workers.size();
+		m_generation++;
+	}
+	m_wake.notify_all();
+
+	runBands();
+
+	// wait until every worker has left this job before fn goes out of scope
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (m_activeWorkers > 0)
+		m_done.wait(lock);
+	m_pJob = NULL;
+}
+
+void ThreadPool::runBands()
+/*takes bands of the current job until none are left*/
+{
+	const ThreadPool * pOuterPool = t_pRunningPool;
+	t_pRunningPool = this;
+	for (int band = m_nextBand++; band < m_numBands; band = m_nextBand++)
+	{
+		const int bandBegin = m_begin + band * m_bandSize;
+		int bandEnd = bandBegin + m_bandSize;
+		if (bandEnd > m_end)
+			bandEnd = m_end;
+		// shows the activity of every thread in the trace
+		IP_PROFILE_SCOPE("parallelFor band");
+		(*m_pJob)(bandBegin, bandEnd);
+	}
+	t_pRunningPool = pOuterPool;
+}
+
+void ThreadPool::workerLoop(int index)
+{
+	IP_PROFILE_THREAD_NAME(("ThreadPool worker " + std::to_string(index)).c_str());
+	unsigned int seenGeneration = 0;
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while (!m_quit && m_generation == seenGeneration)
+				m_wake.wait(lock);
+			if (m_quit)
+				return;
+			seenGeneration = m_generation;
+		}
+
+		runBands();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_activeWorkers == 0)
+			m_done.notify_one();
+	}
+}
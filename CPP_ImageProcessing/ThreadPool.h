@@ -0,0 +1,76 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 ThreadPool.h
+///
+/// Fixed set of worker threads for band-parallel image kernels. parallelFor()
+/// splits a row range into bands and blocks until all bands are done; the
+/// calling thread works on bands as well.
+///
+//=================================================================================
+//=================================================================================
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+class ThreadPool
+{
+public:
+	// numThreads <= 0 uses one thread per hardware thread
+	explicit ThreadPool(int numThreads = 0);
+	~ThreadPool();
+
+	// total number of threads working on a parallelFor, including the caller
+	int numThreads() const { return (int)m_workers.size() + 1; }
+
+	// calls fn(bandBegin, bandEnd) for consecutive bands covering [begin, end),
+	// every band has at least minBandSize elements (except a shorter last one).
+	// A parallelFor of the same pool inside fn runs on the calling thread alone
+	void parallelFor(int begin, int end, const std::function<void(int, int)>& fn,
+		int minBandSize = 1);
+
+private:
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+	void workerLoop(int index);	// index 1 .. numThreads() - 1, the caller is 0
+	void runBands();
+
+	std::vector<std::thread> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	std::mutex m_callMutex;	// one parallelFor at a time
+
+	// current job, guarded by m_mutex
+	const std::function<void(int, int)> * m_pJob;
+	int m_begin;
+	int m_end;
+	int m_bandSize;
+	int m_numBands;
+	unsigned int m_generation;
+	int m_activeWorkers;
+	bool m_quit;
+	std::atomic<int> m_nextBand;
+};
+
+// minBandSize of the row-band kernels, bands smaller than this are not worth a thread
+static const int MIN_BAND_ROWS = 8;
+
+// runs fn over [begin, end) on pool, or directly on the calling thread if pool is NULL
+inline void parallelFor(ThreadPool * pPool, int begin, int end,
+	const std::function<void(int, int)>& fn, int minBandSize = 1)
+{
+	if (pPool)
+		pPool->parallelFor(begin, end, fn, minBandSize);
+	else if (begin < end)
+		fn(begin, end);
+}
+
+#endif
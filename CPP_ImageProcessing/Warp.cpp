@@ -0,0 +1,322 @@
+/*
+
+Tiled affine resampling by inverse mapping
+
+*/
+
+#include <math.h>
+#include <algorithm>
+#include "Warp.h"
+#include "ThreadPool.h"
+
+// edge length of the square output tiles, a tile of source and destination
+// pixels stays in the L1/L2 cache for every rotation angle
+static const int WARP_TILE = 64;
+// fraction bits of the source positions
+static const int COORD_BITS = 16;
+// fraction bits of the interpolation weights
+static const int WEIGHT_BITS = 8;
+static const int WEIGHT_ONE = 1 << WEIGHT_BITS;
+
+/*
+Catmull-Rom weights of the four taps x0 - 1 .. x0 + 2 for the WEIGHT_ONE
+fractions of a pixel. A namespace scope object, initialized before main().
+*/
+struct CubicWeights
+{
+	float w[WEIGHT_ONE][4];
+
+	CubicWeights()
+	{
+		for (int f = 0; f < WEIGHT_ONE; f++)
+		{
+			const float t = (float)f / WEIGHT_ONE;
+			w[f][0] = ((-0.5f * t + 1.f) * t - 0.5f) * t;
+			w[f][1] = (1.5f * t - 2.5f) * t * t + 1.f;
+			w[f][2] = ((-1.5f * t + 2.f) * t + 0.5f) * t;
+			w[f][3] = (0.5f * t - 0.5f) * t * t;
+		}
+	}
+};
+static const CubicWeights s_cubic;
+
+static inline void saturate(unsigned char & dst, const float v)
+{
+	dst = (unsigned char)std::min(255.f, std::max(0.f, v + 0.5f));
+}
+
+static inline void saturate(unsigned short & dst, const float v)
+{
+	dst = (unsigned short)std::min(65535.f, std::max(0.f, v + 0.5f));
+}
+
+static inline void saturate(float & dst, const float v)
+{
+	dst = v;
+}
+
+// bilinear mix with weights fx, fy in 1/WEIGHT_ONE, integer pixels round.
+// 16 bit pixels times WEIGHT_ONE^2 still fit into unsigned int
+template <typename T>
+static inline T bilinear(const T a, const T b, const T c, const T d, const int fx, const int fy)
+{
+	const unsigned int top = (unsigned int)a * (WEIGHT_ONE - fx) + (unsigned int)b * fx;
+	const unsigned int bottom = (unsigned int)c * (WEIGHT_ONE - fx) + (unsigned int)d * fx;
+	return (T)((top * (WEIGHT_ONE - fy) + bottom * fy + (WEIGHT_ONE * WEIGHT_ONE / 2)) >> (2 * WEIGHT_BITS));
+}
+
+static inline float bilinear(const float a, const float b, const float c, const float d, const int fx, const int fy)
+{
+	const float wx = (float)fx / WEIGHT_ONE;
+	const float wy = (float)fy / WEIGHT_ONE;
+	const float top = a + (b - a) * wx;
+	const float bottom = c + (d - c) * wx;
+	return top + (bottom - top) * wy;
+}
+
+// true if all taps of the interpolation at (sx, sy) lie inside a w x h image
+template <InterpolationMode mode>
+static inline bool tapsInside(const long long sx, const long long sy, const int w, const int h)
+{
+	if (mode == INTERPOLATION_NEAREST)
+	{
+		const long long half = 1LL << (COORD_BITS - 1);
+		const long long nx = (sx + half) >> COORD_BITS;
+		const long long ny = (sy + half) >> COORD_BITS;
+		return nx >= 0 && nx < w && ny >= 0 && ny < h;
+	}
+
+	const long long x0 = sx >> COORD_BITS;
+	const long long y0 = sy >> COORD_BITS;
+	if (mode == INTERPOLATION_BILINEAR)
+		return x0 >= 0 && x0 + 1 < w && y0 >= 0 && y0 + 1 < h;
+	return x0 >= 1 && x0 + 2 < w && y0 >= 1 && y0 + 2 < h;
+}
+
+template <typename T, InterpolationMode mode>
+static T samplePixel(const long long sx, const long long sy, const ImageViewT<const T> & src)
+/*one pixel near or outside the border: 0 without a nearest source pixel,
+taps outside the image repeat the border pixels*/
+{
+	const long long half = 1LL << (COORD_BITS - 1);
+	const int w = src.cols();
+	const int h = src.rows();
+
+	const long long nx = (sx + half) >> COORD_BITS;
+	const long long ny = (sy + half) >> COORD_BITS;
+	if (nx < 0 || nx >= w || ny < 0 || ny >= h)
+		return 0;
+	if (mode == INTERPOLATION_NEAREST)
+		return src.rowPtr((int)ny)[nx];
+
+	const int x0 = (int)(sx >> COORD_BITS);
+	const int y0 = (int)(sy >> COORD_BITS);
+	const int fx = (int)((sx >> (COORD_BITS - WEIGHT_BITS)) & (WEIGHT_ONE - 1));
+	const int fy = (int)((sy >> (COORD_BITS - WEIGHT_BITS)) & (WEIGHT_ONE - 1));
+
+	if (mode == INTERPOLATION_BILINEAR)
+	{
+		const int xa = std::min(w - 1, std::max(0, x0));
+		const int xb = std::min(w - 1, std::max(0, x0 + 1));
+		const T * pTop = src.rowPtr(std::min(h - 1, std::max(0, y0)));
+		const T * pBottom = src.rowPtr(std::min(h - 1, std::max(0, y0 + 1)));
+		return bilinear(pTop[xa], pTop[xb], pBottom[xa], pBottom[xb], fx, fy);
+	}
+
+	const float * wx = s_cubic.w[fx];
+	const float * wy = s_cubic.w[fy];
+	int xs[4];
+	for (int j = 0; j < 4; j++)
+		xs[j] = std::min(w - 1, std::max(0, x0 - 1 + j));
+
+	float sum = 0;
+	for (int k = 0; k < 4; k++)
+	{
+		const T * p = src.rowPtr(std::min(h - 1, std::max(0, y0 - 1 + k)));
+		sum += wy[k] * (wx[0] * p[xs[0]] + wx[1] * p[xs[1]] + wx[2] * p[xs[2]] + wx[3] * p[xs[3]]);
+	}
+	T result;
+	saturate(result, sum);
+	return result;
+}
+
+template <typename T, InterpolationMode mode>
+static void warpRow(T * pDst, const int n, const long long sx, const long long sy, const long long dx,
+	const long long dy, const ImageViewT<const T> & srcView)
+/*n pixels of one output row, the source position starts at (sx, sy) and
+advances by (dx, dy) per pixel, all in COORD_BITS fixed point. The positions
+are on a line, so the pixels with all taps inside the image are one run
+[xBegin, xEnd): only the pixels before and after it need the border checks.
+The view is copied, stores through an 8 bit pDst could alias it otherwise*/
+{
+	const ImageViewT<const T> src = srcView;
+	const int w = src.cols();
+	const int h = src.rows();
+
+	int xBegin = 0;
+	while (xBegin < n && !tapsInside<mode>(sx + xBegin * dx, sy + xBegin * dy, w, h))
+		xBegin++;
+	int xEnd = n;
+	while (xEnd > xBegin && !tapsInside<mode>(sx + (xEnd - 1) * dx, sy + (xEnd - 1) * dy, w, h))
+		xEnd--;
+
+	for (int x = 0; x < xBegin; x++)
+		pDst[x] = samplePixel<T, mode>(sx + x * dx, sy + x * dy, src);
+
+	const T * const pSrc = src.data();
+	const ptrdiff_t stride = src.stride();
+	long long px = sx + xBegin * dx;
+	long long py = sy + xBegin * dy;
+
+	if (mode == INTERPOLATION_NEAREST)
+	{
+		const long long half = 1LL << (COORD_BITS - 1);
+		for (int x = xBegin; x < xEnd; x++, px += dx, py += dy)
+			pDst[x] = pSrc[((py + half) >> COORD_BITS) * stride + ((px + half) >> COORD_BITS)];
+	}
+	else if (mode == INTERPOLATION_BILINEAR)
+	{
+		for (int x = xBegin; x < xEnd; x++, px += dx, py += dy)
+		{
+			const T * p = pSrc + (py >> COORD_BITS) * stride + (px >> COORD_BITS);
+			const int fx = (int)(px >> (COORD_BITS - WEIGHT_BITS)) & (WEIGHT_ONE - 1);
+			const int fy = (int)(py >> (COORD_BITS - WEIGHT_BITS)) & (WEIGHT_ONE - 1);
+			pDst[x] = bilinear(p[0], p[1], p[stride], p[stride + 1], fx, fy);
+		}
+	}
+	else
+	{
+		for (int x = xBegin; x < xEnd; x++, px += dx, py += dy)
+		{
+			// 4x4 taps from (x0 - 1, y0 - 1)
+			const T * p = pSrc + ((py >> COORD_BITS) - 1) * stride + (px >> COORD_BITS) - 1;
+			const float * wx = s_cubic.w[(int)(px >> (COORD_BITS - WEIGHT_BITS)) & (WEIGHT_ONE - 1)];
+			const float * wy = s_cubic.w[(int)(py >> (COORD_BITS - WEIGHT_BITS)) & (WEIGHT_ONE - 1)];
+			float sum = 0;
+			for (int k = 0; k < 4; k++, p += stride)
+				sum += wy[k] * (wx[0] * p[0] + wx[1] * p[1] + wx[2] * p[2] + wx[3] * p[3]);
+			saturate(pDst[x], sum);
+		}
+	}
+
+	for (int x = xEnd; x < n; x++)
+		pDst[x] = samplePixel<T, mode>(sx + x * dx, sy + x * dy, src);
+}
+
+static inline long long toFixed(const double v)
+{
+	return (long long)floor(v * (1LL << COORD_BITS) + 0.5);
+}
+
+template <typename T>
+static void warpAffineT(const ImageViewT<T> & dst, const ImageViewT<const T> & src, const double m[6],
+	InterpolationMode mode, ThreadPool * pPool)
+/*the start of every tile row is computed in double, the pixels of the row
+are stepped in fixed point, so the rounding error of the steps cannot add up
+over more than WARP_TILE pixels*/
+{
+	if (dst.empty())
+		return;
+
+	const int tilesX = (dst.cols() + WARP_TILE - 1) / WARP_TILE;
+	const int tilesY = (dst.rows() + WARP_TILE - 1) / WARP_TILE;
+	const long long dx = toFixed(m[0]);
+	const long long dy = toFixed(m[3]);
+
+	parallelFor(pPool, 0, tilesX * tilesY, [&](int t0, int t1)
+	{
+		for (int t = t0; t < t1; t++)
+		{
+			const int x0 = (t % tilesX) * WARP_TILE;
+			const int y0 = (t / tilesX) * WARP_TILE;
+			const int x1 = std::min(dst.cols(), x0 + WARP_TILE);
+			const int y1 = std::min(dst.rows(), y0 + WARP_TILE);
+
+			for (int y = y0; y < y1; y++)
+			{
+				T * pDst = dst.rowPtr(y) + x0;
+				if (src.empty())
+				{
+					std::fill(pDst, pDst + (x1 - x0), (T)0);
+					continue;
+				}
+				const long long sx = toFixed(m[0] * x0 + m[1] * y + m[2]);
+				const long long sy = toFixed(m[3] * x0 + m[4] * y + m[5]);
+				switch (mode)
+				{
+				case INTERPOLATION_NEAREST:
+					warpRow<T, INTERPOLATION_NEAREST>(pDst, x1 - x0, sx, sy, dx, dy, src);
+					break;
+				case INTERPOLATION_BILINEAR:
+					warpRow<T, INTERPOLATION_BILINEAR>(pDst, x1 - x0, sx, sy, dx, dy, src);
+					break;
+				default:
+					warpRow<T, INTERPOLATION_BICUBIC>(pDst, x1 - x0, sx, sy, dx, dy, src);
+					break;
+				}
+			}
+		}
+	}, 1);
+}
+
+void warpAffine(const ImageViewT<unsigned char> & dst, const ImageViewT<const unsigned char> & src,
+	const double m[6], InterpolationMode mode, ThreadPool * pPool)
+{
+	warpAffineT(dst, src, m, mode, pPool);
+}
+
+void warpAffine(const ImageViewT<unsigned short> & dst, const ImageViewT<const unsigned short> & src,
+	const double m[6], InterpolationMode mode, ThreadPool * pPool)
+{
+	warpAffineT(dst, src, m, mode, pPool);
+}
+
+void warpAffine(const ImageViewT<float> & dst, const ImageViewT<const float> & src,
+	const double m[6], InterpolationMode mode, ThreadPool * pPool)
+{
+	warpAffineT(dst, src, m, mode, pPool);
+}
+
+void rotationMap(double m[6], const double angleDegrees, const int rows, const int cols)
+/*ImageT::rotateImage moved the pixel (r, c) to
+	r' = r0 + (r - r0) * cos - (c - c0) * sin
+	c' = c0 + (r - r0) * sin + (c - c0) * cos
+the inverse rotation takes (c', r') back to (c, r)*/
+{
+	const double rads = angleDegrees * 3.14159265358979323846 / 180.0;
+	const double cosA = cos(rads);
+	const double sinA = sin(rads);
+	const double r0 = rows / 2;
+	const double c0 = cols / 2;
+
+	m[0] = cosA;
+	m[1] = -sinA;
+	m[2] = c0 - cosA * c0 + sinA * r0;
+	m[3] = sinA;
+	m[4] = cosA;
+	m[5] = r0 - sinA * c0 - cosA * r0;
+}
+
+void rotateImage(const ImageViewT<unsigned char> & dst, const ImageViewT<const unsigned char> & src,
+	const double angleDegrees, InterpolationMode mode, ThreadPool * pPool)
+{
+	double m[6];
+	rotationMap(m, angleDegrees, src.rows(), src.cols());
+	warpAffineT(dst, src, m, mode, pPool);
+}
+
+void rotateImage(const ImageViewT<unsigned short> & dst, const ImageViewT<const unsigned short> & src,
+	const double angleDegrees, InterpolationMode mode, ThreadPool * pPool)
+{
+	double m[6];
+	rotationMap(m, angleDegrees, src.rows(), src.cols());
+	warpAffineT(dst, src, m, mode, pPool);
+}
+
+void rotateImage(const ImageViewT<float> & dst, const ImageViewT<const float> & src,
+	const double angleDegrees, InterpolationMode mode, ThreadPool * pPool)
+{
+	double m[6];
+	rotationMap(m, angleDegrees, src.rows(), src.cols());
+	warpAffineT(dst, src, m, mode, pPool);
+}
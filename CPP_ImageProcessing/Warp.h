@@ -0,0 +1,47 @@
+#ifndef __WARP_H__
+#define __WARP_H__
+//=================================================================================
+//=================================================================================
+///
+/// \file	 Warp.h
+///
+/// Affine resampling of 8 bit, 16 bit and float images by inverse mapping:
+/// every output pixel looks up its source position, so there are no holes.
+/// Source positions are stepped along the rows in 48.16 fixed point, the
+/// output is processed in square tiles that are distributed over the threads.
+///
+//=================================================================================
+//=================================================================================
+
+#include "ImageProcess.h"
+
+class ThreadPool;
+
+/*
+Output pixel (x, y) (column, row) is sampled at source position
+	sx = m[0] * x + m[1] * y + m[2]
+	sy = m[3] * x + m[4] * y + m[5]
+Pixels whose nearest source pixel lies outside src are set to 0, the taps of
+the interpolation that fall outside src repeat the border pixels. dst and src
+must not overlap.
+*/
+void warpAffine(const ImageViewT<unsigned char> & dst, const ImageViewT<const unsigned char> & src,
+	const double m[6], InterpolationMode mode = INTERPOLATION_BILINEAR, ThreadPool * pPool = NULL);
+void warpAffine(const ImageViewT<unsigned short> & dst, const ImageViewT<const unsigned short> & src,
+	const double m[6], InterpolationMode mode = INTERPOLATION_BILINEAR, ThreadPool * pPool = NULL);
+void warpAffine(const ImageViewT<float> & dst, const ImageViewT<const float> & src,
+	const double m[6], InterpolationMode mode = INTERPOLATION_BILINEAR, ThreadPool * pPool = NULL);
+
+// the inverse map of a rotation by angleDegrees around pixel
+// (src.rows() / 2, src.cols() / 2), in the direction of ImageT::rotateImage
+void rotationMap(double m[6], const double angleDegrees, const int rows, const int cols);
+
+// dst = src rotated by angleDegrees around its center, see rotationMap()
+void rotateImage(const ImageViewT<unsigned char> & dst, const ImageViewT<const unsigned char> & src,
+	const double angleDegrees, InterpolationMode mode = INTERPOLATION_BILINEAR, ThreadPool * pPool = NULL);
+void rotateImage(const ImageViewT<unsigned short> & dst, const ImageViewT<const unsigned short> & src,
+	const double angleDegrees, InterpolationMode mode = INTERPOLATION_BILINEAR, ThreadPool * pPool = NULL);
+void rotateImage(const ImageViewT<float> & dst, const ImageViewT<const float> & src,
+	const double angleDegrees, InterpolationMode mode = INTERPOLATION_BILINEAR, ThreadPool * pPool = NULL);
+
+#endif